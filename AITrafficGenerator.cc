@@ -1,7 +1,10 @@
 #include "AITrafficGenerator.h"
+#include "PacketTrain.h"
+#include "WorkloadType.h"
 #include "inet/common/packet/Packet.h"
 #include <sstream>
 #include <algorithm>
+#include <cmath>
 
 namespace tomahawk6 {
 
@@ -11,8 +14,16 @@ AITrafficGenerator::AITrafficGenerator()
 {
     burstTimer = nullptr;
     collectiveTimer = nullptr;
+    nextOperationId = 0;
+    maxActiveOperations = 0;
+    operationsCompleted = 0;
     totalBytesSent = 0;
     packetsSent = 0;
+    tokensDispatched = 0;
+    tokensDropped = 0;
+    maxDispatchImbalance = 0;
+    totalCrossSwitchHops = 0;
+    collectivesPlaced = 0;
 }
 
 AITrafficGenerator::~AITrafficGenerator()
@@ -20,43 +31,77 @@ AITrafficGenerator::~AITrafficGenerator()
     cancelAndDelete(burstTimer);
     cancelAndDelete(collectiveTimer);
     
-    for (auto timer : operationTimers) {
-        cancelAndDelete(timer);
+    for (auto& entry : activeOperations) {
+        cancelAndDelete(entry.second.completionTimer);
     }
 }
 
 void AITrafficGenerator::initialize()
 {
     // Read parameters
-    std::string workloadStr = par("workloadType").stdstringValue();
-    if (workloadStr == "AllReduce") workloadType = ALL_REDUCE;
-    else if (workloadStr == "AllGather") workloadType = ALL_GATHER;
-    else if (workloadStr == "ReduceScatter") workloadType = REDUCE_SCATTER;
-    else if (workloadStr == "P2P") workloadType = POINT_TO_POINT;
-    else if (workloadStr == "Broadcast") workloadType = BROADCAST;
-    else if (workloadStr == "AllToAll") workloadType = ALL_TO_ALL;
-    else workloadType = ALL_REDUCE;
+    workloadType = parseWorkloadType(par("workloadType"));
     
     trafficIntensity = par("trafficIntensity");
-    burstSize = par("burstSize");
+    burstSize = par("burstSize").intValue();
     burstInterval = par("burstInterval");
     rocevProtocol = par("rocevProtocol");
-    flowSize = par("flowSize");
+    flowSize = par("flowSize").intValue();
     
     // AI-specific parameters (with defaults)
-    tensorSize = par("tensorSize");
-    batchSize = par("batchSize");
+    tensorSize = par("tensorSize").intValue();
     numGPUs = par("numGPUs");
-    computeToCommRatio = par("computeToCommRatio");
+    multicastGroup = par("multicastGroup");
+    
+    // MTU segmentation and packet trains
+    mtu = par("mtu");
+    maxTrainLength = par("maxTrainLength");
+    
+    // A train has to fit the transmit FIFO of the SerDes it may queue at
+    long segmentBytes = mtu + (rocevProtocol ? ROCE_HEADER_BYTES : 0);
+    long maxTrainBytes = par("maxTrainBytes").intValue();
+    if (maxTrainBytes < segmentBytes) {
+        throw cRuntimeError("maxTrainBytes of %ld B is smaller than one MTU segment of %ld B", maxTrainBytes, segmentBytes);
+    }
+    if ((long)maxTrainLength * segmentBytes > maxTrainBytes) {
+        maxTrainLength = maxTrainBytes / segmentBytes;
+        EV << "Packet trains limited to " << maxTrainLength << " segments by maxTrainBytes" << endl;
+    }
+    
+    // Participants of a collective are placed on the switch topology
+    collectiveSize = par("collectiveSize");
+    placement.init(par("gpusPerNode"), par("endpointsPerSwitch"), par("railOptimized"));
+    placement.setPolicy(par("placement").stdstringValue());
+    
+    // Mixture-of-Experts: experts are spread round-robin over the GPUs and
+    // their popularity follows a Zipf law (expertSkew = 0: uniform)
+    localGPU = isVector() ? getIndex() % numGPUs : 0;
+    numExperts = par("numExperts");
+    expertTopK = par("expertTopK");
+    tokensPerStep = par("tokensPerStep");
+    tokenBytes = par("tokenBytes").intValue();
+    capacityFactor = par("capacityFactor");
+    expertComputeTime = par("expertComputeTime");
+    double expertSkew = par("expertSkew");
+    double popularitySum = 0;
+    for (int expert = 0; expert < numExperts; expert++) {
+        expertPopularity.push_back(1.0 / std::pow(expert + 1, expertSkew));
+        popularitySum += expertPopularity.back();
+    }
+    for (auto& popularity : expertPopularity) {
+        popularity /= popularitySum;
+    }
     
     // Initialize statistics
     generatedTrafficSignal = registerSignal("generatedTraffic");
     burstSizeSignal = registerSignal("burstSize");
-    collectiveLatencySignal = registerSignal("collectiveLatency");
+    collectiveDurationSignal = registerSignal("collectiveDuration");
+    dispatchImbalanceSignal = registerSignal("dispatchImbalance");
     
     // Create timers
     burstTimer = new cMessage("burstTimer");
     collectiveTimer = new cMessage("collectiveTimer");
+    pacer.init(this, "out");
+    pacer.setPacketTrains(maxTrainLength, par("nicDataRate").doubleValue());
     
     // Schedule initial traffic generation
     scheduleAt(simTime() + exponential(burstInterval.dbl()), burstTimer);
@@ -71,6 +116,10 @@ void AITrafficGenerator::initialize()
 
 void AITrafficGenerator::handleMessage(cMessage *msg)
 {
+    if (pacer.handleTimer(msg)) {
+        return;
+    }
+    
     if (msg == burstTimer) {
         generateBurst();
         
@@ -90,13 +139,9 @@ void AITrafficGenerator::handleMessage(cMessage *msg)
         return;
     }
     
-    // Check if it's an operation completion timer
-    auto timerIt = std::find(operationTimers.begin(), operationTimers.end(), msg);
-    if (timerIt != operationTimers.end()) {
-        // Complete the collective operation
-        EV << "Collective operation completed at " << simTime() << endl;
-        operationTimers.erase(timerIt);
-        delete msg;
+    // Operation completion timers point to their operation
+    if (msg->isSelfMessage() && msg->getContextPointer() != nullptr) {
+        completeCollectiveOperation(static_cast<CollectiveOperation*>(msg->getContextPointer()));
         return;
     }
     
@@ -113,18 +158,11 @@ void AITrafficGenerator::generateBurst()
     int packetsInBurst = std::max(1L, burstSize / 1500); // Assume 1500 byte packets
     
     for (int i = 0; i < packetsInBurst; i++) {
-        cPacket *packet = createAIPacket("AITraffic", 1500, workloadType);
-        
-        if (rocevProtocol) {
-            addRoCEHeaders(packet);
-        }
+        AIPacket *packet = createAIPacket("AITraffic", 1500, workloadType);
         
         // Add some jitter to packet timing within burst
         simtime_t sendTime = simTime() + uniform(0, 0.001); // Up to 1ms jitter
-        sendDelayed(packet, sendTime - simTime(), "out");
-        
-        totalBytesSent += packet->getByteLength();
-        packetsSent++;
+        sendMessage(packet, sendTime - simTime());
         
         emit(generatedTrafficSignal, packet->getBitLength());
     }
@@ -135,186 +173,334 @@ void AITrafficGenerator::generateBurst()
 
 void AITrafficGenerator::startCollectiveOperation(AIWorkloadType type)
 {
-    CollectiveOperation op;
+    long id = nextOperationId++;
+    CollectiveOperation& op = activeOperations[id];
+    op.id = id;
     op.type = type;
-    op.participantCount = uniform(4, numGPUs); // Random number of participants
+    op.participantCount = (collectiveSize > 0) ? std::min(collectiveSize, numGPUs) : (int)uniform(4, numGPUs);
     op.dataSize = calculateMessageSize(type);
     op.startTime = simTime();
     op.participants = selectParticipants(op.participantCount);
     op.duration = calculateCollectiveDuration(type, op.participantCount, op.dataSize);
     
-    activeOperations.push_back(op);
+    // Only the placed GPUs take part; this GPU's rank is its position in
+    // the placement order
+    int rank = std::find(op.participants.begin(), op.participants.end(), localGPU) - op.participants.begin();
+    if (rank == (int)op.participants.size()) {
+        activeOperations.erase(id);
+        return;
+    }
+    maxActiveOperations = std::max(maxActiveOperations, activeOperations.size());
     
     // Generate traffic for this collective operation
     switch (type) {
         case ALL_REDUCE:
-            generateAllReduceTraffic();
+            generateAllReduceTraffic(op, rank);
             break;
         case ALL_GATHER:
-            generateAllGatherTraffic();
+            generateAllGatherTraffic(op, rank);
             break;
         case REDUCE_SCATTER:
-            generateReduceScatterTraffic();
+            generateReduceScatterTraffic(op, rank);
             break;
         case POINT_TO_POINT:
-            generateP2PTraffic();
+            generateP2PTraffic(op, rank);
+            break;
+        case BROADCAST:
+            generateBroadcastTraffic(op, rank);
+            break;
+        case ALL_TO_ALL:
+            generateAllToAllTraffic(op, rank);
             break;
         default:
-            generateAllReduceTraffic(); // Default case
+            generateAllReduceTraffic(op, rank); // Default case
             break;
     }
     
-    // Schedule operation completion
-    cMessage *completionTimer = new cMessage("operationComplete");
-    operationTimers.push_back(completionTimer);
-    scheduleAt(simTime() + op.duration, completionTimer);
+    // Schedule operation completion; map entries keep their address
+    op.completionTimer = new cMessage("operationComplete");
+    op.completionTimer->setContextPointer(&op);
+    scheduleAt(simTime() + op.duration, op.completionTimer);
     
-    EV << "Started " << getWorkloadTypeString() << " operation with " 
+    EV << "Started " << getWorkloadTypeString() << " operation " << op.id << " with " 
        << op.participantCount << " participants, " 
        << op.dataSize/1024/1024 << " MB data" << endl;
 }
 
-void AITrafficGenerator::generateAllReduceTraffic()
+void AITrafficGenerator::completeCollectiveOperation(CollectiveOperation *op)
+{
+    // The timer fires after the modelled duration; nothing is measured on
+    // the network (see CollectiveEndpoint for that)
+    emit(collectiveDurationSignal, op->duration);
+    modelledDurations[op->type].collect(op->duration);
+    operationsCompleted++;
+    
+    EV << "Collective operation " << op->id << " completed after " << op->duration << "s" << endl;
+    
+    long id = op->id;
+    delete op->completionTimer;
+    activeOperations.erase(id);
+}
+
+void AITrafficGenerator::generateAllReduceTraffic(const CollectiveOperation& op, int rank)
 {
-    // AllReduce: each participant sends to all others, then receives reduced result
+    // Ring AllReduce over the participants in rank order
     // Phase 1: Reduce-scatter (each node gets partial results)
     // Phase 2: All-gather (distribute final results)
-    
-    long messageSize = tensorSize / numGPUs; // Divide tensor among participants
+    int ranks = op.participants.size();
+    int next = op.participants[(rank + 1) % ranks];
+    long messageSize = op.dataSize / ranks; // Divide tensor among participants
     
     // Generate reduce-scatter phase traffic
-    for (int round = 0; round < numGPUs - 1; round++) {
-        cPacket *packet = createAIPacket("AllReduce_RS", messageSize, ALL_REDUCE);
-        packet->addPar("phase") = "reduce_scatter";
-        packet->addPar("round") = round;
-        
-        if (rocevProtocol) {
-            addRoCEHeaders(packet);
-        }
+    for (int round = 0; round < ranks - 1; round++) {
+        AIPacket *packet = createAIPacket("AllReduce_RS", messageSize, ALL_REDUCE);
+        addCollectiveMetadata(packet, op);
+        packet->setSource(localGPU);
+        packet->setDestination(next);
+        packet->setPhase(PHASE_REDUCE_SCATTER);
+        packet->setRound(round);
         
         simtime_t sendDelay = round * 0.001; // 1ms between rounds
-        sendDelayed(packet, sendDelay, "out");
-        
-        totalBytesSent += packet->getByteLength();
-        packetsSent++;
+        sendMessage(packet, sendDelay);
     }
     
     // Generate all-gather phase traffic
-    for (int round = 0; round < numGPUs - 1; round++) {
-        cPacket *packet = createAIPacket("AllReduce_AG", messageSize, ALL_REDUCE);
-        packet->addPar("phase") = "all_gather";
-        packet->addPar("round") = round;
-        
-        if (rocevProtocol) {
-            addRoCEHeaders(packet);
-        }
-        
-        simtime_t sendDelay = (numGPUs - 1) * 0.001 + round * 0.001;
-        sendDelayed(packet, sendDelay, "out");
+    for (int round = 0; round < ranks - 1; round++) {
+        AIPacket *packet = createAIPacket("AllReduce_AG", messageSize, ALL_REDUCE);
+        addCollectiveMetadata(packet, op);
+        packet->setSource(localGPU);
+        packet->setDestination(next);
+        packet->setPhase(PHASE_ALL_GATHER);
+        packet->setRound(round);
         
-        totalBytesSent += packet->getByteLength();
-        packetsSent++;
+        simtime_t sendDelay = (ranks - 1) * 0.001 + round * 0.001;
+        sendMessage(packet, sendDelay);
     }
 }
 
-void AITrafficGenerator::generateAllGatherTraffic()
+void AITrafficGenerator::generateAllGatherTraffic(const CollectiveOperation& op, int rank)
 {
-    // AllGather: each participant broadcasts its data to all others
-    long messageSize = tensorSize / numGPUs;
+    // AllGather: every participant's chunk reaches all others
+    int ranks = op.participants.size();
+    
+    // With a multicast group each chunk is sent once and replicated by the switch
+    if (multicastGroup >= 0) {
+        AIPacket *packet = createAIPacket("AllGather", op.dataSize, ALL_GATHER);
+        addCollectiveMetadata(packet, op);
+        packet->setSource(localGPU);
+        packet->setMulticastGroup(multicastGroup);
+        sendMessage(packet, 0);
+        return;
+    }
     
-    for (int participant = 0; participant < numGPUs; participant++) {
-        cPacket *packet = createAIPacket("AllGather", messageSize, ALL_GATHER);
-        packet->addPar("source") = participant;
-        
-        if (rocevProtocol) {
-            addRoCEHeaders(packet);
-        }
+    // Otherwise around the ring: each round forwards one chunk to the next rank
+    for (int round = 0; round < ranks - 1; round++) {
+        AIPacket *packet = createAIPacket("AllGather", op.dataSize, ALL_GATHER);
+        addCollectiveMetadata(packet, op);
+        packet->setSource(localGPU);
+        packet->setDestination(op.participants[(rank + 1) % ranks]);
+        packet->setRound(round);
         
-        simtime_t sendDelay = participant * 0.0005; // 0.5ms stagger
-        sendDelayed(packet, sendDelay, "out");
+        simtime_t sendDelay = round * 0.0005; // 0.5ms stagger
+        sendMessage(packet, sendDelay);
+    }
+}
+
+void AITrafficGenerator::generateReduceScatterTraffic(const CollectiveOperation& op, int rank)
+{
+    // ReduceScatter: data is reduced and scattered around the ring
+    int ranks = op.participants.size();
+    long messageSize = op.dataSize / ranks;
+    
+    for (int round = 0; round < ranks - 1; round++) {
+        AIPacket *packet = createAIPacket("ReduceScatter", messageSize, REDUCE_SCATTER);
+        addCollectiveMetadata(packet, op);
+        packet->setSource(localGPU);
+        packet->setDestination(op.participants[(rank + 1) % ranks]);
+        packet->setRound(round);
         
-        totalBytesSent += packet->getByteLength();
-        packetsSent++;
+        simtime_t sendDelay = round * 0.001;
+        sendMessage(packet, sendDelay);
     }
 }
 
-void AITrafficGenerator::generateReduceScatterTraffic()
+void AITrafficGenerator::generateP2PTraffic(const CollectiveOperation& op, int rank)
 {
-    // ReduceScatter: data is reduced and scattered among participants
-    long totalData = tensorSize;
-    long messageSize = totalData / numGPUs;
+    // Point-to-point communication to the next rank
+    if (op.participants.size() < 2) {
+        return;
+    }
+    AIPacket *packet = createAIPacket("P2P", op.dataSize, POINT_TO_POINT);
+    addCollectiveMetadata(packet, op);
+    packet->setSource(localGPU);
+    packet->setDestination(op.participants[(rank + 1) % op.participants.size()]);
     
-    for (int round = 0; round < numGPUs - 1; round++) {
-        cPacket *packet = createAIPacket("ReduceScatter", messageSize, REDUCE_SCATTER);
-        packet->addPar("round") = round;
-        
-        if (rocevProtocol) {
-            addRoCEHeaders(packet);
+    sendMessage(packet, 0);
+}
+
+void AITrafficGenerator::generateBroadcastTraffic(const CollectiveOperation& op, int rank)
+{
+    // Broadcast: rank 0 distributes the full tensor (e.g. parameters) to all ranks
+    int ranks = op.participants.size();
+    if (multicastGroup >= 0) {
+        // Single copy from the root, replicated at switch egress
+        if (rank == 0) {
+            AIPacket *packet = createAIPacket("Broadcast", op.dataSize, BROADCAST);
+            addCollectiveMetadata(packet, op);
+            packet->setSource(localGPU);
+            packet->setMulticastGroup(multicastGroup);
+            sendMessage(packet, 0);
         }
+        return;
+    }
+    
+    // Without multicast support the tensor travels down a binomial tree:
+    // rank r forwards to r + 2^k for every 2^k > r, one level per step
+    int level = 0;
+    for (int distance = 1; distance < ranks; distance *= 2, level++) {
+        if (distance <= rank || rank + distance >= ranks) {
+            continue;
+        }
+        AIPacket *packet = createAIPacket("Broadcast", op.dataSize, BROADCAST);
+        addCollectiveMetadata(packet, op);
+        packet->setSource(localGPU);
+        packet->setDestination(op.participants[rank + distance]);
         
-        simtime_t sendDelay = round * 0.001;
-        sendDelayed(packet, sendDelay, "out");
-        
-        totalBytesSent += packet->getByteLength();
-        packetsSent++;
+        simtime_t sendDelay = level * 0.0001; // 0.1ms per tree level
+        sendMessage(packet, sendDelay);
     }
 }
 
-void AITrafficGenerator::generateP2PTraffic()
+void AITrafficGenerator::generateAllToAllTraffic(const CollectiveOperation& op, int rank)
 {
-    // Point-to-point communication
-    long messageSize = uniform(1024, flowSize); // Variable message size
+    // MoE layer seen from this GPU: dispatch the local tokens to the ranks
+    // hosting their experts, then return the outputs of the local experts.
+    // Experts are spread round-robin over the participants in rank order.
+    int ranks = op.participants.size();
+    long dropped = 0;
+    std::vector<long> expertTokens = sampleExpertLoad(tokensPerStep * expertTopK, dropped);
+    tokensDropped += dropped;
+    
+    // Dispatch: one message per destination rank, sized by its experts' load
+    std::vector<long> dispatchTokens(ranks, 0);
+    for (int expert = 0; expert < numExperts; expert++) {
+        dispatchTokens[expert % ranks] += expertTokens[expert];
+        tokensDispatched += expertTokens[expert];
+    }
+    
+    long maxTokens = *std::max_element(dispatchTokens.begin(), dispatchTokens.end());
+    double meanTokens = (double)tokensPerStep * expertTopK / ranks;
+    double imbalance = meanTokens > 0 ? maxTokens / meanTokens : 0;
+    maxDispatchImbalance = std::max(maxDispatchImbalance, imbalance);
+    emit(dispatchImbalanceSignal, imbalance);
+    
+    for (int destination = 0; destination < ranks; destination++) {
+        if (destination == rank || dispatchTokens[destination] == 0) {
+            continue;   // Local experts need no network transfer
+        }
+        AIPacket *packet = createAIPacket("AllToAll_Dispatch", dispatchTokens[destination] * tokenBytes, ALL_TO_ALL);
+        addCollectiveMetadata(packet, op);
+        packet->setSource(localGPU);
+        packet->setDestination(op.participants[destination]);
+        packet->setPhase(PHASE_DISPATCH);
+        sendMessage(packet, 0);
+    }
     
-    cPacket *packet = createAIPacket("P2P", messageSize, POINT_TO_POINT);
+    // Combine: after expert compute, the local experts return the outputs of
+    // the tokens every other GPU routed to them. All GPUs route by the same
+    // popularity law, so this step's sample of the local experts' load
+    // stands for each source; no second draw, no second count of drops
+    long combineTokens = dispatchTokens[rank];
+    if (combineTokens == 0) {
+        return;
+    }
     
+    for (int source = 0; source < ranks; source++) {
+        if (source == rank) {
+            continue;
+        }
+        AIPacket *packet = createAIPacket("AllToAll_Combine", combineTokens * tokenBytes, ALL_TO_ALL);
+        addCollectiveMetadata(packet, op);
+        packet->setSource(localGPU);
+        packet->setDestination(op.participants[source]);
+        packet->setPhase(PHASE_COMBINE);
+        sendMessage(packet, expertComputeTime);
+    }
+}
+
+std::vector<long> AITrafficGenerator::sampleExpertLoad(int tokens, long& dropped)
+{
+    // Multinomial draw over the experts via conditional binomials; each
+    // expert accepts at most its capacity
+    long capacity = (long)std::ceil(capacityFactor * tokens / numExperts);
+    std::vector<long> load(numExperts, 0);
+    
+    int remaining = tokens;
+    double remainingProbability = 1.0;
+    for (int expert = 0; expert < numExperts && remaining > 0; expert++) {
+        double p = std::min(1.0, expertPopularity[expert] / remainingProbability);
+        int routed = (p >= 1.0) ? remaining : binomial(remaining, p);
+        remaining -= routed;
+        remainingProbability -= expertPopularity[expert];
+        
+        load[expert] = std::min((long)routed, capacity);
+        dropped += routed - load[expert];
+    }
+    return load;
+}
+
+void AITrafficGenerator::sendMessage(AIPacket *packet, simtime_t delay)
+{
+    int headerBytes = 0;
     if (rocevProtocol) {
         addRoCEHeaders(packet);
+        headerBytes = ROCE_HEADER_BYTES;
     }
     
-    send(packet, "out");
+    // Messages larger than the MTU leave as MTU segments (or packet trains)
+    PacketTrain::segmentMessage(packet, mtu, headerBytes);
+    pacer.enqueue(packet, delay);
     
-    totalBytesSent += packet->getByteLength();
-    packetsSent++;
+    totalBytesSent += PacketTrain::getMessageWireBytes(packet);
+    packetsSent += packet->getSegmentCount();
 }
 
-cPacket* AITrafficGenerator::createAIPacket(const std::string& name, long size, AIWorkloadType type)
+AIPacket* AITrafficGenerator::createAIPacket(const std::string& name, long size, AIWorkloadType type)
 {
     std::stringstream packetName;
     packetName << name << "_" << packetsSent;
     
-    cPacket *packet = new cPacket(packetName.str().c_str());
+    AIPacket *packet = new AIPacket(packetName.str().c_str());
     packet->setByteLength(size);
     packet->setKind(type);
     packet->setTimestamp(simTime());
     
     // Add AI-specific metadata
-    packet->addPar("aiWorkload") = true;
-    packet->addPar("tensorSize") = tensorSize;
-    packet->addPar("batchSize") = batchSize;
-    packet->addPar("workloadType") = (int)type;
+    packet->setWorkloadType(type);
+    packet->setTensorSize(tensorSize);
     
     return packet;
 }
 
-void AITrafficGenerator::addRoCEHeaders(cPacket* packet)
+void AITrafficGenerator::addRoCEHeaders(AIPacket* packet)
 {
     // Simulate RoCEv2 header overhead
     long originalSize = packet->getByteLength();
-    packet->setByteLength(originalSize + 42); // RoCEv2 header size
+    packet->setByteLength(originalSize + ROCE_HEADER_BYTES);
     
-    // Add RoCEv2 specific parameters
-    packet->addPar("roce") = true;
-    packet->addPar("queuePair") = uniform(1, 1000);
-    packet->addPar("packetSeqNum") = packetsSent;
+    // Add RoCEv2 specific fields
+    packet->setRoce(true);
+    packet->setQueuePair(intuniform(1, 1000));
+    packet->setPacketSeqNum(packetsSent);
     
     EV << "Added RoCEv2 headers to packet " << packet->getName() << endl;
 }
 
-void AITrafficGenerator::addCollectiveMetadata(cPacket* packet, const CollectiveOperation& op)
+void AITrafficGenerator::addCollectiveMetadata(AIPacket* packet, const CollectiveOperation& op)
 {
-    packet->addPar("collectiveType") = (int)op.type;
-    packet->addPar("participantCount") = op.participantCount;
-    packet->addPar("operationId") = activeOperations.size() - 1;
+    packet->setCollectiveType(op.type);
+    packet->setParticipantCount(op.participantCount);
+    packet->setOperationId(op.id);
 }
 
 simtime_t AITrafficGenerator::calculateCollectiveDuration(AIWorkloadType type, int participants, long dataSize)
@@ -335,6 +521,15 @@ simtime_t AITrafficGenerator::calculateCollectiveDuration(AIWorkloadType type, i
             return baseLatency * log2(participants) + bandwidthFactor;
         case POINT_TO_POINT:
             return baseLatency + bandwidthFactor;
+        case BROADCAST:
+            // O(log P) tree, or a single replicated copy with multicast
+            if (multicastGroup >= 0) {
+                return baseLatency + bandwidthFactor;
+            }
+            return baseLatency * log2(participants) + bandwidthFactor;
+        case ALL_TO_ALL:
+            // Dispatch and combine around the expert computation
+            return 2 * (baseLatency + bandwidthFactor) + expertComputeTime.dbl();
         default:
             return baseLatency + bandwidthFactor;
     }
@@ -342,9 +537,17 @@ simtime_t AITrafficGenerator::calculateCollectiveDuration(AIWorkloadType type, i
 
 std::vector<int> AITrafficGenerator::selectParticipants(int count)
 {
-    std::vector<int> participants;
-    for (int i = 0; i < count; i++) {
-        participants.push_back(i);
+    std::vector<int> gpus;
+    for (int i = 0; i < numGPUs; i++) {
+        gpus.push_back(i);
+    }
+    
+    // Rank order follows the placement; every ring hop between switches
+    // crosses the spine
+    std::vector<int> participants = placement.place(gpus, count);
+    if (participants.size() > 1) {
+        totalCrossSwitchHops += (double)placement.countCrossSwitchHops(participants) / participants.size();
+        collectivesPlaced++;
     }
     return participants;
 }
@@ -360,63 +563,15 @@ long AITrafficGenerator::calculateMessageSize(AIWorkloadType type)
             return tensorSize; // Full tensor, then scattered
         case POINT_TO_POINT:
             return uniform(1024, flowSize);
+        case BROADCAST:
+            return tensorSize; // Full tensor from the root
+        case ALL_TO_ALL:
+            return (long)tokensPerStep * expertTopK * tokenBytes; // Routed tokens
         default:
             return tensorSize;
     }
 }
 
-void AITrafficGenerator::modelTrainingIteration()
-{
-    // Model a complete training iteration
-    // 1. Forward pass (minimal communication)
-    // 2. Backward pass with gradient synchronization
-    
-    EV << "Modeling training iteration" << endl;
-    
-    // Generate gradient synchronization traffic (AllReduce)
-    startCollectiveOperation(ALL_REDUCE);
-}
-
-void AITrafficGenerator::modelInferenceWorkload()
-{
-    // Model inference workload with different communication patterns
-    EV << "Modeling inference workload" << endl;
-    
-    // Inference typically has more P2P communication
-    for (int i = 0; i < uniform(1, 5); i++) {
-        generateP2PTraffic();
-    }
-}
-
-void AITrafficGenerator::modelParameterServerPattern()
-{
-    // Model parameter server communication pattern
-    EV << "Modeling parameter server pattern" << endl;
-    
-    // Workers send gradients to parameter server
-    for (int worker = 0; worker < numGPUs; worker++) {
-        cPacket *gradientPacket = createAIPacket("Gradient", tensorSize / numGPUs, POINT_TO_POINT);
-        gradientPacket->addPar("destination") = "ParameterServer";
-        
-        sendDelayed(gradientPacket, worker * 0.0001, "out"); // 0.1ms stagger
-        
-        totalBytesSent += gradientPacket->getByteLength();
-        packetsSent++;
-    }
-    
-    // Parameter server sends updated parameters back
-    for (int worker = 0; worker < numGPUs; worker++) {
-        cPacket *paramPacket = createAIPacket("Parameters", tensorSize / numGPUs, POINT_TO_POINT);
-        paramPacket->addPar("source") = "ParameterServer";
-        
-        simtime_t sendDelay = 0.001 + worker * 0.0001; // After gradient collection
-        sendDelayed(paramPacket, sendDelay, "out");
-        
-        totalBytesSent += paramPacket->getByteLength();
-        packetsSent++;
-    }
-}
-
 std::string AITrafficGenerator::getWorkloadTypeString() const
 {
     switch (workloadType) {
@@ -437,6 +592,28 @@ void AITrafficGenerator::finish()
     recordScalar("Packets Sent", packetsSent);
     recordScalar("Average Packet Size", packetsSent > 0 ? (double)totalBytesSent / packetsSent : 0);
     recordScalar("Active Operations", activeOperations.size());
+    recordScalar("Max Active Operations", maxActiveOperations);
+    recordScalar("Collectives Completed", operationsCompleted);
+    recordScalar("Max Paced Packets", pacer.getMaxPending());
+    recordScalar("Pacer Timer Events", pacer.getTimerEvents());
+    recordScalar("Max Train Length", maxTrainLength);
+    if (collectivesPlaced > 0) {
+        recordScalar("Average Cross-Switch Ring Hops", totalCrossSwitchHops / collectivesPlaced);
+    }
+    
+    // Modelled duration distribution per collective type
+    cEnum *workloadEnum = cEnum::get("tomahawk6::AIWorkloadType");
+    for (auto& entry : modelledDurations) {
+        std::string statName = std::string("Modelled Duration ") + workloadEnum->getStringFor(entry.first);
+        entry.second.setName(statName.c_str());
+        entry.second.record();
+    }
+    
+    if (tokensDispatched + tokensDropped > 0) {
+        recordScalar("MoE Tokens Routed", tokensDispatched);
+        recordScalar("MoE Tokens Dropped", tokensDropped);
+        recordScalar("MoE Max Dispatch Imbalance", maxDispatchImbalance);
+    }
     
     // Calculate throughput
     simtime_t duration = simTime();
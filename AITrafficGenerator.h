@@ -2,10 +2,14 @@
 #define __TOMAHAWK6_AITRAFFICGENERATOR_H_
 
 #include <omnetpp.h>
+#include <map>
 #include <vector>
 #include <string>
 #include "inet/common/INETDefs.h"
 #include "inet/common/packet/Packet.h"
+#include "AIPacket_m.h"
+#include "RankPlacement.h"
+#include "TrafficPacer.h"
 
 using namespace omnetpp;
 using namespace inet;
@@ -19,25 +23,20 @@ namespace tomahawk6 {
 class INET_API AITrafficGenerator : public cSimpleModule
 {
   public:
-    enum AIWorkloadType {
-        ALL_REDUCE,
-        ALL_GATHER,
-        REDUCE_SCATTER,
-        POINT_TO_POINT,
-        BROADCAST,
-        ALL_TO_ALL
-    };
-    
     struct CollectiveOperation {
+        long id;
         AIWorkloadType type;
         int participantCount;
         long dataSize;
         simtime_t startTime;
         simtime_t duration;
         std::vector<int> participants;
+        cMessage *completionTimer;      // Carries the operation as context pointer
     };
 
   private:
+    static const int ROCE_HEADER_BYTES = 42;
+    
     // Configuration parameters
     AIWorkloadType workloadType;
     double trafficIntensity;
@@ -47,25 +46,52 @@ class INET_API AITrafficGenerator : public cSimpleModule
     long flowSize;
     
     // AI-specific parameters
-    int tensorSize;
-    int batchSize;
+    long tensorSize;
     int numGPUs;
-    double computeToCommRatio;
+    int multicastGroup;
+    int mtu;
+    int maxTrainLength;
+    
+    // Topology-aware participant placement
+    int collectiveSize;
+    RankPlacement placement;
+    double totalCrossSwitchHops;
+    long collectivesPlaced;
     
-    // State tracking
-    std::vector<CollectiveOperation> activeOperations;
+    // Mixture-of-Experts all-to-all
+    int localGPU;
+    int numExperts;
+    int expertTopK;
+    int tokensPerStep;
+    long tokenBytes;
+    double capacityFactor;
+    simtime_t expertComputeTime;
+    std::vector<double> expertPopularity;   // Zipf weights, expert 0 is the hottest
+    long tokensDispatched;
+    long tokensDropped;
+    double maxDispatchImbalance;
+    
+    // State tracking: running operations by id, removed on completion
+    std::map<long, CollectiveOperation> activeOperations;
+    long nextOperationId;
+    size_t maxActiveOperations;
+    long operationsCompleted;
     long totalBytesSent;
     int packetsSent;
     
     // Timers
     cMessage *burstTimer;
     cMessage *collectiveTimer;
-    std::vector<cMessage*> operationTimers;
+    
+    // Paced packet emission (one timer instead of one event per packet)
+    TrafficPacer pacer;
     
     // Statistics
     simsignal_t generatedTrafficSignal;
     simsignal_t burstSizeSignal;
-    simsignal_t collectiveLatencySignal;
+    simsignal_t collectiveDurationSignal;
+    simsignal_t dispatchImbalanceSignal;
+    std::map<int, cHistogram> modelledDurations;    // Per AIWorkloadType
     
   protected:
     virtual void initialize() override;
@@ -75,26 +101,29 @@ class INET_API AITrafficGenerator : public cSimpleModule
     // Traffic generation functions
     virtual void generateBurst();
     virtual void startCollectiveOperation(AIWorkloadType type);
-    virtual void generateAllReduceTraffic();
-    virtual void generateAllGatherTraffic();
-    virtual void generateReduceScatterTraffic();
-    virtual void generateP2PTraffic();
+    virtual void completeCollectiveOperation(CollectiveOperation *op);
+    
+    // This GPU's share of op as its participant rank; ring and tree
+    // neighbours follow the placement order
+    virtual void generateAllReduceTraffic(const CollectiveOperation& op, int rank);
+    virtual void generateAllGatherTraffic(const CollectiveOperation& op, int rank);
+    virtual void generateReduceScatterTraffic(const CollectiveOperation& op, int rank);
+    virtual void generateP2PTraffic(const CollectiveOperation& op, int rank);
+    virtual void generateBroadcastTraffic(const CollectiveOperation& op, int rank);
+    virtual void generateAllToAllTraffic(const CollectiveOperation& op, int rank);
+    virtual std::vector<long> sampleExpertLoad(int tokens, long& dropped);
     
     // Packet creation
-    virtual cPacket* createAIPacket(const std::string& name, long size, AIWorkloadType type);
-    virtual void addRoCEHeaders(cPacket* packet);
-    virtual void addCollectiveMetadata(cPacket* packet, const CollectiveOperation& op);
+    virtual AIPacket* createAIPacket(const std::string& name, long size, AIWorkloadType type);
+    virtual void addRoCEHeaders(AIPacket* packet);
+    virtual void addCollectiveMetadata(AIPacket* packet, const CollectiveOperation& op);
+    virtual void sendMessage(AIPacket *packet, simtime_t delay);
     
     // Workload modeling
     virtual simtime_t calculateCollectiveDuration(AIWorkloadType type, int participants, long dataSize);
     virtual std::vector<int> selectParticipants(int count);
     virtual long calculateMessageSize(AIWorkloadType type);
     
-    // AI workload patterns
-    virtual void modelTrainingIteration();
-    virtual void modelInferenceWorkload();
-    virtual void modelParameterServerPattern();
-    
   public:
     AITrafficGenerator();
     virtual ~AITrafficGenerator();
@@ -3,18 +3,28 @@
 //
 
 #include <omnetpp.h>
+#include "AIPacket_m.h"
+#include "LatencyHistogram.h"
+#include "PacketTrain.h"
 
 using namespace omnetpp;
+using tomahawk6::AIPacket;
+using tomahawk6::LatencyHistogram;
 
 class AdvancedSink : public cSimpleModule
 {
   private:
     int packetsReceived;
     long totalBytes;
-    std::map<std::string, int> workloadCounts;
-    simtime_t lastPacketTime;
-    cOutVector throughputVector;
-    cOutVector latencyVector;
+    std::map<int, int> workloadCounts;
+    
+    // Streaming latency percentiles: whole sink, per workload type and
+    // optionally per source endpoint
+    int histogramPrecision;
+    bool perFlowLatency;
+    LatencyHistogram latency;
+    std::map<int, LatencyHistogram> workloadLatency;
+    std::map<int, LatencyHistogram> flowLatency;
 
   protected:
     virtual void initialize() override;
@@ -28,10 +38,9 @@ void AdvancedSink::initialize()
 {
     packetsReceived = 0;
     totalBytes = 0;
-    lastPacketTime = 0;
-    
-    throughputVector.setName("Throughput");
-    latencyVector.setName("Latency");
+    histogramPrecision = par("histogramPrecision");
+    perFlowLatency = par("perFlowLatency");
+    latency = LatencyHistogram(histogramPrecision);
     
     EV << "Initializing AdvancedSink for AI workload analysis" << endl;
 }
@@ -40,31 +49,29 @@ void AdvancedSink::handleMessage(cMessage *msg)
 {
     cPacket *packet = check_and_cast<cPacket *>(msg);
     
-    packetsReceived++;
-    totalBytes += packet->getByteLength();
+    // Multicast copies carry the shared original packet as payload
+    cPacket *original = packet->hasEncapsulatedPacket() ? packet->getEncapsulatedPacket() : packet;
     
-    // Analyze AI workload characteristics
-    if (packet->hasPar("workloadType")) {
-        std::string workloadType = packet->par("workloadType").stringValue();
-        workloadCounts[workloadType]++;
-        
-        EV << "Received " << workloadType << " packet, size: " 
-           << packet->getByteLength() << " bytes" << endl;
-    }
+    // A packet train counts as the MTU frames it carries
+    packetsReceived += tomahawk6::PacketTrain::getSegmentsCarried(original);
+    totalBytes += packet->getByteLength();
     
     // Calculate and record latency
-    simtime_t latency = simTime() - packet->getCreationTime();
-    latencyVector.record(latency);
+    simtime_t packetLatency = simTime() - original->getCreationTime();
+    latency.collect(packetLatency);
     
-    // Calculate throughput
-    if (lastPacketTime > 0) {
-        double timeDiff = (simTime() - lastPacketTime).dbl();
-        if (timeDiff > 0) {
-            double instantThroughput = packet->getByteLength() / timeDiff;
-            throughputVector.record(instantThroughput);
+    // Analyze AI workload characteristics
+    AIPacket *aiPacket = dynamic_cast<AIPacket *>(original);
+    if (aiPacket != nullptr) {
+        workloadCounts[aiPacket->getWorkloadType()]++;
+        workloadLatency.try_emplace(aiPacket->getWorkloadType(), histogramPrecision).first->second.collect(packetLatency);
+        if (perFlowLatency && aiPacket->getSource() >= 0) {
+            flowLatency.try_emplace(aiPacket->getSource(), histogramPrecision).first->second.collect(packetLatency);
         }
+        
+        EV << "Received workload " << aiPacket->getWorkloadType() << " packet, size: " 
+           << packet->getByteLength() << " bytes" << endl;
     }
-    lastPacketTime = simTime();
     
     delete msg;
 }
@@ -76,11 +83,24 @@ void AdvancedSink::finish()
     recordScalar("Average Throughput (bytes/sec)", totalBytes / simTime().dbl());
     
     // Record per-workload statistics
+    cEnum *workloadEnum = cEnum::get("tomahawk6::AIWorkloadType");
     for (auto& pair : workloadCounts) {
-        std::string statName = "Packets_" + pair.first;
+        std::string statName = std::string("Packets_") + workloadEnum->getStringFor(pair.first);
         recordScalar(statName.c_str(), (double)pair.second);
     }
     
+    // Latency percentiles
+    if (latency.getCount() > 0) {
+        latency.recordScalars(this);
+        recordScalar("Latency Mean", latency.getMean().dbl());
+    }
+    for (auto& pair : workloadLatency) {
+        pair.second.recordScalars(this, std::string(workloadEnum->getStringFor(pair.first)) + " ");
+    }
+    for (auto& pair : flowLatency) {
+        pair.second.recordScalars(this, "Flow " + std::to_string(pair.first) + " ");
+    }
+    
     EV << "AdvancedSink finished: " << packetsReceived 
        << " packets, " << totalBytes << " bytes" << endl;
 }
\ No newline at end of file
@@ -3,8 +3,11 @@
 //
 
 #include <omnetpp.h>
+#include "AIPacket_m.h"
+#include "WorkloadType.h"
 
 using namespace omnetpp;
+using namespace tomahawk6;
 
 class AdvancedTrafficGen : public cSimpleModule
 {
@@ -12,6 +15,7 @@ class AdvancedTrafficGen : public cSimpleModule
     cMessage *timer;
     int packetCount;
     std::string workloadType;
+    AIWorkloadType workloadKind;
     double trafficIntensity;
     long tensorSize;
     int numGPUs;
@@ -37,6 +41,8 @@ void AdvancedTrafficGen::initialize()
     numGPUs = par("numGPUs");
     rocevProtocol = par("rocevProtocol");
     
+    workloadKind = parseWorkloadType(workloadType.c_str());
+    
     EV << "Initializing AdvancedTrafficGen: " << workloadType 
        << " workload, " << numGPUs << " GPUs, " 
        << tensorSize << " B tensors" << endl;
@@ -48,7 +54,7 @@ void AdvancedTrafficGen::handleMessage(cMessage *msg)
 {
     if (msg == timer) {
         // Generate AI workload traffic
-        cPacket *packet = new cPacket(("AI_" + workloadType + "_Packet").c_str());
+        AIPacket *packet = new AIPacket(("AI_" + workloadType + "_Packet").c_str());
         
         // Set packet size based on workload type and tensor size
         int packetSize = 1000; // Base size
@@ -64,9 +70,9 @@ void AdvancedTrafficGen::handleMessage(cMessage *msg)
         packet->setKind(packetCount);
         
         // Add AI workload metadata
-        packet->addPar("workloadType") = workloadType.c_str();
-        packet->addPar("tensorSize") = tensorSize;
-        packet->addPar("rocevProtocol") = rocevProtocol;
+        packet->setWorkloadType(workloadKind);
+        packet->setTensorSize(tensorSize);
+        packet->setRoce(rocevProtocol);
         
         send(packet, "out");
         packetCount++;
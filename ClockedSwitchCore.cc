@@ -0,0 +1,317 @@
+#include "ClockedSwitchCore.h"
+#include "MulticastReplicator.h"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+
+namespace tomahawk6 {
+
+Define_Module(ClockedSwitchCore);
+
+ClockedSwitchCore::ClockedSwitchCore()
+{
+    clockTimer = nullptr;
+    numPorts = 0;
+    bufferUsed = 0;
+    cycle = -1;
+    inFlight = 0;
+    activeCycles = 0;
+    framesIngressed = 0;
+    framesAdmitted = 0;
+    framesSwitched = 0;
+    framesDropped = 0;
+    pausedPortTime = 0;
+    maxInFlight = 0;
+}
+
+ClockedSwitchCore::~ClockedSwitchCore()
+{
+    cancelAndDelete(clockTimer);
+    
+    for (auto& fifo : ingressFifos) {
+        for (cPacket *packet : fifo) {
+            delete packet;
+        }
+    }
+    for (auto& queue : egressQueues) {
+        for (QueuedFrame& frame : queue) {
+            delete frame.packet;
+        }
+    }
+}
+
+void ClockedSwitchCore::initialize()
+{
+    CognitiveRouter::initialize();
+    
+    clockPeriod = par("clockPeriod");
+    pipelineStages = par("pipelineStages");
+    ingressWidth = par("ingressWidth");
+    queuesPerPort = par("queuesPerPort");
+    bufferSize = par("bufferSize");
+    if (clockPeriod <= 0 || pipelineStages < 1 || ingressWidth < 1 || queuesPerPort < 1) {
+        throw cRuntimeError("Invalid clocked pipeline: clockPeriod=%s, pipelineStages=%d, ingressWidth=%d, queuesPerPort=%d",
+                            clockPeriod.str().c_str(), pipelineStages, ingressWidth, queuesPerPort);
+    }
+    
+    numPorts = gateSize("out");
+    ingressFifos.resize(numPorts);
+    egressQueues.resize(numPorts * queuesPerPort);
+    egressFrames.resize(numPorts, 0);
+    egressPaused.resize(numPorts, false);
+    pausedSince.resize(numPorts, 0);
+    ingressListed.resize(numPorts, false);
+    egressListed.resize(numPorts, false);
+    activeIngress.reserve(numPorts);
+    activeEgress.reserve(numPorts);
+    retiring.resize(pipelineStages + 1, 0);
+    
+    pipelineOccupancySignal = registerSignal("pipelineOccupancy");
+    packetDropSignal = registerSignal("packetDrop");
+    
+    clockTimer = new cMessage("clock");
+    
+    EV << "ClockedSwitchCore: " << numPorts << " ports, " << pipelineStages << " pipeline stages at "
+       << 1 / clockPeriod.dbl() / 1e9 << " GHz" << endl;
+}
+
+void ClockedSwitchCore::handleMessage(cMessage *msg)
+{
+    if (msg == clockTimer) {
+        tick();
+        return;
+    }
+    
+    // Router timers
+    if (msg->isSelfMessage()) {
+        CognitiveRouter::handleMessage(msg);
+        return;
+    }
+    
+    // Frame from an ingress SerDes: processed from the next clock edge on
+    int port = msg->getArrivalGate()->getIndex();
+    ingressFifos[port].push_back(check_and_cast<cPacket*>(msg));
+    if (!ingressListed[port]) {
+        ingressListed[port] = true;
+        activeIngress.push_back(port);
+    }
+    scheduleCycle(nextEdge());
+}
+
+void ClockedSwitchCore::tick()
+{
+    advanceTo((long)std::llround(simTime() / clockPeriod));
+    activeCycles++;
+    
+    ingressStage();
+    maxInFlight = std::max(maxInFlight, inFlight);
+    long nextReady = egressStage();
+    
+    emit(pipelineOccupancySignal, inFlight);
+    
+    // Next cycle with work; ports stalled by backpressure restart the clock
+    // when their SerDes resumes them
+    if (!activeIngress.empty()) {
+        scheduleCycle(cycle + 1);
+    } else if (nextReady != LONG_MAX) {
+        scheduleCycle(std::max(cycle + 1, nextReady));
+    }
+}
+
+void ClockedSwitchCore::ingressStage()
+{
+    for (size_t i = 0; i < activeIngress.size(); ) {
+        int port = activeIngress[i];
+        std::deque<cPacket*>& fifo = ingressFifos[port];
+        for (int n = 0; n < ingressWidth && !fifo.empty(); n++) {
+            cPacket *packet = fifo.front();
+            fifo.pop_front();
+            framesIngressed++;
+            processPacket(packet);
+        }
+        
+        if (fifo.empty()) {
+            ingressListed[port] = false;
+            activeIngress[i] = activeIngress.back();
+            activeIngress.pop_back();
+        } else {
+            i++;
+        }
+    }
+}
+
+long ClockedSwitchCore::egressStage()
+{
+    // Returns the first cycle at which an unpaused port has an eligible frame
+    long nextReady = LONG_MAX;
+    
+    for (size_t i = 0; i < activeEgress.size(); ) {
+        int port = activeEgress[i];
+        
+        // Strict priority among the eligible queue heads
+        std::deque<QueuedFrame> *queues = &egressQueues[port * queuesPerPort];
+        for (int q = 0; q < queuesPerPort; q++) {
+            if (!queues[q].empty() && queues[q].front().readyCycle <= cycle) {
+                cPacket *packet = queues[q].front().packet;
+                queues[q].pop_front();
+                egressFrames[port]--;
+                bufferUsed -= packet->getByteLength();
+                framesSwitched++;
+                send(packet, "out", port);
+                break;
+            }
+        }
+        
+        if (egressFrames[port] == 0) {
+            egressListed[port] = false;
+            activeEgress[i] = activeEgress.back();
+            activeEgress.pop_back();
+            continue;
+        }
+        for (int q = 0; q < queuesPerPort; q++) {
+            if (!queues[q].empty()) {
+                nextReady = std::min(nextReady, queues[q].front().readyCycle);
+            }
+        }
+        i++;
+    }
+    return nextReady;
+}
+
+void ClockedSwitchCore::forward(cPacket *packet, int port)
+{
+    // Shared buffer admission
+    if (bufferUsed + packet->getByteLength() > bufferSize) {
+        EV << "Shared buffer full, dropping frame for port " << port << endl;
+        emit(packetDropSignal, 1);
+        framesDropped++;
+        delete packet;
+        return;
+    }
+    
+    long readyCycle = cycle + pipelineStages;
+    egressQueues[port * queuesPerPort + classifyFrame(packet)].push_back({packet, readyCycle});
+    egressFrames[port]++;
+    bufferUsed += packet->getByteLength();
+    if (!egressPaused[port]) {
+        listEgress(port);
+    }
+    
+    retiring[readyCycle % retiring.size()]++;
+    inFlight++;
+    framesAdmitted++;
+}
+
+int ClockedSwitchCore::classifyFrame(cPacket *packet)
+{
+    // Collectives first, then RoCEv2, then everything else
+    AIPacket *aiPacket = dynamic_cast<AIPacket*>(MulticastReplicator::getPayload(packet));
+    int queue = queuesPerPort - 1;
+    if (aiPacket != nullptr && aiPacket->getWorkloadType() != POINT_TO_POINT) {
+        queue = 0;
+    } else if (aiPacket != nullptr && aiPacket->getRoce()) {
+        queue = 1;
+    }
+    return std::min(queue, queuesPerPort - 1);
+}
+
+void ClockedSwitchCore::advanceTo(long now)
+{
+    // Retire the frames whose pipeline delay ended in the skipped cycles;
+    // the last retiring.size() cycles cover every slot
+    long steps = std::min(now - cycle, (long)retiring.size());
+    for (long c = now - steps + 1; c <= now; c++) {
+        int& slot = retiring[c % retiring.size()];
+        inFlight -= slot;
+        slot = 0;
+    }
+    cycle = now;
+}
+
+long ClockedSwitchCore::nextEdge() const
+{
+    long edge = (long)std::ceil(simTime() / clockPeriod - 1e-9);
+    return std::max(cycle + 1, edge);
+}
+
+void ClockedSwitchCore::scheduleCycle(long target)
+{
+    simtime_t time = clockPeriod * target;
+    if (clockTimer->isScheduled()) {
+        if (clockTimer->getArrivalTime() <= time) {
+            return;
+        }
+        cancelEvent(clockTimer);
+    }
+    scheduleAt(time, clockTimer);
+}
+
+void ClockedSwitchCore::setEgressPaused(int port, bool paused)
+{
+    Enter_Method_Silent();
+    
+    if (paused == egressPaused[port]) {
+        return;
+    }
+    egressPaused[port] = paused;
+    
+    // A paused port stays off the active list, resuming puts it back
+    if (paused) {
+        pausedSince[port] = simTime();
+        unlistEgress(port);
+        return;
+    }
+    pausedPortTime += simTime() - pausedSince[port];
+    if (egressFrames[port] > 0) {
+        listEgress(port);
+        scheduleCycle(nextEdge());
+    }
+}
+
+void ClockedSwitchCore::listEgress(int port)
+{
+    if (!egressListed[port]) {
+        egressListed[port] = true;
+        activeEgress.push_back(port);
+    }
+}
+
+void ClockedSwitchCore::unlistEgress(int port)
+{
+    if (!egressListed[port]) {
+        return;
+    }
+    egressListed[port] = false;
+    auto it = std::find(activeEgress.begin(), activeEgress.end(), port);
+    *it = activeEgress.back();
+    activeEgress.pop_back();
+}
+
+void ClockedSwitchCore::finish()
+{
+    CognitiveRouter::finish();
+    
+    // Pipeline occupancy over all cycles (Little's law: every admitted
+    // frame spends pipelineStages cycles in the stages)
+    long cycles = (long)std::floor(simTime() / clockPeriod);
+    double portCycles = (double)cycles * numPorts;
+    recordScalar("Clock Cycles", cycles);
+    recordScalar("Active Cycles", activeCycles);
+    recordScalar("Skipped Idle Cycles", std::max(0L, cycles - activeCycles));
+    recordScalar("Frames Switched", framesSwitched);
+    recordScalar("Frames Dropped", framesDropped);
+    recordScalar("Frames per Active Cycle", activeCycles > 0 ? (double)framesSwitched / activeCycles : 0);
+    recordScalar("Average Pipeline Occupancy", cycles > 0 ? (double)framesAdmitted * pipelineStages / cycles : 0);
+    recordScalar("Max Pipeline Occupancy", maxInFlight);
+    recordScalar("Ingress Stage Utilization", portCycles > 0 ? framesIngressed / (portCycles * ingressWidth) : 0);
+    recordScalar("Egress Stage Utilization", portCycles > 0 ? framesSwitched / portCycles : 0);
+    simtime_t pausedTime = pausedPortTime;
+    for (int port = 0; port < numPorts; port++) {
+        if (egressPaused[port]) {
+            pausedTime += simTime() - pausedSince[port];
+        }
+    }
+    recordScalar("Egress Paused Port Cycles", std::floor(pausedTime / clockPeriod));
+}
+
+} // namespace tomahawk6
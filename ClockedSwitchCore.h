@@ -0,0 +1,112 @@
+#ifndef __TOMAHAWK6_CLOCKEDSWITCHCORE_H_
+#define __TOMAHAWK6_CLOCKEDSWITCHCORE_H_
+
+#include <omnetpp.h>
+#include <deque>
+#include <vector>
+#include "inet/common/INETDefs.h"
+#include "CognitiveRouter.h"
+
+using namespace omnetpp;
+using namespace inet;
+
+namespace tomahawk6 {
+
+/**
+ * Cycle-driven switch core: ingress buffers, cognitive router and egress
+ * buffers of a Tomahawk6Switch as one clocked pipeline
+ *
+ * Frames from the ingress SerDes wait in per-port ingress FIFOs. Each
+ * clock cycle runs the pipeline stages as loops over the active ports
+ * only. Ingress takes up to ingressWidth frames per port. It routes them
+ * with the unchanged CognitiveRouter decision and admits them to the
+ * shared buffer. A frame becomes eligible for egress pipelineStages cycles
+ * later. Egress then hands at most one eligible frame per port to its
+ * SerDes, strict priority over queuesPerPort classes. A port whose SerDes
+ * asserts backpressure leaves the active list until the SerDes resumes
+ * it, so the per-cycle loops only visit ports that can move a frame.
+ *
+ * Cycles without work are skipped. The clock stops when the pipeline
+ * drains, jumps ahead while frames only wait out their pipeline delay, and
+ * restarts on the next clock edge when a frame arrives or a SerDes
+ * resumes. Nearly every executed cycle moves a frame, so a frame costs its
+ * arrival event plus about two cycle events, shared with all frames that
+ * move in the same cycles. The event-driven path spends five to seven
+ * events per frame in the ingress buffer, router and egress buffer.
+ */
+class INET_API ClockedSwitchCore : public CognitiveRouter
+{
+  private:
+    struct QueuedFrame {
+        cPacket *packet;
+        long readyCycle;        // First cycle it may leave the pipeline
+    };
+    
+    // Configuration
+    simtime_t clockPeriod;
+    int pipelineStages;
+    int ingressWidth;           // Frames per port and cycle
+    int queuesPerPort;
+    long bufferSize;
+    int numPorts;
+    
+    // Per-port state; egress queue q of port p is egressQueues[p * queuesPerPort + q]
+    std::vector<std::deque<cPacket*>> ingressFifos;
+    std::vector<std::deque<QueuedFrame>> egressQueues;
+    std::vector<int> egressFrames;
+    std::vector<bool> egressPaused;
+    std::vector<simtime_t> pausedSince;
+    std::vector<bool> ingressListed;
+    std::vector<bool> egressListed;
+    std::vector<int> activeIngress;     // Ports with frames in their ingress FIFO
+    std::vector<int> activeEgress;      // Unpaused ports with queued frames
+    long bufferUsed;
+    
+    // Clock
+    cMessage *clockTimer;
+    long cycle;                 // Last executed cycle
+    std::vector<int> retiring;  // Frames leaving the pipeline stages, per cycle modulo its size
+    long inFlight;              // Frames inside the pipeline stages
+    
+    // Statistics
+    long activeCycles;
+    long framesIngressed;
+    long framesAdmitted;
+    long framesSwitched;
+    long framesDropped;
+    simtime_t pausedPortTime;   // Summed over the ports
+    long maxInFlight;
+    simsignal_t pipelineOccupancySignal;
+    simsignal_t packetDropSignal;
+    
+  protected:
+    virtual void initialize() override;
+    virtual void handleMessage(cMessage *msg) override;
+    virtual void finish() override;
+    
+    // Admits a routed frame to the egress queues of its port
+    virtual void forward(cPacket *packet, int port) override;
+    
+    // Pipeline
+    virtual void tick();
+    virtual void ingressStage();
+    virtual long egressStage();
+    virtual int classifyFrame(cPacket *packet);
+    void advanceTo(long now);
+    long nextEdge() const;
+    void scheduleCycle(long target);
+    void listEgress(int port);
+    void unlistEgress(int port);
+    
+  public:
+    ClockedSwitchCore();
+    virtual ~ClockedSwitchCore();
+    
+    // Called by the egress SerDes: stop or resume a port
+    void setEgressPaused(int port, bool paused);
+    long getBufferUsed() const { return bufferUsed; }
+};
+
+} // namespace tomahawk6
+
+#endif
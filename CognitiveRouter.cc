@@ -1,6 +1,10 @@
 #include "CognitiveRouter.h"
+#include "PacketBuffer.h"
+#include "SerDesCore.h"
 #include "inet/common/packet/Packet.h"
 #include <algorithm>
+#include <cstring>
+#include <fstream>
 #include <sstream>
 
 namespace tomahawk6 {
@@ -45,6 +49,9 @@ void CognitiveRouter::initialize()
     queueDepths.resize(numPorts, 0);
     pathWeights.resize(numPorts, 1);
     lastPortActivity.resize(numPorts, simTime());
+    for (int port = 0; port < numPorts; port++) {
+        egressSerDes.push_back(findEgressSerDes(port));
+    }
     
     // Initialize path metrics
     for (int i = 0; i < numPorts; i++) {
@@ -60,6 +67,24 @@ void CognitiveRouter::initialize()
     congestionLevelSignal = registerSignal("congestionLevel");
     adaptiveRoutingSignal = registerSignal("adaptiveRouting");
     loadBalancingSignal = registerSignal("loadBalancing");
+    multicastFanoutSignal = registerSignal("multicastFanout");
+    
+    // Multicast group table
+    parseMulticastGroups(par("multicastGroups").stringValue());
+    
+    // Endpoints attached in address order: destination i is behind port i.
+    // A TopologyConfigurator adds its routes in a later init stage.
+    routingTable.clear();
+    if (par("directRoutes").boolValue()) {
+        for (int port = 0; port < numPorts; port++) {
+            addRoute(port, std::vector<int>(1, port));
+        }
+    }
+    
+    // Routes computed by a TopologyConfigurator in an earlier run
+    if (strlen(par("routeFile").stringValue()) > 0) {
+        loadRoutes(par("routeFile").stringValue());
+    }
     
     // Setup timers
     if (rapidFailureDetection) {
@@ -77,7 +102,8 @@ void CognitiveRouter::initialize()
         scheduleAt(simTime() + 0.001, congestionUpdateTimer); // 1ms congestion updates
     }
     
-    EV << "CognitiveRouter initialized with " << numPorts << " ports" << endl;
+    EV << "CognitiveRouter initialized with " << numPorts << " ports, "
+       << multicastGroups.size() << " multicast groups" << endl;
     EV << "Features: Adaptive=" << adaptiveRouting 
        << ", Congestion=" << congestionControl 
        << ", LoadBalance=" << loadBalancing << endl;
@@ -103,8 +129,17 @@ void CognitiveRouter::handleMessage(cMessage *msg)
         return;
     }
     
-    // Handle incoming packet
-    cPacket *packet = check_and_cast<cPacket*>(msg);
+    processPacket(check_and_cast<cPacket*>(msg));
+}
+
+void CognitiveRouter::processPacket(cPacket *packet)
+{
+    // Multicast packets are replicated at egress instead of routed
+    int groupId = getMulticastGroup(packet);
+    if (groupId >= 0) {
+        replicateMulticast(packet, groupId);
+        return;
+    }
     
     // Select output port using cognitive routing
     int selectedPort = selectOutputPort(packet);
@@ -115,16 +150,25 @@ void CognitiveRouter::handleMessage(cMessage *msg)
         return;
     }
     
+    // Attribute the packet to its job
+    AIPacket *aiPacket = dynamic_cast<AIPacket*>(packet);
+    int jobId = (aiPacket != nullptr) ? aiPacket->getJobId() : -1;
+    if (jobId >= 0) {
+        jobBytesRouted[jobId] += packet->getByteLength();
+    }
+    
     // Apply congestion control if enabled
     if (congestionControl && isPortCongested(selectedPort)) {
+        if (jobId >= 0) {
+            jobCongestedPackets[jobId]++;
+        }
         applyCongestionControl(packet, selectedPort);
     }
     
     // Update routing decision tracking
     updateRoutingDecision(packet, selectedPort);
     
-    // Send packet with routing latency
-    sendDelayed(packet, routingLatency, "out", selectedPort);
+    forward(packet, selectedPort);
     
     // Update port activity tracking
     lastPortActivity[selectedPort] = simTime();
@@ -132,6 +176,12 @@ void CognitiveRouter::handleMessage(cMessage *msg)
     emit(routingDecisionSignal, selectedPort);
 }
 
+void CognitiveRouter::forward(cPacket *packet, int port)
+{
+    // Send packet with routing latency
+    sendDelayed(packet, routingLatency, "out", port);
+}
+
 int CognitiveRouter::selectOutputPort(cPacket *packet)
 {
     std::string flowId = extractFlowId(packet);
@@ -156,6 +206,27 @@ int CognitiveRouter::selectOutputPort(cPacket *packet)
     
     int selectedPort = -1;
     
+    // Addressed packets only use ports that reach their destination
+    std::vector<int> candidatePorts = getRouteCandidates(packet);
+    if (!candidatePorts.empty()) {
+        double bestScore = -1.0;
+        for (int port : candidatePorts) {
+            double score = calculatePathScore(port, flowIt->second.isAITraffic);
+            if (isPortHealthy(port) && score > bestScore) {
+                bestScore = score;
+                selectedPort = port;
+            }
+        }
+        if (selectedPort == -1) {
+            selectedPort = candidatePorts[0];
+        }
+        
+        if (flowIt->second.isAITraffic) {
+            optimizeForAIWorkload(packet, flowIt->second);
+        }
+        return selectedPort;
+    }
+    
     if (adaptiveRouting) {
         selectedPort = adaptiveRoutingDecision(packet, flowId);
         emit(adaptiveRoutingSignal, 1);
@@ -289,6 +360,10 @@ void CognitiveRouter::updatePathMetrics(int port, cPacket *packet)
 void CognitiveRouter::updateCongestionMetrics()
 {
     for (int port = 0; port < gateSize("out"); port++) {
+        if (egressSerDes[port] != nullptr) {
+            portUtilization[port] = egressSerDes[port]->getWindowUtilization();
+        }
+        
         // Update congestion level
         double congestion = portUtilization[port];
         if (queueDepths[port] > 10) {
@@ -334,6 +409,166 @@ void CognitiveRouter::performPacketTrimming(cPacket *packet)
     EV << "Packet trimmed from " << originalSize << " to " << trimmedSize << " bytes" << endl;
 }
 
+void CognitiveRouter::parseMulticastGroups(const char *groupSpec)
+{
+    // Format: "groupId:port,port,first-last;groupId:..."
+    cStringTokenizer groupTokenizer(groupSpec, ";");
+    while (groupTokenizer.hasMoreTokens()) {
+        std::string entry = groupTokenizer.nextToken();
+        size_t colon = entry.find(':');
+        if (colon == std::string::npos) {
+            throw cRuntimeError("Invalid multicast group entry '%s'", entry.c_str());
+        }
+        
+        int groupId = std::stoi(entry.substr(0, colon));
+        std::string portList = entry.substr(colon + 1);
+        std::vector<int> ports;
+        
+        cStringTokenizer portTokenizer(portList.c_str(), ",");
+        while (portTokenizer.hasMoreTokens()) {
+            std::string range = portTokenizer.nextToken();
+            size_t dash = range.find('-');
+            int first = std::stoi(range.substr(0, dash));
+            int last = (dash == std::string::npos) ? first : std::stoi(range.substr(dash + 1));
+            for (int port = first; port <= last; port++) {
+                ports.push_back(port);
+            }
+        }
+        
+        addMulticastGroup(groupId, ports);
+    }
+}
+
+std::vector<int> CognitiveRouter::getRouteCandidates(cPacket *packet)
+{
+    AIPacket *aiPacket = dynamic_cast<AIPacket*>(packet);
+    if (aiPacket == nullptr || aiPacket->getDestination() < 0) {
+        return std::vector<int>();
+    }
+    
+    auto routeIt = routingTable.find(aiPacket->getDestination());
+    return routeIt != routingTable.end() ? routeIt->second : std::vector<int>();
+}
+
+// Route file lines by router path: (destination, ports) per line
+typedef std::map<std::string, std::vector<std::pair<int, std::vector<int>>>> RouteFile;
+
+// Every router of a fabric reads the same file; it is parsed by the first
+// one and kept for the rest of the run
+static std::map<std::string, std::pair<std::string, RouteFile>> routeFileCache;    // file -> (run id, routes)
+
+static const RouteFile& parseRouteFile(const char *fileName)
+{
+    std::string runId = getEnvir()->getConfigEx()->getVariable(CFGVAR_RUNID);
+    auto cached = routeFileCache.find(fileName);
+    if (cached != routeFileCache.end() && cached->second.first == runId) {
+        return cached->second.second;
+    }
+    
+    // "<router path> <destination> <port> [<port>...]" per line
+    std::ifstream file(fileName);
+    if (!file.is_open()) {
+        throw cRuntimeError("Cannot open route file '%s'", fileName);
+    }
+    
+    std::pair<std::string, RouteFile>& entry = routeFileCache[fileName];
+    entry.first = runId;
+    entry.second.clear();
+    std::string line;
+    while (std::getline(file, line)) {
+        std::istringstream fields(line);
+        std::string router;
+        int destination;
+        if (!(fields >> router) || router[0] == '#') {
+            continue;
+        }
+        if (!(fields >> destination)) {
+            throw cRuntimeError("Route file '%s': missing destination for %s", fileName, router.c_str());
+        }
+        std::vector<int> ports;
+        int port;
+        while (fields >> port) {
+            ports.push_back(port);
+        }
+        entry.second[router].emplace_back(destination, ports);
+    }
+    return entry.second;
+}
+
+void CognitiveRouter::loadRoutes(const char *fileName)
+{
+    const RouteFile& routeFile = parseRouteFile(fileName);
+    auto routerIt = routeFile.find(getFullPath());
+    int routes = 0;
+    if (routerIt != routeFile.end()) {
+        for (auto& route : routerIt->second) {
+            addRoute(route.first, route.second);
+            routes++;
+        }
+    }
+    
+    EV << "Loaded " << routes << " routes from " << fileName << endl;
+}
+
+void CognitiveRouter::addRoute(int destination, const std::vector<int>& ports)
+{
+    Enter_Method_Silent();
+    
+    for (int port : ports) {
+        if (port < 0 || port >= gateSize("out")) {
+            throw cRuntimeError("Route to %d uses invalid port %d", destination, port);
+        }
+    }
+    routingTable[destination] = ports;
+}
+
+int CognitiveRouter::getMulticastGroup(cPacket *packet)
+{
+    AIPacket *aiPacket = dynamic_cast<AIPacket*>(packet);
+    return aiPacket != nullptr ? aiPacket->getMulticastGroup() : -1;
+}
+
+void CognitiveRouter::replicateMulticast(cPacket *packet, int groupId)
+{
+    auto groupIt = multicastGroups.find(groupId);
+    if (groupIt == multicastGroups.end() || groupIt->second.empty()) {
+        EV << "Unknown multicast group " << groupId << ", dropping packet" << endl;
+        delete packet;
+        return;
+    }
+    
+    // One copy per member port, all sharing the original payload
+    const std::vector<int>& ports = groupIt->second;
+    std::vector<cPacket*> copies = replicator.replicate(packet, ports.size());
+    
+    for (size_t i = 0; i < ports.size(); i++) {
+        int port = ports[i];
+        updateRoutingDecision(copies[i], port);
+        forward(copies[i], port);
+        lastPortActivity[port] = simTime();
+        emit(routingDecisionSignal, port);
+    }
+    
+    emit(multicastFanoutSignal, (long)ports.size());
+    EV << "Replicated multicast packet to group " << groupId 
+       << " (" << ports.size() << " ports)" << endl;
+}
+
+void CognitiveRouter::addMulticastGroup(int groupId, const std::vector<int>& ports)
+{
+    for (int port : ports) {
+        if (port < 0 || port >= gateSize("out")) {
+            throw cRuntimeError("Multicast group %d references invalid port %d", groupId, port);
+        }
+    }
+    multicastGroups[groupId] = ports;
+}
+
+void CognitiveRouter::removeMulticastGroup(int groupId)
+{
+    multicastGroups.erase(groupId);
+}
+
 int CognitiveRouter::loadBalancedSelection(const std::vector<int>& candidatePorts)
 {
     if (candidatePorts.empty()) return -1;
@@ -412,11 +647,8 @@ bool CognitiveRouter::isPortHealthy(int port)
 
 bool CognitiveRouter::isAITraffic(cPacket *packet)
 {
-    std::string packetName = packet->getName();
-    return packetName.find("AI") != std::string::npos ||
-           packetName.find("AllReduce") != std::string::npos ||
-           packetName.find("AllGather") != std::string::npos ||
-           packetName.find("RoCE") != std::string::npos;
+    // Multicast copies carry the original AI packet as payload
+    return dynamic_cast<AIPacket*>(MulticastReplicator::getPayload(packet)) != nullptr;
 }
 
 void CognitiveRouter::optimizeForAIWorkload(cPacket *packet, FlowInfo& flow)
@@ -430,8 +662,8 @@ void CognitiveRouter::optimizeForAIWorkload(cPacket *packet, FlowInfo& flow)
     }
     
     // Detect collective communication patterns
-    std::string packetName = packet->getName();
-    if (packetName.find("AllReduce") != std::string::npos) {
+    AIPacket *aiPacket = check_and_cast<AIPacket*>(MulticastReplicator::getPayload(packet));
+    if (aiPacket->getWorkloadType() == ALL_REDUCE) {
         // AllReduce pattern detected, optimize for low latency
         EV << "AllReduce pattern detected, optimizing for latency" << endl;
     }
@@ -455,12 +687,33 @@ void CognitiveRouter::updateRoutingDecision(cPacket *packet, int selectedPort)
     // Update path metrics
     updatePathMetrics(selectedPort, packet);
     
-    // Update port utilization
+    // Update port utilization: measured by the egress SerDes if there is
+    // one, otherwise estimated from the routed bits
+    if (egressSerDes[selectedPort] != nullptr) {
+        portUtilization[selectedPort] = egressSerDes[selectedPort]->getWindowUtilization();
+        return;
+    }
     double alpha = 0.1;
     double instantUtil = (double)packet->getBitLength() / (100e9 * 0.001);
     portUtilization[selectedPort] = alpha * instantUtil + (1 - alpha) * portUtilization[selectedPort];
 }
 
+SerDesCore* CognitiveRouter::findEgressSerDes(int port)
+{
+    // The port feeds its SerDes directly or through an egress PacketBuffer
+    cGate *outGate = gate("out", port);
+    for (int hop = 0; hop < 2 && outGate != nullptr; hop++) {
+        cModule *module = outGate->getPathEndGate()->getOwnerModule();
+        SerDesCore *serdes = dynamic_cast<SerDesCore*>(module);
+        if (serdes != nullptr) {
+            return serdes;
+        }
+        PacketBuffer *buffer = dynamic_cast<PacketBuffer*>(module);
+        outGate = (buffer != nullptr && buffer->gateSize("out") > 0) ? buffer->gate("out", 0) : nullptr;
+    }
+    return nullptr;
+}
+
 void CognitiveRouter::collectTelemetryData()
 {
     // Collect and report advanced telemetry
@@ -516,6 +769,25 @@ void CognitiveRouter::finish()
     }
     
     recordScalar("Active Flows", activeFlows.size());
+    
+    // Multicast replication statistics
+    recordScalar("Multicast Packets", replicator.getPacketsReplicated());
+    recordScalar("Multicast Copies", replicator.getCopiesCreated());
+    recordScalar("Average Multicast Fan-out", replicator.getAverageFanout());
+    recordScalar("Max Multicast Fan-out", replicator.getMaxFanout());
+    recordScalar("Multicast Shared Bytes", replicator.getSharedBytes());
+    recordScalar("Multicast Buffer Savings", replicator.getBufferSavings());
+    
+    // Per-job traffic
+    for (auto& entry : jobBytesRouted) {
+        std::stringstream ss;
+        ss << "Job " << entry.first << " Bytes Routed";
+        recordScalar(ss.str().c_str(), entry.second);
+        
+        ss.str("");
+        ss << "Job " << entry.first << " Congested Packets";
+        recordScalar(ss.str().c_str(), jobCongestedPackets[entry.first]);
+    }
 }
 
 } // namespace tomahawk6
\ No newline at end of file
@@ -7,12 +7,16 @@
 #include <unordered_map>
 #include "inet/common/INETDefs.h"
 #include "inet/common/packet/Packet.h"
+#include "MulticastReplicator.h"
+#include "AIPacket_m.h"
 
 using namespace omnetpp;
 using namespace inet;
 
 namespace tomahawk6 {
 
+class SerDesCore;
+
 /**
  * Cognitive Routing 2.0 implementation for Tomahawk 6
  * Includes adaptive routing, congestion control, and AI optimizations
@@ -55,8 +59,17 @@ class INET_API CognitiveRouter : public cSimpleModule
     std::vector<PathMetrics> pathMetrics;
     std::map<int, std::vector<int>> routingTable;
     
+    // Multicast group table and egress replication
+    std::map<int, std::vector<int>> multicastGroups;
+    MulticastReplicator replicator;
+    
+    // Per-job traffic attribution (multi-tenant runs)
+    std::map<int, long> jobBytesRouted;
+    std::map<int, long> jobCongestedPackets;
+    
     // Congestion control
     std::vector<double> portUtilization;
+    std::vector<SerDesCore*> egressSerDes;     // Measured link load, nullptr if none
     std::vector<int> queueDepths;
     double congestionThreshold;
     
@@ -74,6 +87,7 @@ class INET_API CognitiveRouter : public cSimpleModule
     simsignal_t congestionLevelSignal;
     simsignal_t adaptiveRoutingSignal;
     simsignal_t loadBalancingSignal;
+    simsignal_t multicastFanoutSignal;
     
     // Timers
     cMessage *telemetryTimer;
@@ -85,9 +99,13 @@ class INET_API CognitiveRouter : public cSimpleModule
     virtual void finish() override;
     
     // Core routing functions
+    virtual void processPacket(cPacket *packet);
+    virtual void forward(cPacket *packet, int port);    // Hands a routed packet to its output port
     virtual int selectOutputPort(cPacket *packet);
     virtual void updateRoutingDecision(cPacket *packet, int selectedPort);
     virtual std::string extractFlowId(cPacket *packet);
+    virtual std::vector<int> getRouteCandidates(cPacket *packet);
+    virtual void loadRoutes(const char *fileName);
     
     // Adaptive routing
     virtual int adaptiveRoutingDecision(cPacket *packet, const std::string& flowId);
@@ -96,10 +114,16 @@ class INET_API CognitiveRouter : public cSimpleModule
     
     // Congestion control
     virtual void updateCongestionMetrics();
+    virtual SerDesCore* findEgressSerDes(int port);
     virtual bool isPortCongested(int port);
     virtual void applyCongestionControl(cPacket *packet, int port);
     virtual void performPacketTrimming(cPacket *packet);
     
+    // Multicast
+    virtual void parseMulticastGroups(const char *groupSpec);
+    virtual int getMulticastGroup(cPacket *packet);
+    virtual void replicateMulticast(cPacket *packet, int groupId);
+    
     // Load balancing
     virtual int loadBalancedSelection(const std::vector<int>& candidatePorts);
     virtual void updateLoadBalancingWeights();
@@ -125,6 +149,14 @@ class INET_API CognitiveRouter : public cSimpleModule
     double getPortUtilization(int port) const;
     double getCongestionLevel(int port) const;
     PathMetrics getPathMetrics(int port) const;
+    
+    // Destination routes (destination address -> equal-cost output ports)
+    void addRoute(int destination, const std::vector<int>& ports);
+    
+    // Multicast group management
+    void addMulticastGroup(int groupId, const std::vector<int>& ports);
+    void removeMulticastGroup(int groupId);
+    const MulticastReplicator& getReplicator() const { return replicator; }
 };
 
 } // namespace tomahawk6
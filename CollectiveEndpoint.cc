@@ -0,0 +1,1056 @@
+#include "CollectiveEndpoint.h"
+#include "PacketTrain.h"
+#include "JobScheduler.h"
+#include "WorkloadType.h"
+#include <algorithm>
+#include <sstream>
+
+namespace tomahawk6 {
+
+Define_Module(CollectiveEndpoint);
+
+CollectiveEndpoint::CollectiveEndpoint()
+{
+    startTimer = nullptr;
+    traceTimer = nullptr;
+    coordinator = nullptr;
+    scheduler = nullptr;
+    jobId = -1;
+    iterationsDone = 0;
+    jobCollectivesCompleted = 0;
+    traceMode = false;
+    trainingMode = false;
+    lastLoadedId = -1;
+    runningCollective = -1;
+    operationBytes = 0;
+    operationId = -1;
+    operationRank = -1;
+    channelsDone = 0;
+    totalBytesSent = 0;
+    totalBytesReceived = 0;
+    packetsSent = 0;
+    packetsReceived = 0;
+    stalePackets = 0;
+    crossSwitchBytes = 0;
+    stepsCompleted = 0;
+    localCompletions = 0;
+    totalLocalTime = 0;
+    collectivesCompleted = 0;
+    totalCollectiveTime = 0;
+    maxCollectiveTime = 0;
+    traceRecordsCompleted = 0;
+    maxTraceWindow = 0;
+    trainingIterations = 0;
+    totalIterationTime = 0;
+    maxIterationTime = 0;
+    totalExposedCommTime = 0;
+}
+
+CollectiveEndpoint::~CollectiveEndpoint()
+{
+    cancelAndDelete(startTimer);
+    cancelAndDelete(traceTimer);
+}
+
+void CollectiveEndpoint::initialize()
+{
+    // Read parameters
+    address = par("address");
+    
+    workloadType = parseWorkloadType(par("workloadType"));
+    
+    std::string algorithmStr = par("algorithm").stdstringValue();
+    if (algorithmStr == "Ring") algorithm = RING;
+    else if (algorithmStr == "Tree") algorithm = DOUBLE_BINARY_TREE;
+    else if (algorithmStr == "HalvingDoubling") algorithm = HALVING_DOUBLING;
+    else throw cRuntimeError("Unknown collective algorithm '%s'", algorithmStr.c_str());
+    
+    tensorSize = par("tensorSize").intValue();
+    pipelineChunks = std::max(1, (int)par("pipelineChunks"));
+    numIterations = par("numIterations");
+    operationGap = par("operationGap");
+    rocevProtocol = par("rocevProtocol");
+    mtu = par("mtu");
+    maxTrainLength = par("maxTrainLength");
+    nicDataRate = par("nicDataRate");
+    placement.init(par("gpusPerNode"), par("endpointsPerSwitch"), par("railOptimized"));
+    
+    // Initialize statistics
+    collectiveTimeSignal = registerSignal("collectiveTime");
+    localCompletionSignal = registerSignal("localCompletionTime");
+    iterationTimeSignal = registerSignal("iterationTime");
+    exposedCommTimeSignal = registerSignal("exposedCommTime");
+    
+    pacer.init(this, "out");
+    pacer.setPacketTrains(maxTrainLength, nicDataRate);
+    nicFreeAt = 0;
+    startTimer = new cMessage("collectiveStart");
+    
+    // Managed endpoints wait for a job from the JobScheduler
+    if (par("managed").boolValue()) {
+        rank = -1;
+        EV << "CollectiveEndpoint " << address << " waiting for job assignment" << endl;
+        return;
+    }
+    
+    // Communicator: list of endpoint addresses, rank = position in the list
+    parseCommunicator(par("communicator").stringValue());
+    
+    // Placement picks numRanks of the listed endpoints; their order is the
+    // rank order that the ring and the trees follow
+    std::string placementStr = par("placement").stdstringValue();
+    if (!placementStr.empty()) {
+        int numRanks = par("numRanks");
+        int ranks = (numRanks > 0) ? numRanks : communicator.size();
+        placement.setPolicy(placementStr);
+        communicator = placement.place(communicator, ranks);
+        if (communicator.empty()) {
+            throw cRuntimeError("Cannot place %d ranks on the communicator endpoints", ranks);
+        }
+    }
+    
+    auto rankIt = std::find(communicator.begin(), communicator.end(), address);
+    rank = (rankIt != communicator.end()) ? (int)(rankIt - communicator.begin()) : -1;
+    
+    if (rank < 0) {
+        EV << "CollectiveEndpoint " << address << " is not part of the communicator" << endl;
+        return;
+    }
+    
+    // Rank 0 aggregates the completion of every operation
+    cModule *rootModule = getParentModule()->getSubmodule(getName(), communicator[0]);
+    if (rootModule == nullptr) {
+        throw cRuntimeError("Communicator rank 0 (endpoint %d) not found", communicator[0]);
+    }
+    coordinator = check_and_cast<CollectiveEndpoint*>(rootModule);
+    
+    // Replay mode: one trace per rank, "%d" in the file name is the rank
+    std::string traceFile = par("traceFile").stdstringValue();
+    if (!traceFile.empty()) {
+        size_t rankPos = traceFile.find("%d");
+        if (rankPos != std::string::npos) {
+            traceFile.replace(rankPos, 2, std::to_string(rank));
+        }
+        traceMode = true;
+        traceWindow = std::max(1, (int)par("traceWindow"));
+        trace.open(traceFile, par("traceBufferSize").intValue());
+        traceTimer = new cMessage("traceCompletion");
+    }
+    
+    // Training mode: the records are generated by the iteration model
+    if (par("trainingModel").boolValue()) {
+        if (traceMode) {
+            throw cRuntimeError("traceFile and trainingModel cannot be combined");
+        }
+        int stages = std::max(1, (int)par("pipelineStages"));
+        int replicas = communicator.size() / stages;
+        long gradientBytes = tensorSize / stages;
+        
+        // Compute per iteration: explicit, or computeToCommRatio times the
+        // line-rate ring AllReduce of the stage's gradients
+        simtime_t computeTime = par("computeTime");
+        if (computeTime == 0) {
+            double reducedBytes = (replicas > 1) ? 2.0 * (replicas - 1) / replicas * gradientBytes : gradientBytes;
+            computeTime = par("computeToCommRatio").doubleValue() * reducedBytes * 8 / nicDataRate;
+        }
+        
+        // The batch is split evenly over the microbatches
+        int microbatches = std::max(1, (int)par("microbatches"));
+        long samples = std::max(1, (int)par("batchSize") / microbatches);
+        training.init(rank, communicator.size(), stages, microbatches, par("gradientBuckets"), computeTime,
+                      samples * par("activationSize").intValue(), gradientBytes, numIterations);
+        
+        traceMode = true;
+        trainingMode = true;
+        traceWindow = std::max(1, (int)par("traceWindow"));
+        traceTimer = new cMessage("traceCompletion");
+    }
+    
+    scheduleAt(simTime() + par("startTime"), startTimer);
+    
+    EV << "CollectiveEndpoint initialized: address " << address << ", rank " << rank
+       << "/" << communicator.size() << ", algorithm " << algorithmStr
+       << (trainingMode ? ", training stage " + std::to_string(training.getStage())
+           : traceMode ? ", replaying " + traceFile : std::string("")) << endl;
+}
+
+void CollectiveEndpoint::parseCommunicator(const char *spec)
+{
+    // Format: "address,address,first-last"; empty means all endpoints of the vector
+    if (spec[0] == '\0') {
+        int size = isVector() ? getVectorSize() : 1;
+        for (int i = 0; i < size; i++) {
+            communicator.push_back(i);
+        }
+        return;
+    }
+    
+    cStringTokenizer tokenizer(spec, ",");
+    while (tokenizer.hasMoreTokens()) {
+        std::string range = tokenizer.nextToken();
+        size_t dash = range.find('-');
+        int first = std::stoi(range.substr(0, dash));
+        int last = (dash == std::string::npos) ? first : std::stoi(range.substr(dash + 1));
+        for (int member = first; member <= last; member++) {
+            communicator.push_back(member);
+        }
+    }
+}
+
+void CollectiveEndpoint::buildSchedule()
+{
+    int ranks = operationGroup.size();
+    if (ranks <= 1) {
+        return;
+    }
+    
+    if (algorithm == HALVING_DOUBLING && (ranks & (ranks - 1)) != 0) {
+        throw cRuntimeError("HalvingDoubling needs a power-of-two communicator, got %d ranks", ranks);
+    }
+    if (algorithm == DOUBLE_BINARY_TREE && operationType != ALL_REDUCE) {
+        throw cRuntimeError("Tree algorithm is only defined for AllReduce");
+    }
+    
+    // Every pipeline chunk runs as an independent channel
+    long chunkBytes = std::max(1L, operationBytes / pipelineChunks);
+    for (int chunk = 0; chunk < pipelineChunks; chunk++) {
+        switch (algorithm) {
+            case RING:
+                schedule.push_back(buildRingChannel(chunkBytes));
+                break;
+            case DOUBLE_BINARY_TREE:
+                // Each of the two trees reduces half of the chunk
+                schedule.push_back(buildTreeChannel(0, std::max(1L, chunkBytes / 2)));
+                schedule.push_back(buildTreeChannel(1, std::max(1L, chunkBytes / 2)));
+                break;
+            case HALVING_DOUBLING:
+                schedule.push_back(buildHalvingDoublingChannel(chunkBytes));
+                break;
+        }
+    }
+}
+
+CollectiveEndpoint::Channel CollectiveEndpoint::buildRingChannel(long bytes)
+{
+    Channel channel;
+    int ranks = operationGroup.size();
+    int next = (operationRank + 1) % ranks;
+    long chunk = std::max(1L, bytes / ranks);
+    
+    switch (operationType) {
+        case ALL_REDUCE:
+        case REDUCE_SCATTER:
+        case ALL_GATHER: {
+            // Each step forwards one chunk to the next rank; AllReduce runs
+            // a reduce-scatter ring followed by an all-gather ring
+            int steps = (operationType == ALL_REDUCE) ? 2 * (ranks - 1) : ranks - 1;
+            for (int k = 0; k < steps; k++) {
+                ScheduleStep step;
+                step.sends.push_back({next, k});
+                step.numRecvs = 1;
+                step.bytes = chunk;
+                bool reducing = (operationType == REDUCE_SCATTER) ||
+                                (operationType == ALL_REDUCE && k < ranks - 1);
+                step.phase = reducing ? PHASE_REDUCE_SCATTER : PHASE_ALL_GATHER;
+                channel.push_back(step);
+            }
+            break;
+        }
+        
+        case ALL_TO_ALL:
+            // Pairwise exchange with a growing shift
+            for (int k = 0; k < ranks - 1; k++) {
+                ScheduleStep step;
+                step.sends.push_back({(operationRank + k + 1) % ranks, k});
+                step.numRecvs = 1;
+                step.bytes = chunk;
+                step.phase = PHASE_NONE;
+                channel.push_back(step);
+            }
+            break;
+            
+        case BROADCAST: {
+            // Chain from rank 0: receive from the predecessor, then forward
+            ScheduleStep receive;
+            receive.numRecvs = (operationRank == 0) ? 0 : 1;
+            receive.bytes = bytes;
+            receive.phase = PHASE_NONE;
+            channel.push_back(receive);
+            
+            if (operationRank < ranks - 1) {
+                ScheduleStep forward;
+                forward.sends.push_back({operationRank + 1, 0});
+                forward.numRecvs = 0;
+                forward.bytes = bytes;
+                forward.phase = PHASE_NONE;
+                channel.push_back(forward);
+            }
+            break;
+        }
+        
+        default: {
+            // Point-to-point: every rank sends its tensor to the next rank
+            ScheduleStep step;
+            step.sends.push_back({next, 0});
+            step.numRecvs = 1;
+            step.bytes = bytes;
+            step.phase = PHASE_NONE;
+            channel.push_back(step);
+            break;
+        }
+    }
+    
+    return channel;
+}
+
+CollectiveEndpoint::Channel CollectiveEndpoint::buildTreeChannel(int tree, long bytes)
+{
+    int parent;
+    std::vector<int> children;
+    getDoubleBinaryTree(tree, parent, children);
+    
+    Channel channel(3);
+    
+    // Step 0: reduce the children's contributions
+    channel[0].numRecvs = children.size();
+    channel[0].bytes = bytes;
+    channel[0].phase = PHASE_REDUCE_SCATTER;
+    
+    // Step 1: pass the partial sum up, wait for the result to come down
+    if (parent >= 0) {
+        channel[1].sends.push_back({parent, 0});
+    }
+    channel[1].numRecvs = (parent >= 0) ? 1 : 0;
+    channel[1].bytes = bytes;
+    channel[1].phase = PHASE_REDUCE_SCATTER;
+    
+    // Step 2: broadcast the result to the children
+    for (int child : children) {
+        channel[2].sends.push_back({child, 1});
+    }
+    channel[2].numRecvs = 0;
+    channel[2].bytes = bytes;
+    channel[2].phase = PHASE_ALL_GATHER;
+    
+    return channel;
+}
+
+CollectiveEndpoint::Channel CollectiveEndpoint::buildHalvingDoublingChannel(long bytes)
+{
+    if (operationType == POINT_TO_POINT) {
+        return buildRingChannel(bytes);
+    }
+    
+    Channel channel;
+    int ranks = operationGroup.size();
+    int logRanks = 0;
+    while ((1 << logRanks) < ranks) logRanks++;
+    
+    if (operationType == ALL_REDUCE || operationType == REDUCE_SCATTER) {
+        // Recursive halving: distance and data halve every step
+        for (int i = 0; i < logRanks; i++) {
+            ScheduleStep step;
+            step.sends.push_back({operationRank ^ (ranks >> (i + 1)), i});
+            step.numRecvs = 1;
+            step.bytes = std::max(1L, bytes >> (i + 1));
+            step.phase = PHASE_REDUCE_SCATTER;
+            channel.push_back(step);
+        }
+    }
+    
+    if (operationType == ALL_REDUCE || operationType == ALL_GATHER) {
+        // Recursive doubling: distance and data double every step
+        int offset = channel.size();
+        for (int j = 0; j < logRanks; j++) {
+            ScheduleStep step;
+            step.sends.push_back({operationRank ^ (1 << j), offset + j});
+            step.numRecvs = 1;
+            step.bytes = std::max(1L, (bytes / ranks) << j);
+            step.phase = PHASE_ALL_GATHER;
+            channel.push_back(step);
+        }
+    }
+    
+    if (operationType == ALL_TO_ALL) {
+        // Recursive exchange: half of the data moves in every step
+        for (int j = 0; j < logRanks; j++) {
+            ScheduleStep step;
+            step.sends.push_back({operationRank ^ (1 << j), j});
+            step.numRecvs = 1;
+            step.bytes = std::max(1L, bytes / 2);
+            step.phase = PHASE_NONE;
+            channel.push_back(step);
+        }
+    }
+    
+    if (operationType == BROADCAST) {
+        // Binomial tree from rank 0: a rank receives in the step of its
+        // highest bit and forwards to rank + 2^j in every later step
+        int highBit = -1;
+        for (int j = 0; j < logRanks; j++) {
+            if (operationRank & (1 << j)) highBit = j;
+        }
+        for (int j = 0; j < logRanks; j++) {
+            ScheduleStep step;
+            step.numRecvs = (j == highBit) ? 1 : 0;
+            if (j > highBit && operationRank + (1 << j) < ranks) {
+                step.sends.push_back({operationRank + (1 << j), j});
+            }
+            step.bytes = bytes;
+            step.phase = PHASE_NONE;
+            channel.push_back(step);
+        }
+    }
+    
+    return channel;
+}
+
+void CollectiveEndpoint::getBinaryTree(int ranks, int treeRank, int& parent, int& child0, int& child1)
+{
+    // In-order binary tree over ranks, as used by NCCL: the lowest set bit
+    // of a rank gives its level
+    int bit;
+    for (bit = 1; bit < ranks; bit <<= 1) {
+        if (bit & treeRank) break;
+    }
+    
+    if (treeRank == 0) {
+        parent = -1;
+        child0 = -1;
+        child1 = (ranks > 1) ? bit >> 1 : -1;
+        return;
+    }
+    
+    parent = (treeRank ^ bit) | (bit << 1);
+    if (parent >= ranks) {
+        parent = treeRank ^ bit;
+    }
+    
+    int lowBit = bit >> 1;
+    child0 = (lowBit == 0) ? -1 : treeRank - lowBit;
+    child1 = (lowBit == 0) ? -1 : treeRank + lowBit;
+    while (child1 >= ranks) {
+        lowBit >>= 1;
+        child1 = (lowBit == 0) ? -1 : treeRank + lowBit;
+    }
+}
+
+void CollectiveEndpoint::getDoubleBinaryTree(int tree, int& parent, std::vector<int>& children)
+{
+    // The second tree is the first one mirrored (even rank count) or shifted
+    // by one (odd rank count), so leaves of one tree are inner nodes of the other
+    int ranks = operationGroup.size();
+    int child0, child1;
+    children.clear();
+    
+    if (tree == 0) {
+        getBinaryTree(ranks, operationRank, parent, child0, child1);
+    } else if (ranks % 2 == 1) {
+        getBinaryTree(ranks, (operationRank - 1 + ranks) % ranks, parent, child0, child1);
+        parent = (parent < 0) ? -1 : (parent + 1) % ranks;
+        child0 = (child0 < 0) ? -1 : (child0 + 1) % ranks;
+        child1 = (child1 < 0) ? -1 : (child1 + 1) % ranks;
+    } else {
+        getBinaryTree(ranks, ranks - 1 - operationRank, parent, child0, child1);
+        parent = (parent < 0) ? -1 : ranks - 1 - parent;
+        child0 = (child0 < 0) ? -1 : ranks - 1 - child0;
+        child1 = (child1 < 0) ? -1 : ranks - 1 - child1;
+    }
+    
+    if (child0 >= 0) children.push_back(child0);
+    if (child1 >= 0) children.push_back(child1);
+}
+
+void CollectiveEndpoint::handleMessage(cMessage *msg)
+{
+    if (pacer.handleTimer(msg)) {
+        return;
+    }
+    
+    if (msg == startTimer) {
+        if (traceMode) {
+            startTrace();
+        } else {
+            startOperation(workloadType, tensorSize, std::vector<int>());
+        }
+        return;
+    }
+    
+    if (msg == traceTimer) {
+        // Deliver every record completion that is due
+        while (!traceCompletions.empty() && traceCompletions.top().first <= simTime()) {
+            long id = traceCompletions.top().second;
+            traceCompletions.pop();
+            completeTraceRecord(id);
+        }
+        if (!traceCompletions.empty()) {
+            scheduleAt(traceCompletions.top().first, traceTimer);
+        }
+        issueTraceRecords();
+        return;
+    }
+    
+    AIPacket *packet = dynamic_cast<AIPacket*>(msg);
+    if (packet == nullptr) {
+        EV << "Ignoring non-collective message " << msg->getName() << endl;
+        delete msg;
+        return;
+    }
+    
+    handleCollectivePacket(packet);
+}
+
+void CollectiveEndpoint::startOperation(AIWorkloadType type, long bytes, const std::vector<int>& group)
+{
+    // An empty group runs the operation over the whole communicator
+    operationGroup.clear();
+    operationRank = -1;
+    if (group.empty()) {
+        operationGroup = communicator;
+        operationRank = rank;
+    }
+    for (int member : group) {
+        if (member < 0 || member >= (int)communicator.size()) {
+            throw cRuntimeError("Collective group member %d outside the communicator", member);
+        }
+        if (member == rank) {
+            operationRank = operationGroup.size();
+        }
+        operationGroup.push_back(communicator[member]);
+    }
+    if (operationRank < 0) {
+        throw cRuntimeError("Rank %d runs a collective of a group it is not a member of", rank);
+    }
+    
+    operationType = type;
+    operationBytes = bytes;
+    schedule.clear();
+    buildSchedule();
+    
+    operationId++;
+    operationStart = simTime();
+    channelStates.assign(schedule.size(), ChannelState{0, false});
+    channelsDone = 0;
+    
+    EV << "Rank " << rank << " starting collective operation " << operationId << endl;
+    
+    if (schedule.empty()) {
+        completeOperation();
+        return;
+    }
+    
+    for (int channel = 0; channel < (int)schedule.size(); channel++) {
+        progressChannel(channel);
+    }
+}
+
+void CollectiveEndpoint::progressChannel(int channel)
+{
+    ChannelState& state = channelStates[channel];
+    const Channel& steps = schedule[channel];
+    
+    if (state.step >= (int)steps.size()) {
+        return;
+    }
+    
+    while (state.step < (int)steps.size()) {
+        const ScheduleStep& step = steps[state.step];
+        
+        // Sends of a step only depend on the previous step's inputs
+        if (!state.sent) {
+            sendStep(channel, step);
+            state.sent = true;
+        }
+        
+        // Wait until every expected input of this step has arrived
+        long expected = step.bytes * step.numRecvs;
+        if (expected > 0) {
+            auto receivedIt = receivedBytes.find(std::make_tuple(operationId, channel, state.step));
+            if (receivedIt == receivedBytes.end() || receivedIt->second < expected) {
+                return;
+            }
+            receivedBytes.erase(receivedIt);
+        }
+        
+        state.step++;
+        state.sent = false;
+        stepsCompleted++;
+    }
+    
+    channelsDone++;
+    if (channelsDone == (int)schedule.size()) {
+        completeOperation();
+    }
+}
+
+void CollectiveEndpoint::sendStep(int channel, const ScheduleStep& step)
+{
+    int headerBytes = rocevProtocol ? ROCE_HEADER_BYTES : 0;
+    
+    for (const Transfer& transfer : step.sends) {
+        std::stringstream packetName;
+        packetName << "Collective_" << operationId << "_" << operationRank << "to" << transfer.peer;
+        
+        AIPacket *packet = new AIPacket(packetName.str().c_str());
+        packet->setByteLength(step.bytes + headerBytes);
+        packet->setKind(operationType);
+        packet->setTimestamp(simTime());
+        packet->setWorkloadType(operationType);
+        packet->setTensorSize(operationBytes);
+        packet->setSource(address);
+        packet->setDestination(operationGroup[transfer.peer]);
+        packet->setRoce(rocevProtocol);
+        packet->setCollectiveType(operationType);
+        packet->setParticipantCount(operationGroup.size());
+        packet->setOperationId(operationId);
+        packet->setPhase(step.phase);
+        packet->setRound(transfer.peerStep);
+        packet->setChannel(channel);
+        packet->setJobId(jobId);
+        
+        // Messages leave the NIC one after another at the line rate
+        PacketTrain::segmentMessage(packet, mtu, headerBytes);
+        long wireBytes = PacketTrain::getMessageWireBytes(packet);
+        simtime_t departure = std::max(simTime(), nicFreeAt);
+        nicFreeAt = departure + wireBytes * 8.0 / nicDataRate;
+        pacer.enqueue(packet, departure - simTime());
+        
+        totalBytesSent += wireBytes;
+        packetsSent += packet->getSegmentCount();
+        if (placement.getSwitch(address) != placement.getSwitch(packet->getDestination())) {
+            crossSwitchBytes += wireBytes;
+        }
+    }
+}
+
+void CollectiveEndpoint::handleCollectivePacket(AIPacket *packet)
+{
+    if (packet->getDestination() != address) {
+        EV << "Endpoint " << address << " received packet for " << packet->getDestination()
+           << ", dropping" << endl;
+        delete packet;
+        return;
+    }
+    
+    // Leftovers of a finished job are not part of the running one
+    if (packet->getJobId() != jobId) {
+        EV << "Endpoint " << address << " received packet of job " << packet->getJobId()
+           << " while running job " << jobId << ", dropping" << endl;
+        stalePackets++;
+        delete packet;
+        return;
+    }
+    
+    if (packet->getChannel() < 0) {
+        handlePointToPointPacket(packet);
+        return;
+    }
+    
+    long payload = PacketTrain::getTrainPayload(packet);
+    packetsReceived += packet->getTrainLength();
+    totalBytesReceived += packet->getByteLength();
+    
+    long opId = packet->getOperationId();
+    int channel = packet->getChannel();
+    receivedBytes[std::make_tuple(opId, channel, packet->getRound())] += payload;
+    
+    // Data for a later operation is kept until that operation starts
+    if (opId == operationId && channel < (int)channelStates.size()) {
+        progressChannel(channel);
+    }
+    
+    delete packet;
+}
+
+void CollectiveEndpoint::completeOperation()
+{
+    simtime_t localTime = simTime() - operationStart;
+    localCompletions++;
+    iterationsDone++;
+    totalLocalTime += localTime.dbl();
+    emit(localCompletionSignal, localTime);
+    
+    // Next iteration of the collective, or the next trace record
+    if (traceMode) {
+        scheduleTraceCompletion(simTime(), runningCollective);
+    } else if (iterationsDone < numIterations) {
+        scheduleAt(simTime() + operationGap, startTimer);
+    }
+    
+    // The first member of the group aggregates the completion
+    CollectiveEndpoint *groupCoordinator = coordinator;
+    if (operationGroup[0] != communicator[0]) {
+        groupCoordinator = check_and_cast<CollectiveEndpoint*>(getParentModule()->getSubmodule(getName(), operationGroup[0]));
+    }
+    groupCoordinator->reportCompletion(operationId, operationStart, operationGroup.size());
+}
+
+void CollectiveEndpoint::startTrace()
+{
+    traceStart = simTime();
+    traceEnd = simTime();
+    iterationStart = simTime();
+    fillTraceWindow();
+    issueTraceRecords();
+}
+
+bool CollectiveEndpoint::nextTraceRecord(TraceReader::TraceRecord& record)
+{
+    return trainingMode ? training.next(record) : trace.next(record);
+}
+
+void CollectiveEndpoint::fillTraceWindow()
+{
+    // Read ahead only as far as the window allows
+    while ((int)pendingRecords.size() < traceWindow) {
+        TraceEntry entry;
+        if (!nextTraceRecord(entry.record)) {
+            break;
+        }
+        
+        // SEND/RECV records pair up in order per peer
+        entry.sequence = -1;
+        if (entry.record.op == TraceReader::TRACE_SEND) {
+            entry.sequence = sendSequence[entry.record.peer]++;
+        } else if (entry.record.op == TraceReader::TRACE_RECV) {
+            entry.sequence = recvSequence[entry.record.peer]++;
+        }
+        entry.started = false;
+        
+        lastLoadedId = entry.record.id;
+        outstandingRecords.insert(entry.record.id);
+        pendingRecords.push_back(entry);
+    }
+    
+    maxTraceWindow = std::max(maxTraceWindow, pendingRecords.size());
+}
+
+void CollectiveEndpoint::issueTraceRecords()
+{
+    // Collectives start in trace order; once one is held back, so are all later ones
+    bool collectiveBlocked = (runningCollective >= 0);
+    
+    for (TraceEntry& entry : pendingRecords) {
+        if (entry.started) {
+            continue;
+        }
+        
+        bool isCollective = (entry.record.op == TraceReader::TRACE_COLLECTIVE);
+        if (isCollective && collectiveBlocked) {
+            continue;
+        }
+        
+        bool started = startTraceRecord(entry);
+        if (isCollective && !started) {
+            collectiveBlocked = true;
+        }
+    }
+}
+
+bool CollectiveEndpoint::startTraceRecord(TraceEntry& entry)
+{
+    const TraceReader::TraceRecord& record = entry.record;
+    
+    // All dependencies must have completed
+    for (long dep : record.deps) {
+        if (dep > lastLoadedId || outstandingRecords.count(dep) > 0) {
+            return false;
+        }
+    }
+    
+    entry.started = true;
+    
+    // Completions are always delivered through the trace timer, so the
+    // record window is never modified while it is being scanned
+    switch (record.op) {
+        case TraceReader::TRACE_COMPUTE:
+            scheduleTraceCompletion(simTime() + SimTime(record.size, SIMTIME_NS), record.id);
+            break;
+            
+        case TraceReader::TRACE_SEND:
+            sendPointToPoint(entry);
+            scheduleTraceCompletion(nicFreeAt, record.id);
+            break;
+            
+        case TraceReader::TRACE_RECV: {
+            auto receivedIt = p2pReceived.find(std::make_pair(record.peer, entry.sequence));
+            if (receivedIt != p2pReceived.end() && receivedIt->second >= record.size) {
+                p2pReceived.erase(receivedIt);
+                scheduleTraceCompletion(simTime(), record.id);
+            }
+            break;
+        }
+        
+        case TraceReader::TRACE_COLLECTIVE:
+            runningCollective = record.id;
+            startOperation(record.collectiveType, record.size, record.group);
+            break;
+    }
+    
+    return true;
+}
+
+void CollectiveEndpoint::completeTraceRecord(long id)
+{
+    if (id == runningCollective) {
+        runningCollective = -1;
+    }
+    
+    outstandingRecords.erase(id);
+    for (auto it = pendingRecords.begin(); it != pendingRecords.end(); ++it) {
+        if (it->record.id == id) {
+            pendingRecords.erase(it);
+            break;
+        }
+    }
+    traceRecordsCompleted++;
+    
+    if (trainingMode && training.endsIteration(id)) {
+        completeIteration();
+    }
+    
+    fillTraceWindow();
+    
+    if (pendingRecords.empty()) {
+        traceEnd = simTime();
+        EV << "Rank " << rank << " finished replaying " << traceRecordsCompleted
+           << " trace records in " << (traceEnd - traceStart) << "s" << endl;
+    }
+}
+
+void CollectiveEndpoint::scheduleTraceCompletion(simtime_t time, long id)
+{
+    traceCompletions.push(std::make_pair(time, id));
+    
+    if (!traceTimer->isScheduled() || time < traceTimer->getArrivalTime()) {
+        if (traceTimer->isScheduled()) {
+            cancelEvent(traceTimer);
+        }
+        scheduleAt(time, traceTimer);
+    }
+}
+
+void CollectiveEndpoint::sendPointToPoint(const TraceEntry& entry)
+{
+    int headerBytes = rocevProtocol ? ROCE_HEADER_BYTES : 0;
+    int peer = entry.record.peer;
+    if (peer >= (int)communicator.size()) {
+        throw cRuntimeError("%s: SEND to rank %d outside the communicator", trace.getFileName().c_str(), peer);
+    }
+    
+    std::stringstream packetName;
+    packetName << "P2P_" << rank << "to" << peer << "_" << entry.sequence;
+    
+    AIPacket *packet = new AIPacket(packetName.str().c_str());
+    packet->setByteLength(std::max(1L, entry.record.size) + headerBytes);
+    packet->setKind(POINT_TO_POINT);
+    packet->setTimestamp(simTime());
+    packet->setWorkloadType(POINT_TO_POINT);
+    packet->setTensorSize(entry.record.size);
+    packet->setSource(address);
+    packet->setDestination(communicator[peer]);
+    packet->setRoce(rocevProtocol);
+    packet->setRound(entry.sequence);
+    packet->setChannel(-1);
+    packet->setJobId(jobId);
+    
+    PacketTrain::segmentMessage(packet, mtu, headerBytes);
+    long wireBytes = PacketTrain::getMessageWireBytes(packet);
+    simtime_t departure = std::max(simTime(), nicFreeAt);
+    nicFreeAt = departure + wireBytes * 8.0 / nicDataRate;
+    pacer.enqueue(packet, departure - simTime());
+    
+    totalBytesSent += wireBytes;
+    packetsSent += packet->getSegmentCount();
+    if (placement.getSwitch(address) != placement.getSwitch(packet->getDestination())) {
+        crossSwitchBytes += wireBytes;
+    }
+}
+
+void CollectiveEndpoint::handlePointToPointPacket(AIPacket *packet)
+{
+    packetsReceived += packet->getTrainLength();
+    totalBytesReceived += packet->getByteLength();
+    
+    auto sourceIt = std::find(communicator.begin(), communicator.end(), packet->getSource());
+    int sourceRank = (sourceIt != communicator.end()) ? (int)(sourceIt - communicator.begin()) : -1;
+    std::pair<int, long> key(sourceRank, packet->getRound());
+    long received = (p2pReceived[key] += PacketTrain::getTrainPayload(packet));
+    delete packet;
+    
+    // Complete the matching RECV once its data is in
+    for (TraceEntry& entry : pendingRecords) {
+        if (entry.started && entry.record.op == TraceReader::TRACE_RECV &&
+            entry.record.peer == sourceRank && entry.sequence == key.second) {
+            if (received >= entry.record.size) {
+                p2pReceived.erase(key);
+                scheduleTraceCompletion(simTime(), entry.record.id);
+            }
+            break;
+        }
+    }
+}
+
+void CollectiveEndpoint::completeIteration()
+{
+    // Time the rank was not computing went to communication that backprop
+    // could not hide: gradient reductions, pipeline transfers and bubbles
+    simtime_t iterationTime = simTime() - iterationStart;
+    simtime_t exposedTime = std::max(SIMTIME_ZERO, iterationTime - training.getComputePerIteration());
+    iterationStart = simTime();
+    
+    trainingIterations++;
+    totalIterationTime += iterationTime.dbl();
+    maxIterationTime = std::max(maxIterationTime, iterationTime.dbl());
+    totalExposedCommTime += exposedTime.dbl();
+    emit(iterationTimeSignal, iterationTime);
+    emit(exposedCommTimeSignal, exposedTime);
+    
+    EV << "Rank " << rank << " (stage " << training.getStage() << ") finished training iteration "
+       << trainingIterations << " in " << iterationTime << "s, " << exposedTime << "s communication exposed" << endl;
+}
+
+void CollectiveEndpoint::reportCompletion(long opId, simtime_t startTime, int participants)
+{
+    Enter_Method("reportCompletion");
+    
+    auto recordIt = operations.find(opId);
+    if (recordIt == operations.end()) {
+        OperationRecord record;
+        record.firstStart = startTime;
+        record.lastCompletion = simTime();
+        record.ranksCompleted = 0;
+        recordIt = operations.insert(std::make_pair(opId, record)).first;
+    }
+    
+    OperationRecord& record = recordIt->second;
+    record.firstStart = std::min(record.firstStart, startTime);
+    record.lastCompletion = simTime();
+    record.ranksCompleted++;
+    
+    if (record.ranksCompleted < participants) {
+        return;
+    }
+    
+    // Last rank done: the collective is complete
+    simtime_t collectiveTime = record.lastCompletion - record.firstStart;
+    collectivesCompleted++;
+    totalCollectiveTime += collectiveTime.dbl();
+    maxCollectiveTime = std::max(maxCollectiveTime, collectiveTime.dbl());
+    emit(collectiveTimeSignal, collectiveTime);
+    operations.erase(recordIt);
+    
+    EV << "Collective operation " << opId << " completed on " << participants
+       << " ranks in " << collectiveTime << "s" << endl;
+    
+    // The job is done once its last collective has completed on all ranks
+    jobCollectivesCompleted++;
+    if (scheduler != nullptr && jobCollectivesCompleted == numIterations) {
+        scheduler->jobCompleted(jobId);
+    }
+}
+
+void CollectiveEndpoint::startJob(int job, const std::vector<int>& members, AIWorkloadType type, long bytes,
+                                  int iterations, simtime_t gap, JobScheduler *owner)
+{
+    Enter_Method("startJob");
+    
+    jobId = job;
+    communicator = members;
+    rank = std::find(communicator.begin(), communicator.end(), address) - communicator.begin();
+    if (rank >= (int)communicator.size()) {
+        throw cRuntimeError("Endpoint %d assigned to job %d it is not a member of", address, job);
+    }
+    coordinator = check_and_cast<CollectiveEndpoint*>(getParentModule()->getSubmodule(getName(), communicator[0]));
+    
+    workloadType = type;
+    tensorSize = bytes;
+    numIterations = iterations;
+    operationGap = gap;
+    scheduler = owner;
+    
+    // Fresh operation numbering shared by all ranks of the job
+    operationId = -1;
+    iterationsDone = 0;
+    jobCollectivesCompleted = 0;
+    receivedBytes.clear();
+    operations.clear();
+    
+    if (startTimer->isScheduled()) {
+        cancelEvent(startTimer);
+    }
+    scheduleAt(simTime(), startTimer);
+    
+    EV << "Endpoint " << address << " starts job " << jobId << " as rank " << rank
+       << "/" << communicator.size() << endl;
+}
+
+void CollectiveEndpoint::finish()
+{
+    recordScalar("Total Bytes Sent", (double)totalBytesSent);
+    recordScalar("Total Bytes Received", (double)totalBytesReceived);
+    recordScalar("Packets Sent", (double)packetsSent);
+    recordScalar("Packets Received", (double)packetsReceived);
+    if (stalePackets > 0) {
+        recordScalar("Stale Job Packets", (double)stalePackets);
+    }
+    recordScalar("Steps Completed", (double)stepsCompleted);
+    recordScalar("Cross-Switch Bytes", (double)crossSwitchBytes);
+    if (totalBytesSent > 0) {
+        recordScalar("Cross-Switch Fraction", (double)crossSwitchBytes / totalBytesSent);
+    }
+    if (rank == 0) {
+        recordScalar("Cross-Switch Ring Hops", placement.countCrossSwitchHops(communicator));
+    }
+    
+    if (localCompletions > 0) {
+        recordScalar("Average Local Completion Time", totalLocalTime / localCompletions);
+    }
+    
+    if (traceMode) {
+        recordScalar("Trace Records Completed", (double)traceRecordsCompleted);
+        recordScalar("Max Trace Window", (double)maxTraceWindow);
+        if (pendingRecords.empty()) {
+            recordScalar("Trace Replay Time", (traceEnd - traceStart).dbl());
+        } else {
+            recordScalar("Trace Records Pending", (double)pendingRecords.size());
+        }
+    }
+    
+    if (trainingIterations > 0) {
+        double computeTime = training.getComputePerIteration().dbl();
+        double avgIterationTime = totalIterationTime / trainingIterations;
+        double avgExposedTime = totalExposedCommTime / trainingIterations;
+        recordScalar("Training Iterations", trainingIterations);
+        recordScalar("Average Iteration Time", avgIterationTime);
+        recordScalar("Max Iteration Time", maxIterationTime);
+        recordScalar("Compute Time per Iteration", computeTime);
+        recordScalar("Average Exposed Communication Time", avgExposedTime);
+        recordScalar("Exposed Communication Fraction", avgExposedTime / avgIterationTime);
+    }
+    
+    // Rank 0 reports the end-to-end collective statistics
+    if (collectivesCompleted > 0 && traceMode) {
+        recordScalar("Collectives Completed", collectivesCompleted);
+        recordScalar("Average Collective Time", totalCollectiveTime / collectivesCompleted);
+        recordScalar("Max Collective Time", maxCollectiveTime);
+    } else if (collectivesCompleted > 0) {
+        double avgCollectiveTime = totalCollectiveTime / collectivesCompleted;
+        int ranks = communicator.size();
+        double algBandwidth = tensorSize * 8.0 / avgCollectiveTime;
+        double busFactor = 1.0;
+        if (workloadType == ALL_REDUCE) busFactor = 2.0 * (ranks - 1) / ranks;
+        else if (workloadType == ALL_GATHER || workloadType == REDUCE_SCATTER) busFactor = (double)(ranks - 1) / ranks;
+        
+        recordScalar("Collectives Completed", collectivesCompleted);
+        recordScalar("Average Collective Time", avgCollectiveTime);
+        recordScalar("Max Collective Time", maxCollectiveTime);
+        recordScalar("Algorithm Bandwidth (Gbps)", algBandwidth / 1e9);
+        recordScalar("Bus Bandwidth (Gbps)", algBandwidth * busFactor / 1e9);
+    }
+    
+    EV << "CollectiveEndpoint " << address << " finished: " << localCompletions
+       << " operations, " << totalBytesSent << " bytes sent" << endl;
+}
+
+} // namespace tomahawk6
@@ -0,0 +1,226 @@
+#ifndef __TOMAHAWK6_COLLECTIVEENDPOINT_H_
+#define __TOMAHAWK6_COLLECTIVEENDPOINT_H_
+
+#include <omnetpp.h>
+#include <deque>
+#include <map>
+#include <queue>
+#include <set>
+#include <tuple>
+#include <vector>
+#include "inet/common/INETDefs.h"
+#include "AIPacket_m.h"
+#include "RankPlacement.h"
+#include "TrafficPacer.h"
+#include "TraceReader.h"
+#include "TrainingModel.h"
+
+using namespace omnetpp;
+using namespace inet;
+
+namespace tomahawk6 {
+
+class JobScheduler;
+
+/**
+ * GPU endpoint running dependency-driven collective schedules
+ * Every rank executes its part of a ring, double binary tree or recursive
+ * halving-doubling schedule; a step is released only once all data of the
+ * previous step has arrived. Rank 0 aggregates completion times.
+ * With a trace file the endpoint replays a recorded per-rank sequence of
+ * compute gaps, point-to-point transfers and collectives instead.
+ * In training mode the records come from an iteration model of data- and
+ * pipeline-parallel training, reporting iteration and exposed communication time.
+ * Managed endpoints stay idle until a JobScheduler assigns them a job.
+ */
+class INET_API CollectiveEndpoint : public cSimpleModule
+{
+  public:
+    enum CollectiveAlgorithm {
+        RING,
+        DOUBLE_BINARY_TREE,
+        HALVING_DOUBLING
+    };
+    
+    struct Transfer {
+        int peer;           // Rank of the receiver
+        int peerStep;       // Step of the receiver this data completes
+    };
+    
+    struct ScheduleStep {
+        std::vector<Transfer> sends;
+        int numRecvs;       // Number of peers whose data this step waits for
+        long bytes;         // Payload per transfer
+        CollectivePhase phase;
+    };
+    
+    // Steps of a channel run in order; channels progress independently
+    typedef std::vector<ScheduleStep> Channel;
+    
+  private:
+    static const int ROCE_HEADER_BYTES = 42;
+    
+    struct ChannelState {
+        int step;
+        bool sent;
+    };
+    
+    struct OperationRecord {
+        simtime_t firstStart;
+        simtime_t lastCompletion;
+        int ranksCompleted;
+    };
+    
+    struct TraceEntry {
+        TraceReader::TraceRecord record;
+        long sequence;      // Per-peer sequence number of SEND/RECV records
+        bool started;
+    };
+    
+    typedef std::pair<simtime_t, long> TraceCompletion;
+    
+    // Configuration parameters
+    int address;
+    std::vector<int> communicator;      // Endpoint addresses, indexed by rank
+    int rank;
+    AIWorkloadType workloadType;
+    CollectiveAlgorithm algorithm;
+    long tensorSize;
+    int pipelineChunks;
+    int numIterations;
+    simtime_t operationGap;
+    bool rocevProtocol;
+    int mtu;
+    int maxTrainLength;
+    double nicDataRate;
+    CollectiveEndpoint *coordinator;    // Rank 0 of the communicator
+    RankPlacement placement;            // Switch of every endpoint, rank order
+    
+    // Job assignment (managed endpoints)
+    int jobId;
+    JobScheduler *scheduler;
+    int iterationsDone;
+    int jobCollectivesCompleted;
+    
+    // Schedule of this rank
+    std::vector<Channel> schedule;
+    
+    // Running operation
+    std::vector<int> operationGroup;    // Endpoint addresses, indexed by group rank
+    int operationRank;
+    AIWorkloadType operationType;
+    long operationBytes;
+    long operationId;
+    simtime_t operationStart;
+    std::vector<ChannelState> channelStates;
+    int channelsDone;
+    std::map<std::tuple<long, int, int>, long> receivedBytes;  // (operation, channel, step)
+    simtime_t nicFreeAt;
+    
+    // Trace replay: a bounded window of records read ahead from the trace
+    bool traceMode;
+    TraceReader trace;
+    int traceWindow;
+    std::deque<TraceEntry> pendingRecords;
+    std::set<long> outstandingRecords;
+    long lastLoadedId;
+    long runningCollective;
+    std::map<int, long> sendSequence;
+    std::map<int, long> recvSequence;
+    std::map<std::pair<int, long>, long> p2pReceived;   // (source rank, sequence)
+    std::priority_queue<TraceCompletion, std::vector<TraceCompletion>, std::greater<TraceCompletion>> traceCompletions;
+    cMessage *traceTimer;
+    
+    // Training iteration model, replayed like a trace
+    bool trainingMode;
+    TrainingModel training;
+    simtime_t iterationStart;
+    
+    // Completion aggregation on rank 0
+    std::map<long, OperationRecord> operations;
+    
+    // Timers and paced emission
+    cMessage *startTimer;
+    TrafficPacer pacer;
+    
+    // Statistics
+    long totalBytesSent;
+    long totalBytesReceived;
+    long packetsSent;
+    long packetsReceived;
+    long stalePackets;
+    long crossSwitchBytes;
+    long stepsCompleted;
+    int localCompletions;
+    double totalLocalTime;
+    int collectivesCompleted;
+    double totalCollectiveTime;
+    double maxCollectiveTime;
+    long traceRecordsCompleted;
+    size_t maxTraceWindow;
+    simtime_t traceStart;
+    simtime_t traceEnd;
+    int trainingIterations;
+    double totalIterationTime;
+    double maxIterationTime;
+    double totalExposedCommTime;
+    simsignal_t collectiveTimeSignal;
+    simsignal_t localCompletionSignal;
+    simsignal_t iterationTimeSignal;
+    simsignal_t exposedCommTimeSignal;
+    
+  protected:
+    virtual void initialize() override;
+    virtual void handleMessage(cMessage *msg) override;
+    virtual void finish() override;
+    
+    // Schedule construction
+    virtual void parseCommunicator(const char *spec);
+    virtual void buildSchedule();
+    virtual Channel buildRingChannel(long bytes);
+    virtual Channel buildTreeChannel(int tree, long bytes);
+    virtual Channel buildHalvingDoublingChannel(long bytes);
+    virtual void getBinaryTree(int ranks, int treeRank, int& parent, int& child0, int& child1);
+    virtual void getDoubleBinaryTree(int tree, int& parent, std::vector<int>& children);
+    
+    // Execution
+    virtual void startOperation(AIWorkloadType type, long bytes, const std::vector<int>& group);
+    virtual void progressChannel(int channel);
+    virtual void sendStep(int channel, const ScheduleStep& step);
+    virtual void handleCollectivePacket(AIPacket *packet);
+    virtual void completeOperation();
+    
+    // Trace replay
+    virtual void startTrace();
+    virtual bool nextTraceRecord(TraceReader::TraceRecord& record);
+    virtual void fillTraceWindow();
+    virtual void issueTraceRecords();
+    virtual bool startTraceRecord(TraceEntry& entry);
+    virtual void completeTraceRecord(long id);
+    virtual void scheduleTraceCompletion(simtime_t time, long id);
+    virtual void sendPointToPoint(const TraceEntry& entry);
+    virtual void handlePointToPointPacket(AIPacket *packet);
+    virtual void completeIteration();
+    
+  public:
+    CollectiveEndpoint();
+    virtual ~CollectiveEndpoint();
+    
+    // Called on the first rank of the operation's group by every rank that
+    // finished its part of an operation
+    void reportCompletion(long operationId, simtime_t startTime, int participants);
+    
+    // Called by the JobScheduler to run a job's collectives on this endpoint
+    void startJob(int jobId, const std::vector<int>& members, AIWorkloadType type, long bytes,
+                  int iterations, simtime_t gap, JobScheduler *scheduler);
+    
+    int getJobId() const { return jobId; }
+    
+    int getAddress() const { return address; }
+    int getRank() const { return rank; }
+    const std::vector<Channel>& getSchedule() const { return schedule; }
+};
+
+} // namespace tomahawk6
+
+#endif
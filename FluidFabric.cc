@@ -0,0 +1,507 @@
+#include "FluidFabric.h"
+#include "WorkloadType.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <sstream>
+
+namespace tomahawk6 {
+
+Define_Module(FluidFabric);
+
+FluidFabric::FluidFabric()
+{
+    stepTimer = nullptr;
+    jobsRunning = 0;
+    rateSolves = 0;
+    solvesSkipped = 0;
+    stepEvents = 0;
+}
+
+FluidFabric::~FluidFabric()
+{
+    cancelAndDelete(stepTimer);
+    
+    for (auto& job : jobs) {
+        cancelAndDelete(job.computeTimer);
+    }
+}
+
+void FluidFabric::initialize()
+{
+    // Workload definition (same parameters as the packet-level generators)
+    workloadType = parseWorkloadType(par("workloadType"));
+    
+    std::string algorithmStr = par("algorithm").stdstringValue();
+    algorithm = (algorithmStr == "HalvingDoubling") ? HALVING_DOUBLING : RING;
+    
+    stepLatency = par("stepLatency");
+    computeTime = par("computeTime");
+    maxCachedPatterns = par("maxCachedPatterns").intValue();
+    
+    int numGPUs = par("numGPUs");
+    int numJobs = par("numJobs");
+    int numEndpoints = par("numEndpoints");
+    double tensorSize = par("tensorSize").intValue();
+    
+    if (numGPUs * numJobs > numEndpoints) {
+        throw cRuntimeError("%d jobs of %d GPUs do not fit on %d endpoints", numJobs, numGPUs, numEndpoints);
+    }
+    if (algorithm == HALVING_DOUBLING && (numGPUs & (numGPUs - 1)) != 0) {
+        throw cRuntimeError("HalvingDoubling needs a power-of-two GPU count, got %d", numGPUs);
+    }
+    
+    // Build the fabric
+    std::vector<int> torusDimensions = cStringTokenizer(par("torusDimensions").stringValue(), " x").asIntVector();
+    topology.build(par("topology").stdstringValue(), numEndpoints, par("endpointsPerSwitch"),
+                   par("numTiers"), par("leavesPerPod"), par("oversubscription").doubleValue(),
+                   torusDimensions, par("linkRate").doubleValue());
+    
+    // Place jobs on contiguous endpoint ranges
+    jobs.resize(numJobs);
+    for (int j = 0; j < numJobs; j++) {
+        FluidJob& job = jobs[j];
+        job.jobId = j;
+        for (int rank = 0; rank < numGPUs; rank++) {
+            job.endpoints.push_back(j * numGPUs + rank);
+        }
+        job.messageBytes = tensorSize;
+        job.iterationsLeft = par("numIterations");
+        job.step = 0;
+        job.numSteps = 0;
+        job.inStep = false;
+        job.bytesPerFlow = 0;
+        job.inverseRate = 0;
+        job.remaining = 0;
+        job.collectivesCompleted = 0;
+        job.totalCollectiveTime = 0;
+        job.maxCollectiveTime = 0;
+        job.totalIterationTime = 0;
+        job.computeTimer = new cMessage("computeDone");
+    }
+    
+    // Timer context points at the job; the jobs vector no longer grows
+    for (auto& job : jobs) {
+        job.computeTimer->setContextPointer(&job);
+    }
+    
+    // Initialize statistics
+    collectiveTimeSignal = registerSignal("collectiveTime");
+    iterationTimeSignal = registerSignal("iterationTime");
+    
+    stepTimer = new cMessage("fluidStep");
+    lastUpdate = simTime();
+    
+    for (auto& job : jobs) {
+        startIteration(job);
+    }
+    updateRates();
+    
+    EV << "FluidFabric initialized: " << topology.getTypeString() << " fabric, "
+       << numEndpoints << " endpoints, " << topology.getNumSwitches() << " switches, "
+       << topology.getNumLinks() << " links, " << numJobs << " x " << numGPUs << "-GPU jobs" << endl;
+}
+
+void FluidFabric::handleMessage(cMessage *msg)
+{
+    advanceTime();
+    
+    if (msg == stepTimer) {
+        stepEvents++;
+        
+        // Complete every step that has drained
+        for (auto& job : jobs) {
+            if (job.inStep && (job.remaining * job.stepTime.dbl() < 1e-12 || job.remaining < 1e-9)) {
+                completeStep(job);
+            }
+        }
+    } else {
+        // Compute phase finished, communication starts
+        FluidJob *job = static_cast<FluidJob*>(msg->getContextPointer());
+        startCollective(*job);
+    }
+    
+    updateRates();
+    
+    if (jobsRunning == 0) {
+        EV << "All fluid jobs completed at " << simTime() << endl;
+        endSimulation();
+    }
+}
+
+void FluidFabric::startIteration(FluidJob& job)
+{
+    if (job.iterationsLeft <= 0) {
+        return;
+    }
+    
+    jobsRunning++;
+    job.iterationStart = simTime();
+    
+    if (computeTime > 0) {
+        scheduleAt(simTime() + computeTime, job.computeTimer);
+    } else {
+        startCollective(job);
+    }
+}
+
+void FluidFabric::startCollective(FluidJob& job)
+{
+    job.collectiveStart = simTime();
+    job.step = 0;
+    job.numSteps = getNumSteps(job);
+    
+    if (job.numSteps == 0) {
+        completeCollective(job);
+        return;
+    }
+    startStep(job);
+}
+
+void FluidFabric::startStep(FluidJob& job)
+{
+    getStepPlan(job, job.step, job.patternKey, job.bytesPerFlow);
+    job.remaining = 1.0;
+    job.inStep = true;
+}
+
+void FluidFabric::completeStep(FluidJob& job)
+{
+    job.inStep = false;
+    job.step++;
+    
+    if (job.step < job.numSteps) {
+        startStep(job);
+    } else {
+        completeCollective(job);
+    }
+}
+
+void FluidFabric::completeCollective(FluidJob& job)
+{
+    simtime_t collectiveTime = simTime() - job.collectiveStart;
+    simtime_t iterationTime = simTime() - job.iterationStart;
+    
+    job.collectivesCompleted++;
+    job.totalCollectiveTime += collectiveTime.dbl();
+    job.maxCollectiveTime = std::max(job.maxCollectiveTime, collectiveTime.dbl());
+    job.totalIterationTime += iterationTime.dbl();
+    
+    emit(collectiveTimeSignal, collectiveTime);
+    emit(iterationTimeSignal, iterationTime);
+    
+    EV << "Job " << job.jobId << " collective completed in " << collectiveTime << "s" << endl;
+    
+    jobsRunning--;
+    job.iterationsLeft--;
+    startIteration(job);
+}
+
+int FluidFabric::getNumSteps(const FluidJob& job)
+{
+    int ranks = job.endpoints.size();
+    if (ranks <= 1) {
+        return 0;
+    }
+    int logRanks = (int)std::round(std::log2(ranks));
+    
+    if (workloadType == POINT_TO_POINT) {
+        return 1;
+    }
+    
+    if (algorithm == HALVING_DOUBLING) {
+        switch (workloadType) {
+            case ALL_REDUCE:
+            case BROADCAST:
+                return 2 * logRanks;    // Recursive halving, then doubling
+            default:
+                return logRanks;
+        }
+    }
+    
+    switch (workloadType) {
+        case ALL_REDUCE:
+            return 2 * (ranks - 1);     // Reduce-scatter + all-gather rings
+        default:
+            return ranks - 1;
+    }
+}
+
+void FluidFabric::getStepPlan(const FluidJob& job, int step, PatternKey& key, double& bytesPerFlow)
+{
+    int ranks = job.endpoints.size();
+    double chunk = job.messageBytes / ranks;
+    
+    if (workloadType == POINT_TO_POINT) {
+        key = PatternKey(job.jobId, SHIFT, 1);
+        bytesPerFlow = job.messageBytes;
+        return;
+    }
+    
+    if (algorithm == HALVING_DOUBLING) {
+        int logRanks = (int)std::round(std::log2(ranks));
+        bool halving = (workloadType == REDUCE_SCATTER) ||
+                       ((workloadType == ALL_REDUCE || workloadType == BROADCAST) && step < logRanks);
+        
+        if (workloadType == ALL_TO_ALL) {
+            // Recursive exchange, half of the data moves in every step
+            key = PatternKey(job.jobId, EXCHANGE, 1 << step);
+            bytesPerFlow = job.messageBytes / 2;
+        } else if (halving) {
+            // Distance and data halve every step
+            key = PatternKey(job.jobId, EXCHANGE, ranks >> (step + 1));
+            bytesPerFlow = job.messageBytes / (1 << (step + 1));
+        } else {
+            // Distance and data double every step
+            int doubling = (workloadType == ALL_GATHER) ? step : step - logRanks;
+            key = PatternKey(job.jobId, EXCHANGE, 1 << doubling);
+            bytesPerFlow = chunk * (1 << doubling);
+        }
+        return;
+    }
+    
+    // Ring algorithms; all-to-all uses pairwise exchange with growing shift
+    int distance = (workloadType == ALL_TO_ALL) ? step + 1 : 1;
+    key = PatternKey(job.jobId, SHIFT, distance);
+    bytesPerFlow = chunk;
+}
+
+const FluidFabric::FlowPattern& FluidFabric::getPattern(const FluidJob& job, const PatternKey& key)
+{
+    auto patternIt = patterns.find(key);
+    if (patternIt != patterns.end()) {
+        return patternIt->second;
+    }
+    
+    // Bound memory: drop cached patterns that no running step uses
+    if (patterns.size() >= maxCachedPatterns) {
+        for (auto it = patterns.begin(); it != patterns.end();) {
+            if (std::find(activeSignature.begin(), activeSignature.end(), it->first) == activeSignature.end()) {
+                it = patterns.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+    
+    FlowPattern& pattern = patterns[key];
+    int ranks = job.endpoints.size();
+    int kind = std::get<1>(key);
+    int distance = std::get<2>(key);
+    
+    pattern.pathOffsets.reserve(ranks + 1);
+    pattern.pathOffsets.push_back(0);
+    for (int rank = 0; rank < ranks; rank++) {
+        int peer = (kind == SHIFT) ? (rank + distance) % ranks : (rank ^ distance);
+        if (peer == rank || peer >= ranks) {
+            continue;
+        }
+        topology.getPath(job.endpoints[rank], job.endpoints[peer], pattern.links);
+        pattern.pathOffsets.push_back(pattern.links.size());
+    }
+    
+    return pattern;
+}
+
+void FluidFabric::advanceTime()
+{
+    // Drain every running step at its current rate
+    double elapsed = (simTime() - lastUpdate).dbl();
+    if (elapsed > 0) {
+        for (auto& job : jobs) {
+            if (job.inStep && job.stepTime > 0) {
+                job.remaining = std::max(0.0, job.remaining - elapsed / job.stepTime.dbl());
+            }
+        }
+    }
+    lastUpdate = simTime();
+}
+
+void FluidFabric::updateRates()
+{
+    // Rates only change when the set of active step patterns changes
+    std::vector<PatternKey> signature;
+    for (auto& job : jobs) {
+        if (job.inStep) {
+            signature.push_back(job.patternKey);
+        }
+    }
+    
+    if (signature != activeSignature) {
+        activeSignature = signature;
+        solveMaxMinRates();
+    } else {
+        solvesSkipped++;
+    }
+    
+    for (auto& job : jobs) {
+        if (job.inStep) {
+            job.stepTime = job.bytesPerFlow * 8 * job.inverseRate + stepLatency.dbl();
+        }
+    }
+    
+    scheduleNextCompletion();
+}
+
+void FluidFabric::solveMaxMinRates()
+{
+    // Progressive filling over all flows of all running steps
+    rateSolves++;
+    int numLinks = topology.getNumLinks();
+    
+    std::vector<const FlowPattern*> activePatterns;
+    std::vector<int> flowBase;          // First global flow index per active job
+    std::vector<FluidJob*> activeJobs;
+    int numFlows = 0;
+    for (auto& job : jobs) {
+        if (!job.inStep) continue;
+        const FlowPattern& pattern = getPattern(job, job.patternKey);
+        activePatterns.push_back(&pattern);
+        activeJobs.push_back(&job);
+        flowBase.push_back(numFlows);
+        numFlows += pattern.numFlows();
+    }
+    flowBase.push_back(numFlows);
+    
+    // Link to flow adjacency
+    unfrozen.assign(numLinks, 0);
+    for (const FlowPattern *pattern : activePatterns) {
+        for (int link : pattern->links) {
+            unfrozen[link]++;
+        }
+    }
+    linkOffsets.assign(numLinks + 1, 0);
+    for (int link = 0; link < numLinks; link++) {
+        linkOffsets[link + 1] = linkOffsets[link] + unfrozen[link];
+    }
+    linkFlows.resize(linkOffsets[numLinks]);
+    std::vector<int> fill(linkOffsets.begin(), linkOffsets.end() - 1);
+    for (size_t p = 0; p < activePatterns.size(); p++) {
+        const FlowPattern *pattern = activePatterns[p];
+        for (int flow = 0; flow < pattern->numFlows(); flow++) {
+            for (int i = pattern->pathOffsets[flow]; i < pattern->pathOffsets[flow + 1]; i++) {
+                linkFlows[fill[pattern->links[i]]++] = flowBase[p] + flow;
+            }
+        }
+    }
+    
+    residual.resize(numLinks);
+    for (int link = 0; link < numLinks; link++) {
+        residual[link] = topology.getCapacity(link);
+    }
+    
+    std::vector<double> rates(numFlows, -1.0);
+    int flowsLeft = numFlows;
+    
+    while (flowsLeft > 0) {
+        // Bottleneck share among links that still carry unfrozen flows
+        double minShare = std::numeric_limits<double>::infinity();
+        for (int link = 0; link < numLinks; link++) {
+            if (unfrozen[link] > 0) {
+                minShare = std::min(minShare, residual[link] / unfrozen[link]);
+            }
+        }
+        if (std::isinf(minShare)) {
+            break;      // Remaining flows cross no links
+        }
+        
+        // Freeze all flows crossing a bottleneck link; ties are frozen together
+        for (int link = 0; link < numLinks; link++) {
+            if (unfrozen[link] == 0 || residual[link] / unfrozen[link] > minShare * (1 + 1e-9)) {
+                continue;
+            }
+            for (int i = linkOffsets[link]; i < linkOffsets[link + 1]; i++) {
+                int flow = linkFlows[i];
+                if (rates[flow] >= 0) continue;
+                
+                rates[flow] = minShare;
+                flowsLeft--;
+                
+                // Locate the flow's path to release its share
+                size_t p = std::upper_bound(flowBase.begin(), flowBase.end(), flow) - flowBase.begin() - 1;
+                const FlowPattern *pattern = activePatterns[p];
+                int local = flow - flowBase[p];
+                for (int k = pattern->pathOffsets[local]; k < pattern->pathOffsets[local + 1]; k++) {
+                    int pathLink = pattern->links[k];
+                    residual[pathLink] = std::max(0.0, residual[pathLink] - minShare);
+                    unfrozen[pathLink]--;
+                }
+            }
+        }
+    }
+    
+    // A step lasts as long as its slowest flow
+    for (size_t p = 0; p < activeJobs.size(); p++) {
+        double slowest = 0;
+        for (int flow = flowBase[p]; flow < flowBase[p + 1]; flow++) {
+            if (rates[flow] > 0) {
+                slowest = std::max(slowest, 1.0 / rates[flow]);
+            }
+        }
+        activeJobs[p]->inverseRate = slowest;
+    }
+}
+
+void FluidFabric::scheduleNextCompletion()
+{
+    simtime_t next = SIMTIME_MAX;
+    for (auto& job : jobs) {
+        if (job.inStep) {
+            next = std::min(next, simTime() + job.remaining * job.stepTime);
+        }
+    }
+    
+    if (stepTimer->isScheduled()) {
+        cancelEvent(stepTimer);
+    }
+    if (next < SIMTIME_MAX) {
+        scheduleAt(next, stepTimer);
+    }
+}
+
+void FluidFabric::finish()
+{
+    long collectives = 0;
+    double totalCollectiveTime = 0;
+    double totalIterationTime = 0;
+    
+    for (auto& job : jobs) {
+        collectives += job.collectivesCompleted;
+        totalCollectiveTime += job.totalCollectiveTime;
+        totalIterationTime += job.totalIterationTime;
+        
+        if (jobs.size() > 1 && job.collectivesCompleted > 0) {
+            std::stringstream ss;
+            ss << "Job " << job.jobId << " Average Collective Time";
+            recordScalar(ss.str().c_str(), job.totalCollectiveTime / job.collectivesCompleted);
+        }
+    }
+    
+    recordScalar("Fluid Endpoints", topology.getNumEndpoints());
+    recordScalar("Fluid Switches", topology.getNumSwitches());
+    recordScalar("Fluid Links", topology.getNumLinks());
+    recordScalar("Fluid Rate Solves", rateSolves);
+    recordScalar("Fluid Solves Skipped", solvesSkipped);
+    recordScalar("Fluid Step Events", stepEvents);
+    recordScalar("Collectives Completed", collectives);
+    
+    if (collectives > 0) {
+        double avgCollectiveTime = totalCollectiveTime / collectives;
+        recordScalar("Average Collective Time", avgCollectiveTime);
+        recordScalar("Average Iteration Time", totalIterationTime / collectives);
+        
+        // Algorithm and bus bandwidth as reported by collective benchmarks
+        int ranks = jobs.empty() ? 1 : jobs[0].endpoints.size();
+        double algBandwidth = jobs[0].messageBytes * 8 / avgCollectiveTime;
+        double busFactor = 1.0;
+        if (workloadType == ALL_REDUCE) busFactor = 2.0 * (ranks - 1) / ranks;
+        else if (workloadType == ALL_GATHER || workloadType == REDUCE_SCATTER) busFactor = (double)(ranks - 1) / ranks;
+        recordScalar("Average Algorithm Bandwidth (Gbps)", algBandwidth / 1e9);
+        recordScalar("Average Bus Bandwidth (Gbps)", algBandwidth * busFactor / 1e9);
+    }
+    
+    EV << "FluidFabric finished: " << collectives << " collectives, "
+       << rateSolves << " rate solves, " << solvesSkipped << " skipped" << endl;
+}
+
+} // namespace tomahawk6
@@ -0,0 +1,137 @@
+#ifndef __TOMAHAWK6_FLUIDFABRIC_H_
+#define __TOMAHAWK6_FLUIDFABRIC_H_
+
+#include <omnetpp.h>
+#include <map>
+#include <tuple>
+#include <vector>
+#include "inet/common/INETDefs.h"
+#include "AIPacket_m.h"
+#include "FluidTopology.h"
+
+using namespace omnetpp;
+using namespace inet;
+
+namespace tomahawk6 {
+
+/**
+ * Flow-level (fluid) simulation engine for large-scale what-if studies
+ * Collective steps are represented as sets of concurrent flows whose rates
+ * are max-min fair shares of the link capacities. Rates are recomputed only
+ * when the set of active flows changes (a step starts or finishes).
+ */
+class INET_API FluidFabric : public cSimpleModule
+{
+  public:
+    enum CollectiveAlgorithm {
+        RING,
+        HALVING_DOUBLING
+    };
+    
+    enum PatternKind {
+        SHIFT,      // rank r sends to rank r+distance
+        EXCHANGE    // rank r exchanges with rank r^distance
+    };
+    
+    // Concurrent flows of one collective step (paths in CSR form)
+    struct FlowPattern {
+        std::vector<int> pathOffsets;
+        std::vector<int> links;
+        int numFlows() const { return (int)pathOffsets.size() - 1; }
+    };
+    
+    typedef std::tuple<int, int, int> PatternKey;   // jobId, kind, distance
+    
+    struct FluidJob {
+        int jobId;
+        std::vector<int> endpoints;     // Rank to endpoint mapping
+        double messageBytes;
+        int iterationsLeft;
+        
+        // Current collective step
+        int step;
+        int numSteps;
+        bool inStep;
+        PatternKey patternKey;
+        double bytesPerFlow;
+        double inverseRate;             // Slowest flow of the step (s/bit)
+        double remaining;               // Fraction of the step still to go
+        simtime_t stepTime;
+        
+        // Timing
+        simtime_t iterationStart;
+        simtime_t collectiveStart;
+        cMessage *computeTimer;
+        
+        // Statistics
+        long collectivesCompleted;
+        double totalCollectiveTime;
+        double maxCollectiveTime;
+        double totalIterationTime;
+    };
+
+  private:
+    // Configuration
+    AIWorkloadType workloadType;
+    CollectiveAlgorithm algorithm;
+    simtime_t stepLatency;
+    simtime_t computeTime;
+    size_t maxCachedPatterns;
+    
+    // Fabric and jobs
+    FluidTopology topology;
+    std::vector<FluidJob> jobs;
+    std::map<PatternKey, FlowPattern> patterns;
+    int jobsRunning;
+    
+    // Rate state
+    std::vector<PatternKey> activeSignature;
+    simtime_t lastUpdate;
+    cMessage *stepTimer;
+    
+    // Solver scratch space (reused across solves)
+    std::vector<double> residual;
+    std::vector<int> unfrozen;
+    std::vector<int> linkOffsets;
+    std::vector<int> linkFlows;
+    
+    // Statistics
+    long rateSolves;
+    long solvesSkipped;
+    long stepEvents;
+    simsignal_t collectiveTimeSignal;
+    simsignal_t iterationTimeSignal;
+    
+  protected:
+    virtual void initialize() override;
+    virtual void handleMessage(cMessage *msg) override;
+    virtual void finish() override;
+    
+    // Job lifecycle
+    virtual void startIteration(FluidJob& job);
+    virtual void startCollective(FluidJob& job);
+    virtual void startStep(FluidJob& job);
+    virtual void completeStep(FluidJob& job);
+    virtual void completeCollective(FluidJob& job);
+    
+    // Collective schedules
+    virtual int getNumSteps(const FluidJob& job);
+    virtual void getStepPlan(const FluidJob& job, int step, PatternKey& key, double& bytesPerFlow);
+    virtual const FlowPattern& getPattern(const FluidJob& job, const PatternKey& key);
+    
+    // Fluid engine
+    virtual void advanceTime();
+    virtual void updateRates();
+    virtual void solveMaxMinRates();
+    virtual void scheduleNextCompletion();
+    
+  public:
+    FluidFabric();
+    virtual ~FluidFabric();
+    
+    const FluidTopology& getTopology() const { return topology; }
+};
+
+} // namespace tomahawk6
+
+#endif
@@ -0,0 +1,167 @@
+#include "FluidTopology.h"
+#include <algorithm>
+#include <cmath>
+
+namespace tomahawk6 {
+
+FluidTopology::FluidTopology()
+{
+    type = STAR;
+    numEndpoints = 0;
+    endpointsPerSwitch = 1;
+    numTiers = 2;
+    leavesPerPod = 1;
+    linkRate = 0;
+    numLeaves = 0;
+    uplinksPerLeaf = 0;
+    numPods = 0;
+    coresPerPlane = 0;
+    leafUpBase = spineDownBase = spineUpBase = coreDownBase = torusBase = 0;
+}
+
+void FluidTopology::build(const std::string& topology, int numEndpoints, int endpointsPerSwitch,
+                          int numTiers, int leavesPerPod, double oversubscription,
+                          const std::vector<int>& torusDimensions, double linkRate)
+{
+    if (topology == "Clos" || topology == "FatTree") type = CLOS;
+    else if (topology == "Torus") type = TORUS;
+    else if (topology == "ScaleUp" || topology == "Star" || topology == "") type = STAR;
+    else throw cRuntimeError("Topology '%s' is not supported by the fluid engine", topology.c_str());
+    
+    this->numEndpoints = numEndpoints;
+    this->endpointsPerSwitch = std::max(1, endpointsPerSwitch);
+    this->numTiers = numTiers;
+    this->linkRate = linkRate;
+    this->torusDimensions = torusDimensions;
+    
+    // Endpoint links: up (endpoint -> switch) then down (switch -> endpoint)
+    capacities.assign(2 * numEndpoints, linkRate);
+    numLeaves = (numEndpoints + this->endpointsPerSwitch - 1) / this->endpointsPerSwitch;
+    
+    if (type == STAR) {
+        // Single non-blocking switch; only the endpoint links can saturate
+        numLeaves = 1;
+        this->endpointsPerSwitch = std::max(1, numEndpoints);
+        return;
+    }
+    
+    if (type == CLOS) {
+        // Leaf uplinks (= spine planes) follow from the oversubscription ratio
+        uplinksPerLeaf = std::max(1, (int)std::ceil(this->endpointsPerSwitch / oversubscription));
+        this->leavesPerPod = (numTiers >= 3) ? std::max(1, leavesPerPod) : numLeaves;
+        numPods = (numLeaves + this->leavesPerPod - 1) / this->leavesPerPod;
+        coresPerPlane = this->leavesPerPod;
+        
+        leafUpBase = capacities.size();
+        spineDownBase = leafUpBase + numLeaves * uplinksPerLeaf;
+        capacities.resize(spineDownBase + numLeaves * uplinksPerLeaf, linkRate);
+        
+        if (numTiers >= 3) {
+            spineUpBase = capacities.size();
+            coreDownBase = spineUpBase + numPods * uplinksPerLeaf * coresPerPlane;
+            capacities.resize(coreDownBase + numPods * uplinksPerLeaf * coresPerPlane, linkRate);
+        }
+        return;
+    }
+    
+    // Torus: one link per switch, dimension and direction
+    int switches = 1;
+    for (int size : torusDimensions) {
+        switches *= size;
+    }
+    if (switches < numLeaves) {
+        throw cRuntimeError("Torus %d switches cannot host %d endpoints at %d per switch",
+                            switches, numEndpoints, this->endpointsPerSwitch);
+    }
+    torusBase = capacities.size();
+    capacities.resize(torusBase + switches * torusDimensions.size() * 2, linkRate);
+}
+
+unsigned int FluidTopology::hashPair(int src, int dst, unsigned int salt)
+{
+    // Deterministic ECMP hash on the endpoint pair
+    unsigned int h = (unsigned int)src * 2654435761u ^ ((unsigned int)dst + salt) * 2246822519u;
+    h ^= h >> 15;
+    h *= 2654435761u;
+    return h ^ (h >> 13);
+}
+
+void FluidTopology::getPath(int src, int dst, std::vector<int>& path) const
+{
+    path.push_back(src);                        // Endpoint uplink
+    
+    int srcLeaf = getSwitchOf(src);
+    int dstLeaf = getSwitchOf(dst);
+    
+    if (type != STAR && srcLeaf != dstLeaf) {
+        if (type == TORUS) {
+            addTorusPath(srcLeaf, dstLeaf, path);
+        } else {
+            int plane = hashPair(src, dst, 0) % uplinksPerLeaf;
+            path.push_back(leafUpBase + srcLeaf * uplinksPerLeaf + plane);
+            
+            int srcPod = srcLeaf / leavesPerPod;
+            int dstPod = dstLeaf / leavesPerPod;
+            if (numTiers >= 3 && srcPod != dstPod) {
+                int core = hashPair(src, dst, 1) % coresPerPlane;
+                path.push_back(spineUpBase + (srcPod * uplinksPerLeaf + plane) * coresPerPlane + core);
+                path.push_back(coreDownBase + (dstPod * uplinksPerLeaf + plane) * coresPerPlane + core);
+            }
+            
+            path.push_back(spineDownBase + dstLeaf * uplinksPerLeaf + plane);
+        }
+    }
+    
+    path.push_back(numEndpoints + dst);         // Endpoint downlink
+}
+
+void FluidTopology::addTorusPath(int srcSwitch, int dstSwitch, std::vector<int>& path) const
+{
+    // Dimension-ordered routing, shortest direction around each ring
+    int dims = torusDimensions.size();
+    int current = srcSwitch;
+    int stride = 1;
+    
+    for (int dim = 0; dim < dims; dim++) {
+        int size = torusDimensions[dim];
+        int from = (current / stride) % size;
+        int to = (dstSwitch / stride) % size;
+        int forward = (to - from + size) % size;
+        int direction = (forward <= size / 2) ? 0 : 1;
+        int hops = (direction == 0) ? forward : size - forward;
+        
+        for (int hop = 0; hop < hops; hop++) {
+            path.push_back(torusBase + (current * dims + dim) * 2 + direction);
+            int coordinate = (current / stride) % size;
+            int next = (direction == 0) ? (coordinate + 1) % size : (coordinate - 1 + size) % size;
+            current += (next - coordinate) * stride;
+        }
+        stride *= size;
+    }
+}
+
+int FluidTopology::getNumSwitches() const
+{
+    switch (type) {
+        case CLOS:
+            return numLeaves + numPods * uplinksPerLeaf + (numTiers >= 3 ? uplinksPerLeaf * coresPerPlane : 0);
+        case TORUS: {
+            int switches = 1;
+            for (int size : torusDimensions) switches *= size;
+            return switches;
+        }
+        default:
+            return 1;
+    }
+}
+
+std::string FluidTopology::getTypeString() const
+{
+    switch (type) {
+        case CLOS: return numTiers >= 3 ? "Clos3" : "Clos2";
+        case TORUS: return "Torus";
+        default: return "Star";
+    }
+}
+
+} // namespace tomahawk6
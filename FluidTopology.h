@@ -0,0 +1,76 @@
+#ifndef __TOMAHAWK6_FLUIDTOPOLOGY_H_
+#define __TOMAHAWK6_FLUIDTOPOLOGY_H_
+
+#include <omnetpp.h>
+#include <string>
+#include <vector>
+#include "inet/common/INETDefs.h"
+
+using namespace omnetpp;
+using namespace inet;
+
+namespace tomahawk6 {
+
+/**
+ * Link-level fabric description for the flow-level (fluid) engine
+ * Builds directed links with capacities for star, 2/3-tier Clos and torus
+ * fabrics and computes ECMP / dimension-ordered paths between endpoints
+ */
+class INET_API FluidTopology
+{
+  public:
+    enum TopologyType {
+        STAR,
+        CLOS,
+        TORUS
+    };
+
+  private:
+    TopologyType type;
+    int numEndpoints;
+    int endpointsPerSwitch;
+    int numTiers;
+    int leavesPerPod;
+    double linkRate;
+    
+    // Derived sizes
+    int numLeaves;
+    int uplinksPerLeaf;     // Spine planes in a Clos
+    int numPods;
+    int coresPerPlane;
+    std::vector<int> torusDimensions;
+    
+    // Link index bases
+    int leafUpBase;
+    int spineDownBase;
+    int spineUpBase;
+    int coreDownBase;
+    int torusBase;
+    std::vector<double> capacities;
+    
+    static unsigned int hashPair(int src, int dst, unsigned int salt);
+    void addTorusPath(int srcSwitch, int dstSwitch, std::vector<int>& path) const;
+    
+  public:
+    FluidTopology();
+    
+    void build(const std::string& topology, int numEndpoints, int endpointsPerSwitch,
+               int numTiers, int leavesPerPod, double oversubscription,
+               const std::vector<int>& torusDimensions, double linkRate);
+    
+    // Appends the directed links from src to dst endpoint
+    void getPath(int src, int dst, std::vector<int>& path) const;
+    
+    // Topology queries
+    int getNumLinks() const { return capacities.size(); }
+    double getCapacity(int link) const { return capacities[link]; }
+    int getNumEndpoints() const { return numEndpoints; }
+    int getNumSwitches() const;
+    int getSwitchOf(int endpoint) const { return endpoint / endpointsPerSwitch; }
+    TopologyType getType() const { return type; }
+    std::string getTypeString() const;
+};
+
+} // namespace tomahawk6
+
+#endif
@@ -0,0 +1,416 @@
+#include "InferenceEndpoint.h"
+#include "PacketTrain.h"
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+
+namespace tomahawk6 {
+
+Define_Module(InferenceEndpoint);
+
+InferenceEndpoint::InferenceEndpoint()
+{
+    requestTimer = nullptr;
+    computeTimer = nullptr;
+    nextPrefill = 0;
+    nextDecode = 0;
+    requestsIssued = 0;
+    prefillBusy = false;
+    requestsCompleted = 0;
+    requestsWithinSlo = 0;
+    firstTokensReceived = 0;
+    totalTimeToFirstToken = 0;
+    kvTransfers = 0;
+    totalBytesSent = 0;
+    decodeSteps = 0;
+    tokensGenerated = 0;
+}
+
+InferenceEndpoint::~InferenceEndpoint()
+{
+    cancelAndDelete(requestTimer);
+    cancelAndDelete(computeTimer);
+}
+
+void InferenceEndpoint::initialize()
+{
+    // Read parameters
+    address = par("address");
+    
+    std::string roleStr = par("role").stdstringValue();
+    if (roleStr == "Client") role = CLIENT;
+    else if (roleStr == "Prefill") role = PREFILL;
+    else if (roleStr == "Decode") role = DECODE;
+    else throw cRuntimeError("Unknown inference role '%s'", roleStr.c_str());
+    
+    rocevProtocol = par("rocevProtocol");
+    mtu = par("mtu");
+    maxTrainLength = par("maxTrainLength");
+    nicDataRate = par("nicDataRate");
+    tokenBytes = par("tokenBytes");
+    kvBytesPerToken = par("kvBytesPerToken").intValue();
+    
+    requestRate = par("requestRate");
+    numRequests = par("numRequests").intValue();
+    sloLatency = par("sloLatency");
+    prefillTimePerToken = par("prefillTimePerToken");
+    decodeStepTime = par("decodeStepTime");
+    decodeTimePerRequest = par("decodeTimePerRequest");
+    maxDecodeBatch = std::max(1, (int)par("maxDecodeBatch"));
+    
+    // Initialize statistics
+    requestLatencySignal = registerSignal("requestLatency");
+    timeToFirstTokenSignal = registerSignal("timeToFirstToken");
+    queueLengthSignal = registerSignal("queueLength");
+    decodeBatchSignal = registerSignal("decodeBatch");
+    
+    pacer.init(this, "out");
+    pacer.setPacketTrains(maxTrainLength, nicDataRate);
+    nicFreeAt = 0;
+    computeTimer = new cMessage("inferenceCompute");
+    
+    if (role == CLIENT) {
+        parseServers(par("prefillServers").stringValue(), "prefill", prefillServers);
+        if (prefillServers.empty()) {
+            throw cRuntimeError("Inference client %d has no prefill servers", address);
+        }
+        // Spread the clients' first requests over the servers
+        nextPrefill = address % prefillServers.size();
+        
+        requestTimer = new cMessage("inferenceRequest");
+        if (requestRate > 0 && numRequests != 0) {
+            scheduleAt(simTime() + par("startTime") + exponential(1.0 / requestRate), requestTimer);
+        }
+    } else if (role == PREFILL) {
+        parseServers(par("decodeServers").stringValue(), "decode", decodeServers);
+        if (decodeServers.empty()) {
+            throw cRuntimeError("Prefill server %d has no decode servers", address);
+        }
+        nextDecode = address % decodeServers.size();
+    }
+    
+    EV << "InferenceEndpoint initialized: address " << address << ", role " << roleStr << endl;
+}
+
+void InferenceEndpoint::parseServers(const char *spec, const char *vectorName, std::vector<int>& servers)
+{
+    // Format: "address,address,first-last"; empty means every module of the
+    // sibling vector with the given name
+    if (spec[0] == '\0') {
+        cModule *parent = getParentModule();
+        if (!parent->hasSubmoduleVector(vectorName)) {
+            return;
+        }
+        int size = parent->getSubmoduleVectorSize(vectorName);
+        for (int i = 0; i < size; i++) {
+            servers.push_back(parent->getSubmodule(vectorName, i)->par("address"));
+        }
+        return;
+    }
+    
+    cStringTokenizer tokenizer(spec, ",");
+    while (tokenizer.hasMoreTokens()) {
+        std::string range = tokenizer.nextToken();
+        size_t dash = range.find('-');
+        int first = std::stoi(range.substr(0, dash));
+        int last = (dash == std::string::npos) ? first : std::stoi(range.substr(dash + 1));
+        for (int server = first; server <= last; server++) {
+            servers.push_back(server);
+        }
+    }
+}
+
+void InferenceEndpoint::handleMessage(cMessage *msg)
+{
+    if (pacer.handleTimer(msg)) {
+        return;
+    }
+    
+    if (msg == requestTimer) {
+        issueRequest();
+        if (numRequests < 0 || requestsIssued < numRequests) {
+            scheduleAt(simTime() + exponential(1.0 / requestRate), requestTimer);
+        }
+        return;
+    }
+    
+    if (msg == computeTimer) {
+        if (role == PREFILL) {
+            finishPrefill();
+        } else {
+            finishDecodeStep();
+        }
+        return;
+    }
+    
+    AIPacket *packet = dynamic_cast<AIPacket*>(msg);
+    if (packet == nullptr) {
+        EV << "Ignoring non-inference message " << msg->getName() << endl;
+        delete msg;
+        return;
+    }
+    
+    handleInferencePacket(packet);
+}
+
+void InferenceEndpoint::sendMessage(InferenceMessage type, const Request& request, long bytes, int destination)
+{
+    int headerBytes = rocevProtocol ? ROCE_HEADER_BYTES : 0;
+    
+    static const char *typeNames[] = {"", "Request", "KVCache", "Response"};
+    std::stringstream packetName;
+    packetName << typeNames[type] << "_" << request.client << "_" << request.requestId;
+    
+    AIPacket *packet = new AIPacket(packetName.str().c_str());
+    packet->setByteLength(std::max(1L, bytes) + headerBytes);
+    packet->setKind(POINT_TO_POINT);
+    packet->setTimestamp(simTime());
+    packet->setWorkloadType(POINT_TO_POINT);
+    packet->setTensorSize(bytes);
+    packet->setSource(address);
+    packet->setDestination(destination);
+    packet->setRoce(rocevProtocol);
+    packet->setChannel(-1);
+    packet->setInferenceMessage(type);
+    packet->setRequestId(request.requestId);
+    packet->setClient(request.client);
+    packet->setPromptTokens(request.promptTokens);
+    packet->setOutputTokens(type == INFERENCE_RESPONSE ? request.tokensGenerated : request.outputTokens);
+    packet->setRequestTime(request.requestTime);
+    
+    // Messages leave the NIC one after another at the line rate
+    PacketTrain::segmentMessage(packet, mtu, headerBytes);
+    long wireBytes = PacketTrain::getMessageWireBytes(packet);
+    simtime_t departure = std::max(simTime(), nicFreeAt);
+    nicFreeAt = departure + wireBytes * 8.0 / nicDataRate;
+    pacer.enqueue(packet, departure - simTime());
+    
+    totalBytesSent += wireBytes;
+}
+
+void InferenceEndpoint::handleInferencePacket(AIPacket *packet)
+{
+    if (packet->getDestination() != address) {
+        EV << "Endpoint " << address << " received packet for " << packet->getDestination()
+           << ", dropping" << endl;
+        delete packet;
+        return;
+    }
+    
+    // Act on a message once all of its segments have arrived
+    auto key = std::make_tuple(packet->getClient(), packet->getRequestId(), packet->getInferenceMessage(),
+                               packet->getOutputTokens());
+    long received = (receivedBytes[key] += PacketTrain::getTrainPayload(packet));
+    if (received < packet->getMessageBytes()) {
+        delete packet;
+        return;
+    }
+    receivedBytes.erase(key);
+    
+    Request request;
+    request.requestId = packet->getRequestId();
+    request.client = packet->getClient();
+    request.promptTokens = packet->getPromptTokens();
+    request.outputTokens = packet->getOutputTokens();
+    request.tokensGenerated = 0;
+    request.requestTime = packet->getRequestTime();
+    
+    switch (packet->getInferenceMessage()) {
+        case INFERENCE_REQUEST:
+            if (role != PREFILL) {
+                throw cRuntimeError("Endpoint %d is not a prefill server but received a request", address);
+            }
+            prefillQueue.push_back(request);
+            emit(queueLengthSignal, (long)prefillQueue.size());
+            if (!prefillBusy) {
+                startPrefill();
+            }
+            break;
+            
+        case INFERENCE_KV_CACHE:
+            if (role != DECODE) {
+                throw cRuntimeError("Endpoint %d is not a decode server but received a KV cache", address);
+            }
+            decodeQueue.push_back(request);
+            emit(queueLengthSignal, (long)decodeQueue.size());
+            if (!computeTimer->isScheduled()) {
+                startDecodeStep();
+            }
+            break;
+            
+        case INFERENCE_RESPONSE:
+            handleResponse(packet);
+            break;
+            
+        default:
+            EV << "Endpoint " << address << " ignoring non-inference packet " << packet->getName() << endl;
+            break;
+    }
+    
+    delete packet;
+}
+
+void InferenceEndpoint::issueRequest()
+{
+    Request request;
+    request.requestId = requestsIssued++;
+    request.client = address;
+    request.promptTokens = std::max(1, (int)par("promptTokens"));
+    request.outputTokens = std::max(1, (int)par("outputTokens"));
+    request.tokensGenerated = 0;
+    request.requestTime = simTime();
+    
+    outstanding[request.requestId] = OutstandingRequest{simTime(), request.outputTokens, false};
+    
+    // Prefill servers are used round-robin
+    int server = prefillServers[nextPrefill];
+    nextPrefill = (nextPrefill + 1) % prefillServers.size();
+    sendMessage(INFERENCE_REQUEST, request, (long)request.promptTokens * tokenBytes, server);
+}
+
+void InferenceEndpoint::handleResponse(AIPacket *packet)
+{
+    auto requestIt = outstanding.find(packet->getRequestId());
+    if (requestIt == outstanding.end()) {
+        EV << "Client " << address << " received response for unknown request " << packet->getRequestId() << endl;
+        return;
+    }
+    
+    OutstandingRequest& request = requestIt->second;
+    if (!request.firstTokenSeen) {
+        simtime_t timeToFirstToken = simTime() - request.issueTime;
+        request.firstTokenSeen = true;
+        firstTokensReceived++;
+        totalTimeToFirstToken += timeToFirstToken.dbl();
+        emit(timeToFirstTokenSignal, timeToFirstToken);
+    }
+    
+    // The response carrying the last token completes the request
+    if (packet->getOutputTokens() < request.outputTokens) {
+        return;
+    }
+    
+    simtime_t latency = simTime() - request.issueTime;
+    requestsCompleted++;
+    if (latency <= sloLatency) {
+        requestsWithinSlo++;
+    }
+    latencies.collect(latency);
+    emit(requestLatencySignal, latency);
+    outstanding.erase(requestIt);
+}
+
+void InferenceEndpoint::startPrefill()
+{
+    if (prefillQueue.empty()) {
+        prefillBusy = false;
+        return;
+    }
+    
+    // Prefill is compute-bound and scales with the prompt length
+    prefillBusy = true;
+    const Request& request = prefillQueue.front();
+    scheduleAt(simTime() + prefillTimePerToken * request.promptTokens, computeTimer);
+}
+
+void InferenceEndpoint::finishPrefill()
+{
+    Request request = prefillQueue.front();
+    prefillQueue.pop_front();
+    emit(queueLengthSignal, (long)prefillQueue.size());
+    
+    // Hand the KV cache to the decode servers round-robin
+    int server = decodeServers[nextDecode];
+    nextDecode = (nextDecode + 1) % decodeServers.size();
+    sendMessage(INFERENCE_KV_CACHE, request, (long)request.promptTokens * kvBytesPerToken, server);
+    kvTransfers++;
+    
+    startPrefill();
+}
+
+void InferenceEndpoint::startDecodeStep()
+{
+    // Waiting requests join the batch at the step boundary
+    while (!decodeQueue.empty() && (int)decodeBatch.size() < maxDecodeBatch) {
+        decodeBatch.push_back(decodeQueue.front());
+        decodeQueue.pop_front();
+    }
+    if (decodeBatch.empty()) {
+        return;
+    }
+    
+    emit(decodeBatchSignal, (long)decodeBatch.size());
+    scheduleAt(simTime() + decodeStepTime + decodeTimePerRequest * (double)decodeBatch.size(), computeTimer);
+}
+
+void InferenceEndpoint::finishDecodeStep()
+{
+    decodeSteps++;
+    
+    // Every request in the batch gains one token; the first and the last
+    // token are streamed back to the client
+    for (auto it = decodeBatch.begin(); it != decodeBatch.end();) {
+        it->tokensGenerated++;
+        tokensGenerated++;
+        
+        bool done = (it->tokensGenerated >= it->outputTokens);
+        if (done || it->tokensGenerated == 1) {
+            sendMessage(INFERENCE_RESPONSE, *it, (long)it->tokensGenerated * tokenBytes, it->client);
+        }
+        
+        if (done) {
+            it = decodeBatch.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    
+    startDecodeStep();
+}
+
+void InferenceEndpoint::finish()
+{
+    recordScalar("Total Bytes Sent", (double)totalBytesSent);
+    
+    if (role == CLIENT) {
+        recordScalar("Offered Load (req/s)", requestRate);
+        recordScalar("Requests Issued", (double)requestsIssued);
+        recordScalar("Requests Completed", (double)requestsCompleted);
+        recordScalar("Requests Outstanding", (double)outstanding.size());
+        
+        // Outstanding requests past the SLO have missed it already; they
+        // enter the percentiles with their age as a lower bound. Younger
+        // ones are still undecided and count for neither side.
+        long overdue = 0;
+        for (auto& entry : outstanding) {
+            simtime_t age = simTime() - entry.second.issueTime;
+            if (age > sloLatency) {
+                latencies.collect(age);
+                overdue++;
+            }
+        }
+        recordScalar("Requests Overdue", (double)overdue);
+        
+        if (firstTokensReceived > 0) {
+            recordScalar("Average Time To First Token", totalTimeToFirstToken / firstTokensReceived);
+        }
+        if (requestsCompleted + overdue > 0) {
+            latencies.recordScalars(this);
+            recordScalar("SLO Attainment", (double)requestsWithinSlo / (requestsCompleted + overdue));
+        }
+    } else if (role == PREFILL) {
+        recordScalar("KV Cache Transfers", (double)kvTransfers);
+        recordScalar("Prefill Queue Length", (double)prefillQueue.size());
+    } else {
+        recordScalar("Decode Steps", (double)decodeSteps);
+        recordScalar("Tokens Generated", (double)tokensGenerated);
+        if (decodeSteps > 0) {
+            recordScalar("Average Decode Batch", (double)tokensGenerated / decodeSteps);
+        }
+    }
+    
+    EV << "InferenceEndpoint " << address << " finished: " << requestsCompleted << " requests completed, "
+       << totalBytesSent << " bytes sent" << endl;
+}
+
+} // namespace tomahawk6
@@ -0,0 +1,143 @@
+#ifndef __TOMAHAWK6_INFERENCEENDPOINT_H_
+#define __TOMAHAWK6_INFERENCEENDPOINT_H_
+
+#include <omnetpp.h>
+#include <deque>
+#include <map>
+#include <tuple>
+#include <vector>
+#include "inet/common/INETDefs.h"
+#include "AIPacket_m.h"
+#include "LatencyHistogram.h"
+#include "TrafficPacer.h"
+
+using namespace omnetpp;
+using namespace inet;
+
+namespace tomahawk6 {
+
+/**
+ * Endpoint of a disaggregated LLM inference service
+ * Clients issue requests with a Poisson arrival process. A prefill server
+ * processes prompts one at a time and transfers the KV cache to a decode
+ * server, which generates tokens for all its requests in continuous
+ * batches and streams small responses back (first and last token).
+ * Clients track request latency against an SLO.
+ */
+class INET_API InferenceEndpoint : public cSimpleModule
+{
+  public:
+    enum Role {
+        CLIENT,
+        PREFILL,
+        DECODE
+    };
+    
+  private:
+    static const int ROCE_HEADER_BYTES = 42;
+    
+    struct Request {
+        long requestId;
+        int client;
+        int promptTokens;
+        int outputTokens;
+        int tokensGenerated;
+        simtime_t requestTime;
+    };
+    
+    struct OutstandingRequest {
+        simtime_t issueTime;
+        int outputTokens;
+        bool firstTokenSeen;
+    };
+    
+    // Configuration parameters
+    int address;
+    Role role;
+    bool rocevProtocol;
+    int mtu;
+    int maxTrainLength;
+    double nicDataRate;
+    int tokenBytes;             // Prompt and response bytes per token
+    long kvBytesPerToken;
+    
+    // Client
+    double requestRate;
+    long numRequests;
+    simtime_t sloLatency;
+    std::vector<int> prefillServers;
+    int nextPrefill;
+    long requestsIssued;
+    std::map<long, OutstandingRequest> outstanding;
+    
+    // Prefill server: prompts are processed one at a time in arrival order
+    simtime_t prefillTimePerToken;
+    std::vector<int> decodeServers;
+    int nextDecode;
+    std::deque<Request> prefillQueue;
+    bool prefillBusy;
+    
+    // Decode server: continuous batching, requests join at step boundaries
+    simtime_t decodeStepTime;
+    simtime_t decodeTimePerRequest;
+    int maxDecodeBatch;
+    std::deque<Request> decodeQueue;
+    std::vector<Request> decodeBatch;
+    
+    // Partially received messages: (client, request, message type, tokens) -> payload bytes
+    std::map<std::tuple<int, long, int, int>, long> receivedBytes;
+    
+    // Timers and paced emission
+    cMessage *requestTimer;
+    cMessage *computeTimer;
+    TrafficPacer pacer;
+    simtime_t nicFreeAt;
+    
+    // Statistics
+    long requestsCompleted;
+    long requestsWithinSlo;
+    LatencyHistogram latencies;
+    long firstTokensReceived;
+    double totalTimeToFirstToken;
+    long kvTransfers;
+    long totalBytesSent;
+    long decodeSteps;
+    long tokensGenerated;
+    simsignal_t requestLatencySignal;
+    simsignal_t timeToFirstTokenSignal;
+    simsignal_t queueLengthSignal;
+    simsignal_t decodeBatchSignal;
+    
+  protected:
+    virtual void initialize() override;
+    virtual void handleMessage(cMessage *msg) override;
+    virtual void finish() override;
+    
+    virtual void parseServers(const char *spec, const char *vectorName, std::vector<int>& servers);
+    virtual void sendMessage(InferenceMessage type, const Request& request, long bytes, int destination);
+    virtual void handleInferencePacket(AIPacket *packet);
+    
+    // Client
+    virtual void issueRequest();
+    virtual void handleResponse(AIPacket *packet);
+    
+    // Prefill server
+    virtual void startPrefill();
+    virtual void finishPrefill();
+    
+    // Decode server
+    virtual void startDecodeStep();
+    virtual void finishDecodeStep();
+    
+    
+  public:
+    InferenceEndpoint();
+    virtual ~InferenceEndpoint();
+    
+    int getAddress() const { return address; }
+    Role getRole() const { return role; }
+};
+
+} // namespace tomahawk6
+
+#endif
@@ -0,0 +1,328 @@
+#include "JobScheduler.h"
+#include "CollectiveEndpoint.h"
+#include "WorkloadType.h"
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+
+namespace tomahawk6 {
+
+Define_Module(JobScheduler);
+
+JobScheduler::JobScheduler()
+{
+    arrivalTimer = nullptr;
+    totalWeight = 0;
+    calibratingClass = -1;
+    jobsArrived = 0;
+    jobsStarted = 0;
+    jobsCompleted = 0;
+    totalSlowdown = 0;
+    maxSlowdown = 0;
+    totalWaitTime = 0;
+    totalCrossSwitchHops = 0;
+}
+
+JobScheduler::~JobScheduler()
+{
+    cancelAndDelete(arrivalTimer);
+}
+
+void JobScheduler::initialize()
+{
+    // Read parameters
+    parseJobMix(par("jobMix").stringValue());
+    numJobs = par("numJobs");
+    endWhenDone = par("endWhenDone");
+    
+    std::string placementStr = par("placement").stdstringValue();
+    rankPlacement.init(par("gpusPerNode"), par("endpointsPerSwitch"), par("railOptimized"));
+    if (placementStr == "FirstFit") placement = FIRST_FIT;
+    else if (placementStr == "Random") placement = RANDOM_PLACEMENT;
+    else if (RankPlacement::isPolicy(placementStr)) placement = TOPOLOGY_AWARE;
+    else throw cRuntimeError("Unknown placement policy '%s'", placementStr.c_str());
+    if (placement == TOPOLOGY_AWARE) {
+        rankPlacement.setPolicy(placementStr);
+    }
+    
+    // Endpoints are the sibling "endpoint" vector, indexed by address
+    int numEndpoints = getParentModule()->getSubmoduleVectorSize("endpoint");
+    for (int i = 0; i < numEndpoints; i++) {
+        endpoints.push_back(check_and_cast<CollectiveEndpoint*>(getParentModule()->getSubmodule("endpoint", i)));
+    }
+    endpointOwner.assign(numEndpoints, -1);
+    if (endpoints.empty()) {
+        throw cRuntimeError("JobScheduler found no endpoints");
+    }
+    
+    for (auto& jobClass : jobClasses) {
+        if (jobClass.numGPUs > numEndpoints) {
+            throw cRuntimeError("Job class '%s' needs %d GPUs, only %d endpoints",
+                                jobClass.name.c_str(), jobClass.numGPUs, numEndpoints);
+        }
+    }
+    
+    // Initialize statistics
+    jobSlowdownSignal = registerSignal("jobSlowdown");
+    jobWaitTimeSignal = registerSignal("jobWaitTime");
+    jobsRunningSignal = registerSignal("jobsRunning");
+    
+    // Job arrivals start once every class has been timed alone
+    aloneTimes.assign(jobClasses.size(), SIMTIME_ZERO);
+    arrivalTimer = new cMessage("jobArrival");
+    if (numJobs > 0) {
+        calibratingClass = 0;
+        scheduleAt(simTime(), arrivalTimer);
+    }
+    
+    EV << "JobScheduler initialized: " << jobClasses.size() << " job classes, "
+       << numJobs << " jobs, " << numEndpoints << " endpoints, placement " << placementStr << endl;
+}
+
+void JobScheduler::parseJobMix(const char *spec)
+{
+    // Format: "name:workload:gpus:size:iterations:gap:weight;..."
+    cStringTokenizer classTokenizer(spec, ";");
+    while (classTokenizer.hasMoreTokens()) {
+        std::string entry = classTokenizer.nextToken();
+        std::vector<std::string> fields = cStringTokenizer(entry.c_str(), ": ").asVector();
+        if (fields.size() != 7) {
+            throw cRuntimeError("Invalid job mix entry '%s', expected name:workload:gpus:size:iterations:gap:weight",
+                                entry.c_str());
+        }
+        
+        JobClass jobClass;
+        jobClass.name = fields[0];
+        jobClass.workloadType = parseWorkloadType(fields[1].c_str());
+        jobClass.numGPUs = std::stoi(fields[2]);
+        jobClass.messageBytes = (long)cValue::parseQuantity(fields[3].c_str(), "B");
+        jobClass.iterations = std::stoi(fields[4]);
+        jobClass.computeGap = cValue::parseQuantity(fields[5].c_str(), "s");
+        jobClass.weight = std::stod(fields[6]);
+        
+        totalWeight += jobClass.weight;
+        jobClasses.push_back(jobClass);
+    }
+    
+    if (jobClasses.empty() || totalWeight <= 0) {
+        throw cRuntimeError("Job mix is empty");
+    }
+}
+
+void JobScheduler::handleMessage(cMessage *msg)
+{
+    if (msg == arrivalTimer) {
+        if (calibratingClass >= 0) {
+            startCalibrationRun();
+            return;
+        }
+        
+        jobArrival();
+        
+        if (jobsArrived < numJobs) {
+            scheduleAt(simTime() + par("jobInterarrival"), arrivalTimer);
+        }
+        return;
+    }
+    
+    delete msg;
+}
+
+void JobScheduler::jobArrival()
+{
+    // Pick a job class by weight
+    double pick = uniform(0, totalWeight);
+    int classIndex = 0;
+    while (classIndex < (int)jobClasses.size() - 1 && pick >= jobClasses[classIndex].weight) {
+        pick -= jobClasses[classIndex].weight;
+        classIndex++;
+    }
+    
+    Job job;
+    job.jobId = jobsArrived++;
+    job.jobClass = classIndex;
+    job.arrivalTime = simTime();
+    job.aloneTime = aloneTimes[classIndex];
+    waitingJobs.push_back(job);
+    
+    EV << "Job " << job.jobId << " (" << jobClasses[classIndex].name << ", "
+       << jobClasses[classIndex].numGPUs << " GPUs) arrived" << endl;
+       
+    scheduleWaitingJobs();
+}
+
+void JobScheduler::scheduleWaitingJobs()
+{
+    // FIFO: a job that does not fit blocks the jobs behind it
+    while (!waitingJobs.empty()) {
+        Job& job = waitingJobs.front();
+        if (!placeJob(job)) {
+            break;
+        }
+        
+        job.startTime = simTime();
+        simtime_t waitTime = job.startTime - job.arrivalTime;
+        jobsStarted++;
+        totalWaitTime += waitTime.dbl();
+        emit(jobWaitTimeSignal, waitTime);
+        
+        // Ring neighbours on different switches send through the spine
+        int crossSwitchHops = rankPlacement.countCrossSwitchHops(job.endpoints);
+        totalCrossSwitchHops += (double)crossSwitchHops / job.endpoints.size();
+        
+        EV << "Job " << job.jobId << " started on " << job.endpoints.size()
+           << " endpoints after waiting " << waitTime << "s" << endl;
+           
+        startJob(job);
+        waitingJobs.pop_front();
+        emit(jobsRunningSignal, (long)runningJobs.size());
+    }
+}
+
+void JobScheduler::startJob(const Job& job)
+{
+    for (int endpoint : job.endpoints) {
+        endpointOwner[endpoint] = job.jobId;
+    }
+    const Job& running = runningJobs[job.jobId] = job;
+    
+    // Start every rank of the job at the same time
+    const JobClass& jobClass = jobClasses[running.jobClass];
+    for (int endpoint : running.endpoints) {
+        endpoints[endpoint]->startJob(running.jobId, running.endpoints, jobClass.workloadType,
+                                      jobClass.messageBytes, jobClass.iterations,
+                                      jobClass.computeGap, this);
+    }
+}
+
+void JobScheduler::startCalibrationRun()
+{
+    // One job of the class on the idle fabric, placed like the mix places
+    // it; ids above the mix's keep the endpoints' job numbering apart
+    Job job;
+    job.jobId = numJobs + calibratingClass;
+    job.jobClass = calibratingClass;
+    job.arrivalTime = simTime();
+    job.startTime = simTime();
+    if (!placeJob(job)) {
+        throw cRuntimeError("Job class '%s' cannot be placed on the idle fabric",
+                            jobClasses[calibratingClass].name.c_str());
+    }
+    
+    EV << "Timing job class " << jobClasses[calibratingClass].name << " alone" << endl;
+    startJob(job);
+}
+
+bool JobScheduler::placeJob(Job& job)
+{
+    std::vector<int> freeEndpoints;
+    for (int i = 0; i < (int)endpointOwner.size(); i++) {
+        if (endpointOwner[i] < 0) {
+            freeEndpoints.push_back(i);
+        }
+    }
+    
+    int needed = jobClasses[job.jobClass].numGPUs;
+    if ((int)freeEndpoints.size() < needed) {
+        return false;
+    }
+    
+    if (placement == TOPOLOGY_AWARE) {
+        job.endpoints = rankPlacement.place(freeEndpoints, needed);
+        return !job.endpoints.empty();
+    }
+    
+    if (placement == RANDOM_PLACEMENT) {
+        for (int i = freeEndpoints.size() - 1; i > 0; i--) {
+            std::swap(freeEndpoints[i], freeEndpoints[intuniform(0, i)]);
+        }
+    }
+    
+    job.endpoints.assign(freeEndpoints.begin(), freeEndpoints.begin() + needed);
+    return true;
+}
+
+void JobScheduler::jobCompleted(int jobId)
+{
+    Enter_Method("jobCompleted");
+    
+    auto jobIt = runningJobs.find(jobId);
+    if (jobIt == runningJobs.end()) {
+        throw cRuntimeError("Completion reported for unknown job %d", jobId);
+    }
+    
+    Job& job = jobIt->second;
+    const JobClass& jobClass = jobClasses[job.jobClass];
+    simtime_t runtime = simTime() - job.startTime;
+    for (int endpoint : job.endpoints) {
+        endpointOwner[endpoint] = -1;
+    }
+    
+    if (calibratingClass >= 0) {
+        aloneTimes[job.jobClass] = runtime;
+        std::string statName = "Alone Time " + jobClass.name;
+        recordScalar(statName.c_str(), runtime);
+        EV << "Job class " << jobClass.name << " runs alone in " << runtime << "s" << endl;
+        runningJobs.erase(jobIt);
+        
+        // Next class, or the first arrival of the job mix
+        if (++calibratingClass == (int)jobClasses.size()) {
+            calibratingClass = -1;
+            scheduleAt(simTime() + par("firstArrival"), arrivalTimer);
+        } else {
+            scheduleAt(simTime(), arrivalTimer);
+        }
+        return;
+    }
+    
+    double slowdown = runtime / job.aloneTime;
+    
+    jobsCompleted++;
+    totalSlowdown += slowdown;
+    maxSlowdown = std::max(maxSlowdown, slowdown);
+    classSlowdown[jobClass.name].first++;
+    classSlowdown[jobClass.name].second += slowdown;
+    emit(jobSlowdownSignal, slowdown);
+    
+    std::stringstream ss;
+    ss << "Job " << jobId << " Slowdown";
+    recordScalar(ss.str().c_str(), slowdown);
+    
+    EV << "Job " << jobId << " (" << jobClass.name << ") completed in " << runtime
+       << "s, alone " << job.aloneTime << "s, slowdown " << slowdown << endl;
+       
+    runningJobs.erase(jobIt);
+    emit(jobsRunningSignal, (long)runningJobs.size());
+    
+    scheduleWaitingJobs();
+    
+    if (endWhenDone && jobsArrived == numJobs && runningJobs.empty() && waitingJobs.empty()) {
+        EV << "All " << numJobs << " jobs completed" << endl;
+        endSimulation();
+    }
+}
+
+void JobScheduler::finish()
+{
+    recordScalar("Jobs Arrived", jobsArrived);
+    recordScalar("Jobs Completed", jobsCompleted);
+    recordScalar("Jobs Waiting", (double)waitingJobs.size());
+    
+    if (jobsCompleted > 0) {
+        recordScalar("Average Slowdown", totalSlowdown / jobsCompleted);
+        recordScalar("Max Slowdown", maxSlowdown);
+    }
+    if (jobsStarted > 0) {
+        recordScalar("Average Wait Time", totalWaitTime / jobsStarted);
+        recordScalar("Average Cross-Switch Ring Hops", totalCrossSwitchHops / jobsStarted);
+    }
+    
+    for (auto& entry : classSlowdown) {
+        std::string statName = "Average Slowdown " + entry.first;
+        recordScalar(statName.c_str(), entry.second.second / entry.second.first);
+    }
+    
+    EV << "JobScheduler finished: " << jobsCompleted << "/" << jobsArrived << " jobs completed" << endl;
+}
+
+} // namespace tomahawk6
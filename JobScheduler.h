@@ -0,0 +1,115 @@
+#ifndef __TOMAHAWK6_JOBSCHEDULER_H_
+#define __TOMAHAWK6_JOBSCHEDULER_H_
+
+#include <omnetpp.h>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+#include "inet/common/INETDefs.h"
+#include "AIPacket_m.h"
+#include "RankPlacement.h"
+
+using namespace omnetpp;
+using namespace inet;
+
+namespace tomahawk6 {
+
+class CollectiveEndpoint;
+
+/**
+ * Multi-tenant job scheduler
+ * Jobs drawn from a weighted job mix arrive over time, wait for free GPU
+ * endpoints, are placed and run on CollectiveEndpoints, and release their
+ * endpoints when done. Before the first arrival every job class runs once
+ * on the otherwise idle fabric; each job's runtime is compared with the
+ * alone time measured for its class (slowdown).
+ */
+class INET_API JobScheduler : public cSimpleModule
+{
+  public:
+    enum PlacementPolicy {
+        FIRST_FIT,
+        RANDOM_PLACEMENT,
+        TOPOLOGY_AWARE      // Packed, Spread or RailAligned (RankPlacement)
+    };
+    
+    struct JobClass {
+        std::string name;
+        AIWorkloadType workloadType;
+        int numGPUs;
+        long messageBytes;
+        int iterations;
+        simtime_t computeGap;
+        double weight;
+    };
+    
+    struct Job {
+        int jobId;
+        int jobClass;
+        std::vector<int> endpoints;
+        simtime_t arrivalTime;
+        simtime_t startTime;
+        simtime_t aloneTime;
+    };
+    
+  private:
+    // Configuration
+    std::vector<JobClass> jobClasses;
+    double totalWeight;
+    int numJobs;
+    PlacementPolicy placement;
+    RankPlacement rankPlacement;
+    bool endWhenDone;
+    
+    // Alone-time calibration
+    std::vector<simtime_t> aloneTimes;  // Measured per job class
+    int calibratingClass;               // Job class running alone, -1 when calibrated
+    
+    // Cluster state
+    std::vector<CollectiveEndpoint*> endpoints;
+    std::vector<int> endpointOwner;     // Job running on each endpoint, -1 if free
+    std::deque<Job> waitingJobs;
+    std::map<int, Job> runningJobs;
+    int jobsArrived;
+    
+    cMessage *arrivalTimer;
+    
+    // Statistics
+    int jobsStarted;
+    int jobsCompleted;
+    double totalSlowdown;
+    double maxSlowdown;
+    double totalWaitTime;
+    double totalCrossSwitchHops;    // Per job, relative to its ring length
+    std::map<std::string, std::pair<int, double>> classSlowdown;   // count, sum
+    simsignal_t jobSlowdownSignal;
+    simsignal_t jobWaitTimeSignal;
+    simsignal_t jobsRunningSignal;
+    
+  protected:
+    virtual void initialize() override;
+    virtual void handleMessage(cMessage *msg) override;
+    virtual void finish() override;
+    
+    virtual void parseJobMix(const char *spec);
+    virtual void jobArrival();
+    virtual void scheduleWaitingJobs();
+    virtual bool placeJob(Job& job);
+    virtual void startJob(const Job& job);
+    virtual void startCalibrationRun();
+    
+  public:
+    JobScheduler();
+    virtual ~JobScheduler();
+    
+    // Called by the job's rank 0 once its last collective has completed
+    void jobCompleted(int jobId);
+    
+    int getRunningJobs() const { return runningJobs.size(); }
+    int getWaitingJobs() const { return waitingJobs.size(); }
+};
+
+} // namespace tomahawk6
+
+#endif
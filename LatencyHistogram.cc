@@ -0,0 +1,95 @@
+#include "LatencyHistogram.h"
+#include <algorithm>
+#include <cmath>
+
+namespace tomahawk6 {
+
+LatencyHistogram::LatencyHistogram(int precisionBits)
+{
+    if (precisionBits < 1 || precisionBits > 20) {
+        throw cRuntimeError("Latency histogram precision of %d bits out of range 1..20", precisionBits);
+    }
+    this->precisionBits = precisionBits;
+    firstBucket = 0;
+    count = 0;
+    minLatency = 0;
+    maxLatency = 0;
+    sum = 0;
+}
+
+int LatencyHistogram::getBucket(int64_t picoseconds) const
+{
+    // The top precisionBits + 1 bits of the value select the bucket
+    int shift = 0;
+    for (int64_t top = picoseconds >> precisionBits; top > 1; top >>= 1) {
+        shift++;
+    }
+    return (shift << precisionBits) + (int)(picoseconds >> shift);
+}
+
+int64_t LatencyHistogram::getBucketMidpoint(int bucket) const
+{
+    int shift = std::max(0, (bucket >> precisionBits) - 1);
+    int64_t lower = (int64_t)(bucket - (shift << precisionBits)) << shift;
+    return lower + ((int64_t(1) << shift) - 1) / 2;
+}
+
+void LatencyHistogram::collect(simtime_t latency)
+{
+    int64_t picoseconds = std::max((int64_t)0, (int64_t)std::llround(latency.dbl() * 1e12));
+    int bucket = getBucket(picoseconds);
+    
+    // Grow the stored range to cover the bucket
+    if (counts.empty()) {
+        firstBucket = bucket;
+        counts.assign(1, 0);
+    } else if (bucket < firstBucket) {
+        counts.insert(counts.begin(), firstBucket - bucket, 0);
+        firstBucket = bucket;
+    } else if (bucket >= firstBucket + (int)counts.size()) {
+        counts.resize(bucket - firstBucket + 1, 0);
+    }
+    counts[bucket - firstBucket]++;
+    
+    if (count == 0 || latency < minLatency) {
+        minLatency = latency;
+    }
+    if (count == 0 || latency > maxLatency) {
+        maxLatency = latency;
+    }
+    count++;
+    sum += latency.dbl();
+}
+
+simtime_t LatencyHistogram::getPercentile(double percentile) const
+{
+    if (count == 0) {
+        return 0;
+    }
+    
+    long rank = (long)std::ceil(percentile / 100.0 * count);
+    rank = std::min(count, std::max(1L, rank));
+    if (rank == count) {
+        return maxLatency;
+    }
+    
+    long cumulative = 0;
+    for (size_t i = 0; i < counts.size(); i++) {
+        cumulative += counts[i];
+        if (cumulative >= rank) {
+            simtime_t value = getBucketMidpoint(firstBucket + i) * 1e-12;
+            return std::min(maxLatency, std::max(minLatency, value));
+        }
+    }
+    return maxLatency;
+}
+
+void LatencyHistogram::recordScalars(cComponent *owner, const std::string& prefix) const
+{
+    owner->recordScalar((prefix + "Latency p50").c_str(), getPercentile(50).dbl());
+    owner->recordScalar((prefix + "Latency p99").c_str(), getPercentile(99).dbl());
+    owner->recordScalar((prefix + "Latency p99.9").c_str(), getPercentile(99.9).dbl());
+    owner->recordScalar((prefix + "Latency Max").c_str(), maxLatency.dbl());
+}
+
+} // namespace tomahawk6
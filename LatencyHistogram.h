@@ -0,0 +1,58 @@
+#ifndef __TOMAHAWK6_LATENCYHISTOGRAM_H_
+#define __TOMAHAWK6_LATENCYHISTOGRAM_H_
+
+#include <omnetpp.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "inet/common/INETDefs.h"
+
+using namespace omnetpp;
+using namespace inet;
+
+namespace tomahawk6 {
+
+/**
+ * Streaming latency histogram with bounded relative error (HDR histogram
+ * bucket layout)
+ *
+ * Latencies are counted in picoseconds. Values below 2^(precisionBits+1)
+ * ps get a bucket each. Above that, every power of two is split into
+ * 2^precisionBits equal buckets. A percentile is therefore off by at most
+ * 2^-(precisionBits+1) of its value; 7 bits keep it within 0.4%. Only the
+ * buckets between the smallest and the largest latency seen are stored,
+ * so memory does not grow with the number of samples.
+ */
+class INET_API LatencyHistogram
+{
+  private:
+    int precisionBits;
+    std::vector<long> counts;   // Buckets firstBucket .. firstBucket + counts.size() - 1
+    int firstBucket;
+    long count;
+    simtime_t minLatency;
+    simtime_t maxLatency;
+    double sum;
+    
+    int getBucket(int64_t picoseconds) const;
+    int64_t getBucketMidpoint(int bucket) const;
+    
+  public:
+    explicit LatencyHistogram(int precisionBits = 7);
+    
+    void collect(simtime_t latency);
+    
+    long getCount() const { return count; }
+    simtime_t getMin() const { return minLatency; }
+    simtime_t getMax() const { return maxLatency; }
+    simtime_t getMean() const { return count > 0 ? sum / count : 0; }
+    simtime_t getPercentile(double percentile) const;   // Nearest rank
+    size_t getBucketsStored() const { return counts.size(); }
+    
+    // "<prefix>Latency p50", "... p99", "... p99.9" and "... Max" in seconds
+    void recordScalars(cComponent *owner, const std::string& prefix = "") const;
+};
+
+} // namespace tomahawk6
+
+#endif
@@ -0,0 +1,65 @@
+#include "MulticastReplicator.h"
+#include <algorithm>
+
+namespace tomahawk6 {
+
+MulticastReplicator::MulticastReplicator()
+{
+    packetsReplicated = 0;
+    copiesCreated = 0;
+    payloadBytes = 0;
+    sharedBytes = 0;
+    maxFanout = 0;
+}
+
+std::vector<cPacket*> MulticastReplicator::replicate(cPacket *packet, int fanout)
+{
+    std::vector<cPacket*> copies;
+    if (fanout <= 0) {
+        delete packet;
+        return copies;
+    }
+
+    // Wrap the payload in a zero-length replication header. dup() of the header
+    // shares the encapsulated payload (reference counted) instead of copying it.
+    cPacket *header = new cPacket(packet->getName(), packet->getKind());
+    header->setByteLength(0);
+    header->setTimestamp(packet->getTimestamp());
+    header->encapsulate(packet);
+
+    copies.reserve(fanout);
+    copies.push_back(header);
+    for (int i = 1; i < fanout; i++) {
+        copies.push_back(header->dup());
+    }
+
+    // Update statistics
+    long size = packet->getByteLength();
+    packetsReplicated++;
+    copiesCreated += fanout;
+    payloadBytes += size * fanout;
+    sharedBytes += size * (fanout - 1);
+    maxFanout = std::max(maxFanout, fanout);
+
+    return copies;
+}
+
+cPacket* MulticastReplicator::getPayload(cPacket *packet)
+{
+    // Replicated copies carry the original packet as their payload
+    cPacket *payload = packet->getEncapsulatedPacket();
+    return payload != nullptr ? payload : packet;
+}
+
+double MulticastReplicator::getAverageFanout() const
+{
+    return packetsReplicated > 0 ? (double)copiesCreated / packetsReplicated : 0.0;
+}
+
+double MulticastReplicator::getBufferSavings() const
+{
+    // Fraction of replicated bytes that did not need their own buffer copy
+    return payloadBytes > 0 ? (double)sharedBytes / payloadBytes : 0.0;
+}
+
+} // namespace tomahawk6
@@ -0,0 +1,46 @@
+#ifndef __TOMAHAWK6_MULTICASTREPLICATOR_H_
+#define __TOMAHAWK6_MULTICASTREPLICATOR_H_
+
+#include <omnetpp.h>
+#include <vector>
+#include "inet/common/INETDefs.h"
+
+using namespace omnetpp;
+using namespace inet;
+
+namespace tomahawk6 {
+
+/**
+ * Egress replication engine for multicast traffic
+ * Builds one copy per egress port; all copies share a single reference-counted
+ * payload instead of duplicating the original packet
+ */
+class INET_API MulticastReplicator
+{
+  private:
+    // Statistics
+    long packetsReplicated;
+    long copiesCreated;
+    long payloadBytes;
+    long sharedBytes;
+    int maxFanout;
+
+  public:
+    MulticastReplicator();
+
+    // Replication
+    std::vector<cPacket*> replicate(cPacket *packet, int fanout);
+    static cPacket* getPayload(cPacket *packet);
+
+    // Statistics
+    long getPacketsReplicated() const { return packetsReplicated; }
+    long getCopiesCreated() const { return copiesCreated; }
+    long getSharedBytes() const { return sharedBytes; }
+    int getMaxFanout() const { return maxFanout; }
+    double getAverageFanout() const;
+    double getBufferSavings() const;
+};
+
+} // namespace tomahawk6
+
+#endif
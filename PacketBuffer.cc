@@ -1,5 +1,9 @@
 #include "PacketBuffer.h"
+#include "PacketTrain.h"
+#include "SerDesCore.h"
 #include "inet/common/packet/Packet.h"
+#include <algorithm>
+#include <climits>
 
 namespace tomahawk6 {
 
@@ -9,8 +13,14 @@ PacketBuffer::PacketBuffer()
 {
     processingTimer = nullptr;
     processing = false;
+    backpressure = false;
+    stallTime = 0;
+    stallEvents = 0;
     totalBufferUsed = 0;
     currentRRIndex = 0;
+    trainsSplit = 0;
+    trainsCut = 0;
+    egress = nullptr;
     lastAdaptationTime = 0;
 }
 
@@ -82,6 +92,11 @@ void PacketBuffer::initialize()
     packetDropSignal = registerSignal("packetDrop");
     throughputSignal = registerSignal("throughput");
     
+    // A SerDes on out[0] limits how much of a train leaves at once
+    if (gateSize("out") > 0) {
+        egress = dynamic_cast<SerDesCore*>(gate("out", 0)->getPathEndGate()->getOwnerModule());
+    }
+    
     // Create processing timer
     processingTimer = new cMessage("processQueue");
     
@@ -92,47 +107,51 @@ void PacketBuffer::initialize()
 void PacketBuffer::handleMessage(cMessage *msg)
 {
     if (msg == processingTimer) {
-        // Process queued packets
-        if (!processing) {
-            cPacket *packet = dequeuePacket();
-            if (packet != nullptr) {
-                processing = true;
-                
-                // Calculate packet delay
-                simtime_t delay = simTime() - packet->getCreationTime();
-                emit(packetDelaySignal, delay);
-                
-                // Send packet out with processing delay
-                sendDelayed(packet, processingDelay, "out", 0);
-                
-                // Schedule next processing cycle
-                scheduleAt(simTime() + processingDelay, processingTimer);
-                
-                emit(throughputSignal, packet->getBitLength());
-            } else {
-                processing = false;
-            }
+        // Process queued packets; stop while the egress SerDes is paused,
+        // setBackpressure() restarts the cycle
+        cPacket *packet = backpressure ? nullptr : dequeuePacket();
+        if (packet == nullptr) {
+            processing = false;
+            return;
         }
+        
+        // Calculate packet delay
+        simtime_t delay = simTime() - packet->getCreationTime();
+        emit(packetDelaySignal, delay);
+        
+        // Send packet out with processing delay
+        sendDelayed(packet, processingDelay, "out", 0);
+        
+        // Schedule next processing cycle
+        scheduleAt(simTime() + processingDelay, processingTimer);
+        
+        emit(throughputSignal, packet->getBitLength());
         return;
     }
     
     // Incoming packet
     cPacket *packet = check_and_cast<cPacket*>(msg);
     
-    // Classify packet and determine queue
-    int queueIndex = classifyPacket(packet);
+    // Packet trains pass an idle buffer intact; under contention their
+    // segments are admitted (and dropped) one MTU frame at a time
+    bool admitted = false;
+    if (PacketTrain::isTrain(packet) && isContended(packet)) {
+        std::vector<AIPacket*> segments = PacketTrain::split(check_and_cast<AIPacket*>(packet));
+        trainsSplit++;
+        for (AIPacket *segment : segments) {
+            admitted |= admitPacket(segment);
+        }
+    } else {
+        admitted = admitPacket(packet);
+    }
     
-    // Try to enqueue
-    if (!enqueuePacket(packet, queueIndex)) {
-        // Buffer full, drop packet
-        EV << "Packet dropped due to buffer overflow in queue " << queueIndex << endl;
-        emit(packetDropSignal, 1);
-        delete packet;
+    if (!admitted) {
         return;
     }
     
     // Start processing if not already active
-    if (!processing) {
+    if (!processing && !backpressure) {
+        processing = true;
         scheduleAt(simTime(), processingTimer);
     }
     
@@ -145,6 +164,33 @@ void PacketBuffer::handleMessage(cMessage *msg)
     updateBufferStatistics();
 }
 
+bool PacketBuffer::admitPacket(cPacket *packet)
+{
+    // Classify packet and determine queue
+    int queueIndex = classifyPacket(packet);
+    
+    // Try to enqueue
+    if (!enqueuePacket(packet, queueIndex)) {
+        // Buffer full, drop packet
+        EV << "Packet dropped due to buffer overflow in queue " << queueIndex << endl;
+        emit(packetDropSignal, 1);
+        AIPacket *aiPacket = dynamic_cast<AIPacket*>(packet);
+        if (aiPacket != nullptr && aiPacket->getJobId() >= 0) {
+            jobDrops[aiPacket->getJobId()]++;
+        }
+        delete packet;
+        return false;
+    }
+    return true;
+}
+
+bool PacketBuffer::isContended(cPacket *packet)
+{
+    // A train has to be split if it would share the buffer with other
+    // packets or cannot be admitted as a whole
+    return totalBufferUsed > 0 || !hasSpaceInBuffer(packet);
+}
+
 bool PacketBuffer::enqueuePacket(cPacket *packet, int queueIndex)
 {
     if (!hasSpaceInBuffer(packet)) {
@@ -194,7 +240,18 @@ cPacket* PacketBuffer::dequeuePacket()
     }
     
     cPacket *packet = queues[selectedQueue].front();
-    queues[selectedQueue].pop();
+    
+    // A train longer than the egress SerDes can take leaves as a shorter
+    // train; the rest stays at the head of the queue
+    long acceptable = (egress != nullptr) ? egress->getAcceptableBytes() : LONG_MAX;
+    if (PacketTrain::isTrain(packet) && packet->getByteLength() > acceptable) {
+        AIPacket *train = check_and_cast<AIPacket*>(packet);
+        long segmentBytes = train->getSegmentPayload() + train->getHeaderBytes();
+        packet = PacketTrain::detachTrain(train, std::max(1L, acceptable / segmentBytes));
+        trainsCut++;
+    } else {
+        queues[selectedQueue].pop();
+    }
     
     long packetSize = packet->getByteLength();
     queueSizes[selectedQueue] -= packetSize;
@@ -221,24 +278,29 @@ int PacketBuffer::selectNextQueue()
 
 int PacketBuffer::classifyPacket(cPacket *packet)
 {
-    // Simple classification based on packet properties
+    // Classification based on the typed AI packet fields
     // In a real implementation, this would examine packet headers
     
-    std::string packetName = packet->getName();
-    
-    // AI/ML traffic classification
-    if (packetName.find("AllReduce") != std::string::npos ||
-        packetName.find("AllGather") != std::string::npos ||
-        packetName.find("AI") != std::string::npos) {
-        return 0;  // First AI priority queue
+    AIPacket *aiPacket = dynamic_cast<AIPacket*>(packet);
+    if (aiPacket == nullptr && packet->getEncapsulatedPacket() != nullptr) {
+        // Multicast copy, classify by its shared payload
+        aiPacket = dynamic_cast<AIPacket*>(packet->getEncapsulatedPacket());
     }
     
-    // RoCEv2 traffic
-    if (rocevSupport && packetName.find("RoCE") != std::string::npos) {
-        return numQueues - 1;  // RoCEv2 queue
+    if (aiPacket != nullptr) {
+        // AI/ML collective traffic
+        if (aiPacket->getWorkloadType() != POINT_TO_POINT) {
+            return 0;  // First AI priority queue
+        }
+        
+        // RoCEv2 traffic
+        if (rocevSupport && aiPacket->getRoce()) {
+            return numQueues - 1;  // RoCEv2 queue
+        }
     }
     
     // Control traffic
+    std::string packetName = packet->getName();
     if (packetName.find("Control") != std::string::npos) {
         return numQueues - 2;  // Control queue
     }
@@ -335,6 +397,30 @@ void PacketBuffer::updateBufferStatistics()
     }
 }
 
+void PacketBuffer::setBackpressure(bool paused)
+{
+    Enter_Method("setBackpressure");
+    
+    if (paused == backpressure) {
+        return;
+    }
+    backpressure = paused;
+    
+    if (paused) {
+        stallStart = simTime();
+        stallEvents++;
+        EV << "Egress paused by SerDes backpressure" << endl;
+        return;
+    }
+    
+    stallTime += simTime() - stallStart;
+    EV << "Egress resumed after " << simTime() - stallStart << "s" << endl;
+    if (!processing && totalBufferUsed > 0) {
+        processing = true;
+        scheduleAt(simTime(), processingTimer);
+    }
+}
+
 int PacketBuffer::getQueueLength(int queueIndex) const
 {
     if (queueIndex >= 0 && queueIndex < numQueues) {
@@ -348,12 +434,27 @@ void PacketBuffer::finish()
     // Record final statistics
     recordScalar("Final Buffer Utilization", getBufferUtilization());
     recordScalar("Total Packets Processed", throughputSignal);
+    recordScalar("Packet Trains Split", trainsSplit);
+    recordScalar("Packet Trains Cut for Egress", trainsCut);
+    
+    simtime_t stalled = stallTime;
+    if (backpressure) {
+        stalled += simTime() - stallStart;
+    }
+    recordScalar("Egress Stalls", stallEvents);
+    recordScalar("Egress Stall Time", stalled);
     
     for (int i = 0; i < numQueues; i++) {
         std::stringstream ss;
         ss << "Queue " << i << " Final Length";
         recordScalar(ss.str().c_str(), queues[i].size());
     }
+    
+    for (auto& entry : jobDrops) {
+        std::stringstream ss;
+        ss << "Job " << entry.first << " Packets Dropped";
+        recordScalar(ss.str().c_str(), entry.second);
+    }
 }
 
 } // namespace tomahawk6
\ No newline at end of file
@@ -2,16 +2,20 @@
 #define __TOMAHAWK6_PACKETBUFFER_H_
 
 #include <omnetpp.h>
+#include <map>
 #include <queue>
 #include <vector>
 #include "inet/common/INETDefs.h"
 #include "inet/common/packet/Packet.h"
+#include "AIPacket_m.h"
 
 using namespace omnetpp;
 using namespace inet;
 
 namespace tomahawk6 {
 
+class SerDesCore;
+
 /**
  * Multi-level packet buffer with AI/ML optimizations
  * Supports various scheduling algorithms and adaptive buffering
@@ -54,10 +58,20 @@ class INET_API PacketBuffer : public cSimpleModule
     
     long totalBufferUsed;
     int currentRRIndex;  // For round-robin scheduling
+    long trainsSplit;
+    long trainsCut;             // Trains handed to the SerDes in parts
+    std::map<int, long> jobDrops;   // Drops per tenant job
     
     // Timers and state
     cMessage *processingTimer;
-    bool processing;
+    bool processing;            // Processing timer scheduled
+    
+    // Egress flow control from the SerDes transmit FIFO
+    SerDesCore *egress;
+    bool backpressure;
+    simtime_t stallStart;
+    simtime_t stallTime;
+    long stallEvents;
     
     // Statistics
     simsignal_t queueLengthSignal;
@@ -76,6 +90,8 @@ class INET_API PacketBuffer : public cSimpleModule
     virtual void finish() override;
     
     // Buffer management
+    virtual bool admitPacket(cPacket *packet);
+    virtual bool isContended(cPacket *packet);
     virtual bool enqueuePacket(cPacket *packet, int queueIndex);
     virtual cPacket* dequeuePacket();
     virtual int selectNextQueue();
@@ -100,6 +116,10 @@ class INET_API PacketBuffer : public cSimpleModule
     long getTotalBufferUsed() const { return totalBufferUsed; }
     double getBufferUtilization() const { return (double)totalBufferUsed / bufferSize; }
     int getQueueLength(int queueIndex) const;
+    
+    // Called by the egress SerDes: stop or resume dequeuing
+    void setBackpressure(bool paused);
+    bool isBackpressured() const { return backpressure; }
 };
 
 } // namespace tomahawk6
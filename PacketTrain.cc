@@ -0,0 +1,85 @@
+#include "PacketTrain.h"
+#include <algorithm>
+
+namespace tomahawk6 {
+
+void PacketTrain::segmentMessage(AIPacket *message, int mtu, int headerBytes)
+{
+    // Packet length includes one header; every MTU segment carries its own
+    long payload = message->getByteLength() - headerBytes;
+    int segments = std::max(1L, (payload + mtu - 1) / mtu);
+    
+    message->setMessageBytes(payload);
+    message->setSegmentPayload(mtu);
+    message->setHeaderBytes(headerBytes);
+    message->setSegmentCount(segments);
+    message->setSegmentIndex(0);
+    message->setTrainLength(segments);
+    message->setByteLength(getTrainBytes(message));
+}
+
+AIPacket* PacketTrain::detachTrain(AIPacket *message, int segments)
+{
+    // Head of the message leaves as its own train, the remainder stays behind
+    segments = std::min(segments, message->getTrainLength());
+    
+    AIPacket *train = message->dup();
+    train->setTrainLength(segments);
+    train->setByteLength(getTrainBytes(train));
+    
+    message->setSegmentIndex(message->getSegmentIndex() + segments);
+    message->setTrainLength(message->getTrainLength() - segments);
+    message->setByteLength(getTrainBytes(message));
+    
+    return train;
+}
+
+std::vector<AIPacket*> PacketTrain::split(AIPacket *train)
+{
+    std::vector<AIPacket*> segments;
+    segments.reserve(train->getTrainLength());
+    
+    while (train->getTrainLength() > 1) {
+        segments.push_back(detachTrain(train, 1));
+    }
+    segments.push_back(train);
+    
+    return segments;
+}
+
+bool PacketTrain::isTrain(cPacket *packet)
+{
+    AIPacket *aiPacket = dynamic_cast<AIPacket*>(packet);
+    return aiPacket != nullptr && aiPacket->getTrainLength() > 1;
+}
+
+long PacketTrain::getTrainBytes(const AIPacket *packet)
+{
+    // Only the last segment of a message can be shorter than the MTU
+    long firstOffset = (long)packet->getSegmentIndex() * packet->getSegmentPayload();
+    long endOffset = (long)(packet->getSegmentIndex() + packet->getTrainLength()) * packet->getSegmentPayload();
+    long payload = std::min(endOffset, packet->getMessageBytes()) - firstOffset;
+    
+    return payload + (long)packet->getTrainLength() * packet->getHeaderBytes();
+}
+
+long PacketTrain::getTrainPayload(const AIPacket *packet)
+{
+    return getTrainBytes(packet) - (long)packet->getTrainLength() * packet->getHeaderBytes();
+}
+
+long PacketTrain::getMessageWireBytes(const AIPacket *packet)
+{
+    if (packet->getSegmentCount() <= 1) {
+        return packet->getByteLength();
+    }
+    return packet->getMessageBytes() + (long)packet->getSegmentCount() * packet->getHeaderBytes();
+}
+
+int PacketTrain::getSegmentsCarried(cPacket *packet)
+{
+    AIPacket *aiPacket = dynamic_cast<AIPacket*>(packet);
+    return aiPacket != nullptr ? aiPacket->getTrainLength() : 1;
+}
+
+} // namespace tomahawk6
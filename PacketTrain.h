@@ -0,0 +1,37 @@
+#ifndef __TOMAHAWK6_PACKETTRAIN_H_
+#define __TOMAHAWK6_PACKETTRAIN_H_
+
+#include <omnetpp.h>
+#include <vector>
+#include "inet/common/INETDefs.h"
+#include "AIPacket_m.h"
+
+using namespace omnetpp;
+using namespace inet;
+
+namespace tomahawk6 {
+
+/**
+ * MTU segmentation and packet-train handling for large AI messages
+ * A message is cut into MTU segments; consecutive segments can travel as a
+ * single packet train and are split only where contention requires it
+ */
+class INET_API PacketTrain
+{
+  public:
+    // Segmentation
+    static void segmentMessage(AIPacket *message, int mtu, int headerBytes);
+    static AIPacket* detachTrain(AIPacket *message, int segments);
+    static std::vector<AIPacket*> split(AIPacket *train);
+    
+    // Size helpers
+    static bool isTrain(cPacket *packet);
+    static long getTrainBytes(const AIPacket *packet);
+    static long getTrainPayload(const AIPacket *packet);
+    static long getMessageWireBytes(const AIPacket *packet);
+    static int getSegmentsCarried(cPacket *packet);
+};
+
+} // namespace tomahawk6
+
+#endif
@@ -0,0 +1,183 @@
+#include "PortManager.h"
+#include "SerDesCore.h"
+#include <algorithm>
+#include <cmath>
+
+namespace tomahawk6 {
+
+Define_Module(PortManager);
+
+PortManager::PortManager()
+{
+    lanesPerCore = 8;
+    numLanes = 0;
+    laneLineRate = 0;
+    laneMacRate = 0;
+    pam4 = true;
+    configured = false;
+}
+
+void PortManager::initialize()
+{
+    // SerDes modules may have asked for their ports already
+    getNumPorts();
+    
+    EV << "PortManager initialized: " << portConfiguration << " on " << numLanes
+       << " lanes of " << laneLineRate / 1e9 << " Gbps (" << serdesConfiguration << ")" << endl;
+}
+
+void PortManager::parseSerDesConfiguration(const std::string& config)
+{
+    // Format: "<cores>x<rate>_<modulation>", e.g. "64x212_5G_PAM4"
+    size_t x = config.find('x');
+    size_t modulationStart = config.rfind('_');
+    if (x == std::string::npos || modulationStart == std::string::npos || modulationStart < x) {
+        throw cRuntimeError("Invalid SerDes configuration '%s'", config.c_str());
+    }
+    
+    std::string modulation = config.substr(modulationStart + 1);
+    if (modulation == "PAM4") pam4 = true;
+    else if (modulation == "NRZ") pam4 = false;
+    else throw cRuntimeError("Unknown SerDes modulation '%s'", modulation.c_str());
+    
+    std::string rate = config.substr(x + 1, modulationStart - x - 1);
+    std::replace(rate.begin(), rate.end(), '_', '.');
+    int cores = std::stoi(config.substr(0, x));
+    numLanes = cores * lanesPerCore;
+    laneLineRate = parseRate(rate);
+    
+    // PAM4 lanes use 256b/257b and RS(544,514), NRZ lanes 64b/66b
+    laneMacRate = pam4 ? laneLineRate * 256 / 257 * 514 / 544 : laneLineRate * 64 / 66;
+}
+
+double PortManager::parseRate(const std::string& rate)
+{
+    // "400G", "1.6T", "106.25G"
+    size_t unitPos = 0;
+    double value = std::stod(rate, &unitPos);
+    std::string unit = rate.substr(unitPos);
+    if (unit == "G") return value * 1e9;
+    else if (unit == "T") return value * 1e12;
+    else if (unit == "M") return value * 1e6;
+    else throw cRuntimeError("Invalid rate '%s'", rate.c_str());
+}
+
+void PortManager::configure(const std::string& portConfiguration)
+{
+    Enter_Method("configure");
+    
+    if (numLanes == 0) {
+        lanesPerCore = par("lanesPerCore");
+        serdesConfiguration = par("serdesConfiguration").stdstringValue();
+        parseSerDesConfiguration(serdesConfiguration);
+    }
+    
+    std::vector<LogicalPort> newPorts;
+    int nextLane = 0;
+    
+    cStringTokenizer tokenizer(portConfiguration.c_str(), ",");
+    while (tokenizer.hasMoreTokens()) {
+        std::string group = tokenizer.nextToken();
+        size_t x = group.find('x');
+        if (x == std::string::npos) {
+            throw cRuntimeError("Invalid port group '%s' in '%s'", group.c_str(), portConfiguration.c_str());
+        }
+        int count = std::stoi(group.substr(0, x));
+        double speed = parseRate(group.substr(x + 1));
+        
+        // Lanes to gang; a slower port runs one lane at reduced rate
+        int lanes = std::max(1, (int)std::ceil(speed / laneMacRate - 1e-9));
+        if (lanes < lanesPerCore ? lanesPerCore % lanes != 0 : lanes % lanesPerCore != 0) {
+            throw cRuntimeError("%s ports need %d lanes, which does not divide %d-lane SerDes cores",
+                                group.c_str(), lanes, lanesPerCore);
+        }
+        
+        LogicalPort port;
+        port.lanes = lanes;
+        port.speed = speed;
+        port.laneLineRate = laneLineRate * std::min(1.0, speed / (lanes * laneMacRate));
+        
+        // Align to the port width, so ganged lanes never straddle a core
+        nextLane = (nextLane + lanes - 1) / lanes * lanes;
+        for (int i = 0; i < count; i++) {
+            port.firstLane = nextLane;
+            nextLane += lanes;
+            newPorts.push_back(port);
+        }
+    }
+    
+    if (newPorts.empty()) {
+        throw cRuntimeError("Port configuration '%s' defines no ports", portConfiguration.c_str());
+    }
+    if (nextLane > numLanes) {
+        throw cRuntimeError("Port configuration '%s' needs %d SerDes lanes, '%s' has %d",
+                            portConfiguration.c_str(), nextLane, serdesConfiguration.c_str(), numLanes);
+    }
+    
+    this->portConfiguration = portConfiguration;
+    ports = newPorts;
+    configured = true;
+    
+    EV << "Breakout mode " << portConfiguration << ": " << ports.size() << " ports on "
+       << nextLane << " of " << numLanes << " lanes" << endl;
+}
+
+int PortManager::getNumPorts()
+{
+    if (!configured) {
+        configure(par("portConfiguration").stdstringValue());
+    }
+    return ports.size();
+}
+
+const PortManager::LogicalPort& PortManager::getPort(int port)
+{
+    if (port < 0 || port >= getNumPorts()) {
+        throw cRuntimeError("Breakout mode %s has no port %d", portConfiguration.c_str(), port);
+    }
+    return ports[port];
+}
+
+void PortManager::finish()
+{
+    int usedLanes = 0;
+    double capacity = 0;
+    for (const LogicalPort& port : ports) {
+        usedLanes += port.lanes;
+        capacity += port.speed;
+    }
+    
+    recordScalar("Logical Ports", ports.size());
+    recordScalar("SerDes Lanes", numLanes);
+    recordScalar("Lanes Used", usedLanes);
+    recordScalar("Switch Capacity (bps)", capacity);
+    
+    // Energy of all SerDes of the switch, receive and transmit side;
+    // energy per bit counts the bits transmitted
+    cModule *parent = getParentModule();
+    if (!parent->hasSubmoduleVector("serdes")) {
+        return;
+    }
+    double energy = 0;
+    double goodBits = 0;
+    for (const char *vectorName : {"ingressSerdes", "serdes"}) {
+        if (!parent->hasSubmoduleVector(vectorName)) {
+            continue;
+        }
+        for (int i = 0; i < parent->getSubmoduleVectorSize(vectorName); i++) {
+            SerDesCore *serdes = dynamic_cast<SerDesCore*>(parent->getSubmodule(vectorName, i));
+            if (serdes != nullptr) {
+                energy += serdes->getEnergy();
+                if (!serdes->isIngress()) {
+                    goodBits += serdes->getGoodBytesSent() * 8.0;
+                }
+            }
+        }
+    }
+    double elapsed = simTime().dbl();
+    recordScalar("Switch SerDes Energy (J)", energy);
+    recordScalar("Switch SerDes Power (W)", elapsed > 0 ? energy / elapsed : 0);
+    recordScalar("Switch Energy per Bit (pJ)", goodBits > 0 ? energy / goodBits * 1e12 : 0);
+}
+
+} // namespace tomahawk6
@@ -0,0 +1,76 @@
+#ifndef __TOMAHAWK6_PORTMANAGER_H_
+#define __TOMAHAWK6_PORTMANAGER_H_
+
+#include <omnetpp.h>
+#include <string>
+#include <vector>
+#include "inet/common/INETDefs.h"
+
+using namespace omnetpp;
+using namespace inet;
+
+namespace tomahawk6 {
+
+/**
+ * Port breakout and lane ganging for a Tomahawk 6 switch
+ *
+ * serdesConfiguration = "<cores>x<rate>_<modulation>" (e.g.
+ * "128x106_25G_PAM4") describes the SerDes cores with lanesPerCore lanes
+ * each; underscores in the rate stand for the decimal point.
+ * portConfiguration = "<ports>x<speed>[,<ports>x<speed>...]" (e.g.
+ * "512x200G" or "128x400G,256x200G") describes the logical ports.
+ *
+ * Each logical port gangs as many consecutive lanes as its speed needs
+ * (an 800G port takes 8 lanes of 106.25G or 4 lanes of 212.5G) and stripes
+ * frames over them in PCS blocks. A port slower than one lane runs a single
+ * lane at reduced rate. Ganged lanes stay inside one core, or span whole
+ * cores. configure() can be called again to switch the breakout mode.
+ */
+class INET_API PortManager : public cSimpleModule
+{
+  public:
+    struct LogicalPort {
+        int firstLane;
+        int lanes;
+        double speed;           // MAC data rate of the port
+        double laneLineRate;    // Signalling rate of each of its lanes
+    };
+    
+  private:
+    // SerDes
+    std::string serdesConfiguration;
+    int lanesPerCore;
+    int numLanes;
+    double laneLineRate;
+    double laneMacRate;
+    bool pam4;
+    
+    // Logical ports of the current breakout mode
+    std::string portConfiguration;
+    std::vector<LogicalPort> ports;
+    bool configured;
+    
+  protected:
+    virtual void initialize() override;
+    virtual void finish() override;
+    
+    virtual void parseSerDesConfiguration(const std::string& config);
+    static double parseRate(const std::string& rate);
+    
+  public:
+    PortManager();
+    
+    // Applies a breakout mode; throws if the lanes do not suffice
+    void configure(const std::string& portConfiguration);
+    
+    int getNumPorts();
+    const LogicalPort& getPort(int port);
+    int getNumLanes() const { return numLanes; }
+    double getLaneLineRate() const { return laneLineRate; }
+    int getBlockBytes() const { return pam4 ? 32 : 8; }     // 256b/257b or 64b/66b blocks
+    const std::string& getPortConfiguration() const { return portConfiguration; }
+};
+
+} // namespace tomahawk6
+
+#endif
@@ -0,0 +1,176 @@
+#include "RankPlacement.h"
+#include <algorithm>
+#include <map>
+
+namespace tomahawk6 {
+
+RankPlacement::RankPlacement()
+{
+    policy = PACKED;
+    gpusPerNode = 1;
+    endpointsPerSwitch = 0;
+    railOptimized = false;
+}
+
+void RankPlacement::init(int gpusPerNode, int endpointsPerSwitch, bool railOptimized)
+{
+    if (gpusPerNode < 1 || endpointsPerSwitch < 0) {
+        throw cRuntimeError("Invalid placement topology: %d GPUs per node, %d endpoints per switch",
+                            gpusPerNode, endpointsPerSwitch);
+    }
+    this->gpusPerNode = gpusPerNode;
+    this->endpointsPerSwitch = endpointsPerSwitch;
+    this->railOptimized = railOptimized;
+}
+
+void RankPlacement::setPolicy(const std::string& name)
+{
+    if (name == "Packed") policy = PACKED;
+    else if (name == "Spread") policy = SPREAD;
+    else if (name == "RailAligned") policy = RAIL_ALIGNED;
+    else throw cRuntimeError("Unknown placement policy '%s'", name.c_str());
+}
+
+bool RankPlacement::isPolicy(const std::string& name)
+{
+    return name == "Packed" || name == "Spread" || name == "RailAligned";
+}
+
+int RankPlacement::getSwitch(int endpoint) const
+{
+    if (endpointsPerSwitch == 0) {
+        return 0;
+    }
+    if (!railOptimized) {
+        return endpoint / endpointsPerSwitch;
+    }
+    
+    // One switch per rail and group of endpointsPerSwitch nodes
+    int group = getNode(endpoint) / endpointsPerSwitch;
+    return group * gpusPerNode + getRail(endpoint);
+}
+
+std::vector<int> RankPlacement::place(const std::vector<int>& freeEndpoints, int count) const
+{
+    if (count <= 0 || (int)freeEndpoints.size() < count) {
+        return std::vector<int>();
+    }
+    
+    switch (policy) {
+        case SPREAD:
+            return placeSpread(freeEndpoints, count);
+        case RAIL_ALIGNED:
+            return placeRailAligned(freeEndpoints, count);
+        default:
+            return placePacked(freeEndpoints, count);
+    }
+}
+
+std::vector<int> RankPlacement::placePacked(const std::vector<int>& freeEndpoints, int count) const
+{
+    std::map<int, std::vector<int>> bySwitch;
+    for (int endpoint : freeEndpoints) {
+        bySwitch[getSwitch(endpoint)].push_back(endpoint);
+    }
+    
+    // A single switch that fits the whole job: take the tightest one to
+    // keep larger free blocks for later jobs
+    const std::vector<int> *bestFit = nullptr;
+    for (auto& entry : bySwitch) {
+        if ((int)entry.second.size() >= count && (bestFit == nullptr || entry.second.size() < bestFit->size())) {
+            bestFit = &entry.second;
+        }
+    }
+    if (bestFit != nullptr) {
+        return std::vector<int>(bestFit->begin(), bestFit->begin() + count);
+    }
+    
+    // Otherwise fill the switches with the most free endpoints first
+    std::vector<const std::vector<int>*> switches;
+    for (auto& entry : bySwitch) {
+        switches.push_back(&entry.second);
+    }
+    std::stable_sort(switches.begin(), switches.end(), [](const std::vector<int> *a, const std::vector<int> *b) {
+        return a->size() > b->size();
+    });
+    
+    std::vector<int> ranks;
+    for (const std::vector<int> *endpoints : switches) {
+        for (int endpoint : *endpoints) {
+            if ((int)ranks.size() == count) {
+                return ranks;
+            }
+            ranks.push_back(endpoint);
+        }
+    }
+    return ranks;
+}
+
+std::vector<int> RankPlacement::placeSpread(const std::vector<int>& freeEndpoints, int count) const
+{
+    std::map<int, std::vector<int>> bySwitch;
+    for (int endpoint : freeEndpoints) {
+        bySwitch[getSwitch(endpoint)].push_back(endpoint);
+    }
+    
+    // Deal ranks over the switches like cards
+    std::vector<int> ranks;
+    for (size_t round = 0; (int)ranks.size() < count; round++) {
+        for (auto& entry : bySwitch) {
+            if (round < entry.second.size() && (int)ranks.size() < count) {
+                ranks.push_back(entry.second[round]);
+            }
+        }
+    }
+    return ranks;
+}
+
+std::vector<int> RankPlacement::placeRailAligned(const std::vector<int>& freeEndpoints, int count) const
+{
+    std::map<int, std::vector<int>> byNode;
+    for (int endpoint : freeEndpoints) {
+        byNode[getNode(endpoint)].push_back(endpoint);
+    }
+    
+    // Whole nodes first, so every rank has a partner on the same rail in
+    // every other node
+    std::vector<const std::vector<int>*> nodes;
+    for (auto& entry : byNode) {
+        nodes.push_back(&entry.second);
+    }
+    std::stable_sort(nodes.begin(), nodes.end(), [](const std::vector<int> *a, const std::vector<int> *b) {
+        return a->size() > b->size();
+    });
+    
+    std::vector<int> ranks;
+    for (const std::vector<int> *endpoints : nodes) {
+        for (int endpoint : *endpoints) {
+            if ((int)ranks.size() < count) {
+                ranks.push_back(endpoint);
+            }
+        }
+    }
+    
+    // Rail-major rank order: consecutive ranks are the same GPU of
+    // consecutive nodes and talk over their rail switch
+    std::stable_sort(ranks.begin(), ranks.end(), [this](int a, int b) {
+        if (getRail(a) != getRail(b)) {
+            return getRail(a) < getRail(b);
+        }
+        return getNode(a) < getNode(b);
+    });
+    return ranks;
+}
+
+int RankPlacement::countCrossSwitchHops(const std::vector<int>& ranks) const
+{
+    int hops = 0;
+    for (size_t i = 0; ranks.size() > 1 && i < ranks.size(); i++) {
+        if (getSwitch(ranks[i]) != getSwitch(ranks[(i + 1) % ranks.size()])) {
+            hops++;
+        }
+    }
+    return hops;
+}
+
+} // namespace tomahawk6
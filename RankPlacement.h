@@ -0,0 +1,70 @@
+#ifndef __TOMAHAWK6_RANKPLACEMENT_H_
+#define __TOMAHAWK6_RANKPLACEMENT_H_
+
+#include <omnetpp.h>
+#include <string>
+#include <vector>
+#include "inet/common/INETDefs.h"
+
+using namespace omnetpp;
+using namespace inet;
+
+namespace tomahawk6 {
+
+/**
+ * Topology-aware mapping of collective ranks to GPU endpoints
+ *
+ * Endpoint e sits in node e / gpusPerNode on rail e % gpusPerNode. With
+ * top-of-rack switches, each leaf switch connects endpointsPerSwitch
+ * consecutive endpoints. In a rail-optimized fabric, the nodes are grouped
+ * so that every group fills endpointsPerSwitch ports per rail, and the
+ * GPUs of one rail in a group share a switch. endpointsPerSwitch = 0 puts
+ * all endpoints on one switch.
+ *
+ * The returned endpoint order is the rank order, so ring neighbours and
+ * binary-tree subtrees follow the placement:
+ *   Packed       fewest switches: best-fit switch, else fullest switches first
+ *   Spread       ranks dealt round-robin over the switches
+ *   RailAligned  whole nodes first, ranks ordered rail by rail
+ */
+class INET_API RankPlacement
+{
+  public:
+    enum Policy {
+        PACKED,
+        SPREAD,
+        RAIL_ALIGNED
+    };
+    
+  private:
+    Policy policy;
+    int gpusPerNode;
+    int endpointsPerSwitch;
+    bool railOptimized;
+    
+    std::vector<int> placePacked(const std::vector<int>& freeEndpoints, int count) const;
+    std::vector<int> placeSpread(const std::vector<int>& freeEndpoints, int count) const;
+    std::vector<int> placeRailAligned(const std::vector<int>& freeEndpoints, int count) const;
+    
+  public:
+    RankPlacement();
+    
+    void init(int gpusPerNode, int endpointsPerSwitch, bool railOptimized);
+    void setPolicy(const std::string& name);
+    static bool isPolicy(const std::string& name);
+    
+    int getNode(int endpoint) const { return endpoint / gpusPerNode; }
+    int getRail(int endpoint) const { return endpoint % gpusPerNode; }
+    int getSwitch(int endpoint) const;
+    
+    // Chooses count of the free endpoints and returns them in rank order;
+    // empty if they do not fit
+    std::vector<int> place(const std::vector<int>& freeEndpoints, int count) const;
+    
+    // Ring neighbours (rank i and i + 1) attached to different switches
+    int countCrossSwitchHops(const std::vector<int>& ranks) const;
+};
+
+} // namespace tomahawk6
+
+#endif
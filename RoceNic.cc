@@ -0,0 +1,431 @@
+#include "RoceNic.h"
+#include "PacketTrain.h"
+#include <algorithm>
+
+namespace tomahawk6 {
+
+Define_Module(RoceNic);
+
+RoceNic::RoceNic()
+{
+    txTimer = nullptr;
+    nextQueuePairNumber = 1;
+    lastServedPeer = -1;
+    dataPacketsSent = 0;
+    dataBytesSent = 0;
+    retransmittedPackets = 0;
+    retransmittedBytes = 0;
+    timeouts = 0;
+    naksReceived = 0;
+    acksSent = 0;
+    naksSent = 0;
+    goodputBytes = 0;
+    packetsDelivered = 0;
+    duplicatePackets = 0;
+    outOfOrderPackets = 0;
+    corruptedPackets = 0;
+    unreliablePackets = 0;
+}
+
+RoceNic::~RoceNic()
+{
+    cancelAndDelete(txTimer);
+    for (auto& entry : sendQueuePairs) {
+        SendQueuePair& queuePair = entry.second;
+        cancelAndDelete(queuePair.retransmitTimer);
+        for (AIPacket *packet : queuePair.pending) {
+            delete packet;
+        }
+        for (auto& inflight : queuePair.inflight) {
+            delete inflight.second;
+        }
+    }
+    for (auto& entry : recvQueuePairs) {
+        cancelAndDelete(entry.second.ackTimer);
+        for (auto& buffered : entry.second.outOfOrder) {
+            delete buffered.second;
+        }
+    }
+    for (cPacket *packet : controlQueue) {
+        delete packet;
+    }
+}
+
+void RoceNic::initialize()
+{
+    // Read parameters
+    address = par("address");
+    nicDataRate = par("nicDataRate");
+    maxOutstanding = std::max(1, (int)par("maxOutstanding"));
+    ackCoalescing = std::max(1, (int)par("ackCoalescing"));
+    ackTimeout = par("ackTimeout");
+    retransmitTimeout = par("retransmitTimeout");
+    
+    std::string modeStr = par("retransmission").stdstringValue();
+    if (modeStr == "GoBackN") retransmissionMode = GO_BACK_N;
+    else if (modeStr == "SelectiveRepeat") retransmissionMode = SELECTIVE_REPEAT;
+    else throw cRuntimeError("Unknown retransmission mode '%s'", modeStr.c_str());
+    
+    // Initialize statistics
+    retransmissionSignal = registerSignal("retransmittedBytes");
+    goodputSignal = registerSignal("deliveredBytes");
+    
+    txTimer = new cMessage("roceTransmit");
+    
+    EV << "RoceNic initialized: address " << address << ", " << modeStr
+       << ", " << maxOutstanding << " outstanding packets per queue pair" << endl;
+}
+
+void RoceNic::handleMessage(cMessage *msg)
+{
+    if (msg == txTimer) {
+        transmitNext();
+        return;
+    }
+    if (msg->isSelfMessage() && msg->getKind() == RETRANSMIT_TIMER) {
+        handleRetransmitTimeout(static_cast<SendQueuePair*>(msg->getContextPointer()));
+        return;
+    }
+    if (msg->isSelfMessage() && msg->getKind() == ACK_TIMER) {
+        sendAck(*static_cast<RecvQueuePair*>(msg->getContextPointer()), ROCE_ACK);
+        return;
+    }
+    
+    cPacket *packet = check_and_cast<cPacket*>(msg);
+    if (msg->arrivedOn("appIn")) {
+        handleAppPacket(packet);
+        return;
+    }
+    
+    // Corrupted frames fail the ICRC check and are dropped; the sender
+    // recovers them like any other loss
+    if (packet->hasBitError()) {
+        corruptedPackets++;
+        EV << "RoceNic " << address << " dropped corrupted packet " << packet->getName() << endl;
+        delete packet;
+        return;
+    }
+    
+    AIPacket *aiPacket = dynamic_cast<AIPacket*>(packet);
+    int opcode = aiPacket != nullptr ? aiPacket->getRoceOpcode() : ROCE_NONE;
+    if (opcode == ROCE_ACK || opcode == ROCE_NAK) {
+        handleAck(aiPacket);
+    } else if (opcode == ROCE_RC_SEND) {
+        handleData(aiPacket);
+    } else if (gate("appOut")->isConnected()) {
+        send(packet, "appOut");
+    } else {
+        delete packet;
+    }
+}
+
+void RoceNic::handleAppPacket(cPacket *packet)
+{
+    // Only unicast AIPackets use a reliable connection; everything else is
+    // sent as is
+    AIPacket *aiPacket = dynamic_cast<AIPacket*>(packet);
+    if (aiPacket == nullptr || aiPacket->getDestination() < 0 || aiPacket->getDestination() == address
+        || aiPacket->getMulticastGroup() >= 0) {
+        unreliablePackets++;
+        controlQueue.push_back(packet);
+        transmitNext();
+        return;
+    }
+    
+    // Every MTU segment of a train gets its own PSN
+    SendQueuePair& queuePair = getSendQueuePair(aiPacket->getDestination());
+    for (AIPacket *segment : PacketTrain::split(aiPacket)) {
+        segment->setRoce(true);
+        segment->setRoceOpcode(ROCE_RC_SEND);
+        segment->setQueuePair(queuePair.qpn);
+        segment->setPacketSeqNum(queuePair.nextPsn++);
+        segment->setSource(address);
+        queuePair.pending.push_back(segment);
+    }
+    transmitNext();
+}
+
+RoceNic::SendQueuePair& RoceNic::getSendQueuePair(int peer)
+{
+    auto it = sendQueuePairs.find(peer);
+    if (it != sendQueuePairs.end()) {
+        return it->second;
+    }
+    
+    SendQueuePair& queuePair = sendQueuePairs[peer];
+    queuePair.peer = peer;
+    queuePair.qpn = nextQueuePairNumber++;
+    queuePair.nextPsn = 0;
+    queuePair.retransmitTimer = new cMessage("roceRetransmit", RETRANSMIT_TIMER);
+    queuePair.retransmitTimer->setContextPointer(&queuePair);
+    return queuePair;
+}
+
+void RoceNic::handleAck(AIPacket *ack)
+{
+    auto it = sendQueuePairs.find(ack->getSource());
+    if (it == sendQueuePairs.end()) {
+        delete ack;
+        return;
+    }
+    SendQueuePair& queuePair = it->second;
+    
+    // ACK carries the last PSN received in order, NAK the PSN expected next
+    bool nak = ack->getRoceOpcode() == ROCE_NAK;
+    long expectedPsn = nak ? ack->getPacketSeqNum() : ack->getPacketSeqNum() + 1;
+    bool progress = false;
+    while (!queuePair.inflight.empty() && queuePair.inflight.begin()->first < expectedPsn) {
+        delete queuePair.inflight.begin()->second;
+        queuePair.inflight.erase(queuePair.inflight.begin());
+        progress = true;
+    }
+    
+    if (nak) {
+        naksReceived++;
+        EV << "RoceNic " << address << " received NAK from " << queuePair.peer
+           << ", expected PSN " << expectedPsn << endl;
+        
+        if (retransmissionMode == GO_BACK_N) {
+            // The receiver discarded everything after the gap
+            queuePair.retransmits.clear();
+            for (auto& inflight : queuePair.inflight) {
+                queuePair.retransmits.push_back(inflight.first);
+            }
+        } else if (queuePair.inflight.count(expectedPsn) > 0
+                   && std::find(queuePair.retransmits.begin(), queuePair.retransmits.end(), expectedPsn) == queuePair.retransmits.end()) {
+            queuePair.retransmits.push_back(expectedPsn);
+        }
+    }
+    delete ack;
+    
+    if (progress) {
+        restartRetransmitTimer(queuePair);
+    }
+    transmitNext();
+}
+
+void RoceNic::handleRetransmitTimeout(SendQueuePair *queuePair)
+{
+    if (queuePair->inflight.empty()) {
+        return;
+    }
+    timeouts++;
+    EV << "RoceNic " << address << " retransmission timeout towards " << queuePair->peer
+       << ", " << queuePair->inflight.size() << " packets outstanding" << endl;
+    
+    // Without feedback the tail of the window (or its ACK) was lost
+    long oldestPsn = queuePair->inflight.begin()->first;
+    if (retransmissionMode == GO_BACK_N) {
+        queuePair->retransmits.clear();
+        for (auto& inflight : queuePair->inflight) {
+            queuePair->retransmits.push_back(inflight.first);
+        }
+    } else if (std::find(queuePair->retransmits.begin(), queuePair->retransmits.end(), oldestPsn) == queuePair->retransmits.end()) {
+        queuePair->retransmits.push_back(oldestPsn);
+    }
+    
+    restartRetransmitTimer(*queuePair);
+    transmitNext();
+}
+
+void RoceNic::restartRetransmitTimer(SendQueuePair& queuePair)
+{
+    cancelEvent(queuePair.retransmitTimer);
+    if (!queuePair.inflight.empty()) {
+        scheduleAt(simTime() + retransmitTimeout, queuePair.retransmitTimer);
+    }
+}
+
+void RoceNic::handleData(AIPacket *packet)
+{
+    int peer = packet->getSource();
+    auto it = recvQueuePairs.find(peer);
+    if (it == recvQueuePairs.end()) {
+        RecvQueuePair& created = recvQueuePairs[peer];
+        created.peer = peer;
+        created.expectedPsn = 0;
+        created.unackedPackets = 0;
+        created.nakSent = false;
+        created.ackTimer = new cMessage("roceAck", ACK_TIMER);
+        created.ackTimer->setContextPointer(&created);
+        it = recvQueuePairs.find(peer);
+    }
+    RecvQueuePair& queuePair = it->second;
+    queuePair.qpn = packet->getQueuePair();
+    long psn = packet->getPacketSeqNum();
+    
+    if (psn < queuePair.expectedPsn) {
+        // Retransmission of data already delivered, e.g. after a lost ACK:
+        // acknowledge again right away
+        duplicatePackets++;
+        delete packet;
+        sendAck(queuePair, ROCE_ACK);
+        return;
+    }
+    
+    if (psn > queuePair.expectedPsn) {
+        // Sequence error: one NAK per gap; go-back-N discards the packet,
+        // selective repeat keeps it until the gap is filled
+        outOfOrderPackets++;
+        if (!queuePair.nakSent) {
+            sendAck(queuePair, ROCE_NAK);
+            queuePair.nakSent = true;
+        }
+        if (retransmissionMode == SELECTIVE_REPEAT && queuePair.outOfOrder.count(psn) == 0) {
+            queuePair.outOfOrder[psn] = packet;
+        } else {
+            delete packet;
+        }
+        return;
+    }
+    
+    // In order: deliver it and whatever it releases from the reorder buffer
+    deliver(packet);
+    queuePair.expectedPsn++;
+    queuePair.unackedPackets++;
+    while (!queuePair.outOfOrder.empty() && queuePair.outOfOrder.begin()->first == queuePair.expectedPsn) {
+        deliver(queuePair.outOfOrder.begin()->second);
+        queuePair.outOfOrder.erase(queuePair.outOfOrder.begin());
+        queuePair.expectedPsn++;
+        queuePair.unackedPackets++;
+    }
+    queuePair.nakSent = false;
+    
+    // Coalesce ACKs: one per ackCoalescing packets, or after ackTimeout
+    if (queuePair.unackedPackets >= ackCoalescing) {
+        sendAck(queuePair, ROCE_ACK);
+    } else if (!queuePair.ackTimer->isScheduled()) {
+        scheduleAt(simTime() + ackTimeout, queuePair.ackTimer);
+    }
+}
+
+void RoceNic::deliver(AIPacket *packet)
+{
+    long payload = PacketTrain::getTrainPayload(packet);
+    goodputBytes += payload;
+    packetsDelivered++;
+    emit(goodputSignal, payload);
+    
+    if (gate("appOut")->isConnected()) {
+        send(packet, "appOut");
+    } else {
+        delete packet;
+    }
+}
+
+void RoceNic::sendAck(RecvQueuePair& queuePair, RoceOpcode opcode)
+{
+    cancelEvent(queuePair.ackTimer);
+    queuePair.unackedPackets = 0;
+    
+    AIPacket *ack = new AIPacket(opcode == ROCE_NAK ? "roceNak" : "roceAck");
+    ack->setByteLength(ROCE_HEADER_BYTES + AETH_BYTES);
+    ack->setRoce(true);
+    ack->setRoceOpcode(opcode);
+    ack->setQueuePair(queuePair.qpn);
+    ack->setSource(address);
+    ack->setDestination(queuePair.peer);
+    ack->setPacketSeqNum(opcode == ROCE_NAK ? queuePair.expectedPsn : queuePair.expectedPsn - 1);
+    
+    if (opcode == ROCE_NAK) {
+        naksSent++;
+    } else {
+        acksSent++;
+    }
+    controlQueue.push_back(ack);
+    transmitNext();
+}
+
+void RoceNic::transmitNext()
+{
+    if (txTimer->isScheduled()) {
+        return;     // Still serializing the previous packet
+    }
+    
+    cPacket *packet = nullptr;
+    if (!controlQueue.empty()) {
+        packet = controlQueue.front();
+        controlQueue.pop_front();
+    } else {
+        packet = nextDataPacket();
+    }
+    if (packet == nullptr) {
+        return;
+    }
+    
+    send(packet, "netOut");
+    scheduleAt(simTime() + packet->getBitLength() / nicDataRate, txTimer);
+}
+
+AIPacket* RoceNic::nextDataPacket()
+{
+    // Round-robin over the queue pairs; retransmissions go ahead of new data
+    auto it = sendQueuePairs.upper_bound(lastServedPeer);
+    for (size_t i = 0; i < sendQueuePairs.size(); i++, ++it) {
+        if (it == sendQueuePairs.end()) {
+            it = sendQueuePairs.begin();
+        }
+        SendQueuePair& queuePair = it->second;
+        AIPacket *packet = nullptr;
+        
+        while (packet == nullptr && !queuePair.retransmits.empty()) {
+            long psn = queuePair.retransmits.front();
+            queuePair.retransmits.pop_front();
+            auto inflightIt = queuePair.inflight.find(psn);
+            if (inflightIt != queuePair.inflight.end()) {   // Not acknowledged meanwhile
+                packet = inflightIt->second->dup();
+                retransmittedPackets++;
+                retransmittedBytes += packet->getByteLength();
+                emit(retransmissionSignal, (long)packet->getByteLength());
+            }
+        }
+        
+        if (packet == nullptr && !queuePair.pending.empty() && (int)queuePair.inflight.size() < maxOutstanding) {
+            AIPacket *segment = queuePair.pending.front();
+            queuePair.pending.pop_front();
+            queuePair.inflight[segment->getPacketSeqNum()] = segment;
+            packet = segment->dup();
+            dataPacketsSent++;
+            dataBytesSent += packet->getByteLength();
+        }
+        
+        if (packet != nullptr) {
+            lastServedPeer = it->first;
+            if (!queuePair.retransmitTimer->isScheduled()) {
+                scheduleAt(simTime() + retransmitTimeout, queuePair.retransmitTimer);
+            }
+            return packet;
+        }
+    }
+    return nullptr;
+}
+
+void RoceNic::finish()
+{
+    double elapsed = simTime().dbl();
+    
+    // Sender
+    recordScalar("Data Packets Sent", dataPacketsSent);
+    recordScalar("Data Bytes Sent", dataBytesSent);
+    recordScalar("Retransmitted Packets", retransmittedPackets);
+    recordScalar("Retransmitted Bytes", retransmittedBytes);
+    recordScalar("Retransmission Overhead", dataBytesSent > 0 ? (double)retransmittedBytes / dataBytesSent : 0);
+    recordScalar("Retransmission Timeouts", timeouts);
+    recordScalar("NAKs Received", naksReceived);
+    recordScalar("Unreliable Packets Sent", unreliablePackets);
+    
+    // Receiver
+    recordScalar("Packets Delivered", packetsDelivered);
+    recordScalar("Goodput Bytes", goodputBytes);
+    recordScalar("Goodput (bps)", elapsed > 0 ? goodputBytes * 8 / elapsed : 0);
+    recordScalar("Duplicate Packets", duplicatePackets);
+    recordScalar("Out-of-Order Packets", outOfOrderPackets);
+    recordScalar("Corrupted Packets Dropped", corruptedPackets);
+    recordScalar("ACKs Sent", acksSent);
+    recordScalar("NAKs Sent", naksSent);
+    
+    EV << "RoceNic " << address << " finished: " << dataPacketsSent << " packets sent, "
+       << retransmittedPackets << " retransmitted, " << goodputBytes << " bytes delivered" << endl;
+}
+
+} // namespace tomahawk6
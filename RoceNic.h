@@ -0,0 +1,130 @@
+#ifndef __TOMAHAWK6_ROCENIC_H_
+#define __TOMAHAWK6_ROCENIC_H_
+
+#include <omnetpp.h>
+#include <deque>
+#include <map>
+#include "inet/common/INETDefs.h"
+#include "AIPacket_m.h"
+
+using namespace omnetpp;
+using namespace inet;
+
+namespace tomahawk6 {
+
+/**
+ * RoCEv2 NIC with reliable-connection queue pairs
+ * Unicast AIPackets from the application are segmented and sent on one
+ * queue pair per destination. Every segment gets a PSN, and at most
+ * maxOutstanding segments per queue pair are unacknowledged. The receiver
+ * passes only in-order data to the application and coalesces ACKs. A
+ * sequence error triggers a NAK. Lost data is recovered with go-back-N
+ * (resend everything from the missing PSN) or selective repeat (resend
+ * only the missing PSN; the receiver buffers out-of-order segments).
+ * Corrupted packets are dropped at the receiver.
+ */
+class INET_API RoceNic : public cSimpleModule
+{
+  public:
+    enum RetransmissionMode {
+        GO_BACK_N,
+        SELECTIVE_REPEAT
+    };
+    
+    enum TimerKind {
+        RETRANSMIT_TIMER = 1,
+        ACK_TIMER = 2
+    };
+    
+  private:
+    static const int ROCE_HEADER_BYTES = 42;
+    static const int AETH_BYTES = 4;
+    
+    struct SendQueuePair {
+        int peer;
+        int qpn;
+        long nextPsn;                       // PSN of the next new segment
+        std::deque<AIPacket*> pending;      // Segments not sent yet
+        std::map<long, AIPacket*> inflight; // Unacknowledged, kept for retransmission
+        std::deque<long> retransmits;       // PSNs to send again
+        cMessage *retransmitTimer;
+    };
+    
+    struct RecvQueuePair {
+        int peer;
+        int qpn;
+        long expectedPsn;
+        std::map<long, AIPacket*> outOfOrder;   // Selective repeat only
+        int unackedPackets;
+        bool nakSent;                       // One NAK per sequence error
+        cMessage *ackTimer;
+    };
+    
+    // Configuration parameters
+    int address;
+    double nicDataRate;
+    RetransmissionMode retransmissionMode;
+    int maxOutstanding;
+    int ackCoalescing;
+    simtime_t ackTimeout;
+    simtime_t retransmitTimeout;
+    
+    // Queue pairs by peer address; map nodes are stable, so timers point to them
+    std::map<int, SendQueuePair> sendQueuePairs;
+    std::map<int, RecvQueuePair> recvQueuePairs;
+    int nextQueuePairNumber;
+    int lastServedPeer;
+    
+    // Transmission: ACK/NAK and non-RC packets go ahead of queue pair data
+    std::deque<cPacket*> controlQueue;
+    cMessage *txTimer;
+    
+    // Statistics
+    long dataPacketsSent;
+    long dataBytesSent;
+    long retransmittedPackets;
+    long retransmittedBytes;
+    long timeouts;
+    long naksReceived;
+    long acksSent;
+    long naksSent;
+    long goodputBytes;
+    long packetsDelivered;
+    long duplicatePackets;
+    long outOfOrderPackets;
+    long corruptedPackets;
+    long unreliablePackets;
+    simsignal_t retransmissionSignal;
+    simsignal_t goodputSignal;
+    
+  protected:
+    virtual void initialize() override;
+    virtual void handleMessage(cMessage *msg) override;
+    virtual void finish() override;
+    
+    // Sender
+    virtual void handleAppPacket(cPacket *packet);
+    virtual SendQueuePair& getSendQueuePair(int peer);
+    virtual void handleAck(AIPacket *ack);
+    virtual void handleRetransmitTimeout(SendQueuePair *queuePair);
+    virtual void restartRetransmitTimer(SendQueuePair& queuePair);
+    
+    // Receiver
+    virtual void handleData(AIPacket *packet);
+    virtual void deliver(AIPacket *packet);
+    virtual void sendAck(RecvQueuePair& queuePair, RoceOpcode opcode);
+    
+    // Transmission at the line rate
+    virtual void transmitNext();
+    virtual AIPacket* nextDataPacket();
+    
+  public:
+    RoceNic();
+    virtual ~RoceNic();
+    
+    int getAddress() const { return address; }
+};
+
+} // namespace tomahawk6
+
+#endif
@@ -1,4 +1,11 @@
 #include "SerDesCore.h"
+#include "ClockedSwitchCore.h"
+#include "PacketBuffer.h"
+#include "PacketTrain.h"
+#include "PortManager.h"
+#include <algorithm>
+#include <climits>
+#include <cmath>
 
 namespace tomahawk6 {
 
@@ -7,34 +14,142 @@ Define_Module(SerDesCore);
 SerDesCore::SerDesCore()
 {
     endTransmissionTimer = nullptr;
+    lpiTimer = nullptr;
+    wakeTimer = nullptr;
     busy = false;
+    ingress = false;
+    txFifoBytes = 0;
+    feeder = nullptr;
+    clockedFeeder = nullptr;
+    feederPort = 0;
+    backpressure = false;
+    overflowDrops = 0;
+    fcsErrorDrops = 0;
+    framesSent = 0;
+    uncorrectableFrames = 0;
+    codewordsSent = 0;
+    correctedCodewords = 0;
+    uncorrectableCodewords = 0;
+    bytesSent = 0;
+    goodBytesSent = 0;
+    lineBitsSent = 0;
+    lanes = 1;
+    blockBytes = 32;
+    nextLane = 0;
+    maxFifoBytes = 0;
+    backpressureEvents = 0;
+    powerState = POWER_IDLE;
+    wakeups = 0;
+    wakeDelayedPackets = 0;
 }
 
 SerDesCore::~SerDesCore()
 {
     cancelAndDelete(endTransmissionTimer);
+    cancelAndDelete(lpiTimer);
+    cancelAndDelete(wakeTimer);
+    
+    for (cPacket *packet : txFifo) {
+        delete packet;
+    }
 }
 
 void SerDesCore::initialize()
 {
     // Read parameters
     serdesType = par("serdesType").stdstringValue();
+    ingress = par("ingress");
     dataRate = par("dataRate");
     latency = par("latency");
+    txFifoSize = par("txFifoSize").intValue();
+    xoffThreshold = std::min(par("xoffThreshold").intValue(), txFifoSize);
+    xonThreshold = std::min(par("xonThreshold").intValue(), xoffThreshold);
+    
+    preambleBytes = par("preambleBytes");
+    interFrameGap = par("interFrameGap");
+    fecLatency = par("fecLatency");
+    preFecBer = par("preFecBer");
+    errorBurstLength = std::max(1.0, par("errorBurstLength").doubleValue());
+    utilizationWindow = par("utilizationWindow");
+    
+    lowPowerIdle = par("lowPowerIdle");
+    lpiEntryDelay = par("lpiEntryDelay");
+    wakeLatency = par("wakeLatency");
+    activePowerPerLane = par("activePowerPerLane");
+    idlePowerRatio = par("idlePowerRatio");
+    lpiPowerRatio = par("lpiPowerRatio");
+    
+    std::string encoding = par("encoding").stdstringValue();
+    if (encoding == "256b257b") { codingDataBits = 256; codingLineBits = 257; }
+    else if (encoding == "64b66b") { codingDataBits = 64; codingLineBits = 66; }
+    else if (encoding == "None") { codingDataBits = 1; codingLineBits = 1; }
+    else throw cRuntimeError("Unknown line encoding '%s'", encoding.c_str());
+    
+    std::string fec = par("fec").stdstringValue();
+    if (fec == "RS544") { fecSymbols = 544; fecDataSymbols = 514; }     // KP4, PAM4 lanes
+    else if (fec == "RS528") { fecSymbols = 528; fecDataSymbols = 514; }    // KR4, NRZ lanes
+    else if (fec == "None") { fecSymbols = 0; fecDataSymbols = 0; }
+    else throw cRuntimeError("Unknown FEC '%s'", fec.c_str());
+    fecSymbolBits = 10;
+    
+    // Lanes of the logical port this SerDes carries
+    laneRate = dataRate;
+    PortManager *portManager = dynamic_cast<PortManager*>(getParentModule()->getSubmodule("portManager"));
+    if (portManager != nullptr && isVector()) {
+        const PortManager::LogicalPort& port = portManager->getPort(getIndex());
+        lanes = port.lanes;
+        laneRate = port.laneLineRate;
+        dataRate = lanes * laneRate;
+        blockBytes = portManager->getBlockBytes();
+    }
+    laneBytes.resize(lanes, 0);
     
     // Initialize state
     busy = false;
     transmissionStartTime = 0;
+    backpressureTime = 0;
+    busyTime = 0;
+    lastTransmissionEnd = 0;
+    windowStart = 0;
+    windowBusy = 0;
+    lastWindowUpdate = 0;
+    windowUtilization = 0;
+    idleGaps.setName("Idle Gap");
+    powerState = POWER_IDLE;
+    powerStateSince = 0;
+    for (int state = 0; state < NUM_POWER_STATES; state++) {
+        powerStateTime[state] = 0;
+    }
+    totalWakeDelay = 0;
+    
+    // Backpressure goes to the PacketBuffer or clocked core port feeding
+    // this lane, if any
+    if (!ingress) {
+        cGate *sourceGate = gate("in")->getPathStartGate();
+        feeder = dynamic_cast<PacketBuffer*>(sourceGate->getOwnerModule());
+        clockedFeeder = dynamic_cast<ClockedSwitchCore*>(sourceGate->getOwnerModule());
+        feederPort = sourceGate->getIndex();
+    }
     
     // Initialize statistics
     throughputSignal = registerSignal("throughput");
     utilizationSignal = registerSignal("utilization");
+    fifoLengthSignal = registerSignal("fifoLength");
+    backpressureSignal = registerSignal("backpressure");
+    powerStateSignal = registerSignal("powerState");
+    wakeDelaySignal = registerSignal("wakeDelay");
     
     // Create timer for transmission end
     endTransmissionTimer = new cMessage("endTransmission");
+    lpiTimer = new cMessage("enterLowPowerIdle");
+    wakeTimer = new cMessage("wakeUp");
+    if (lowPowerIdle && !ingress) {
+        scheduleAt(simTime() + lpiEntryDelay, lpiTimer);
+    }
     
     EV << "SerDesCore initialized: " << serdesType 
-       << " at " << dataRate/1e9 << " Gbps" << endl;
+       << " at " << dataRate/1e9 << " Gbps on " << lanes << " lanes, " << getMacDataRate()/1e9 << " Gbps MAC rate, "
+       << encoding << ", FEC " << fec << (ingress ? ", ingress" : "") << endl;
 }
 
 void SerDesCore::handleMessage(cMessage *msg)
@@ -43,74 +158,458 @@ void SerDesCore::handleMessage(cMessage *msg)
         endTransmission();
         return;
     }
+    if (msg == lpiTimer) {
+        setPowerState(POWER_LOW_POWER_IDLE);
+        return;
+    }
+    if (msg == wakeTimer) {
+        finishWake();
+        return;
+    }
     
     cPacket *packet = check_and_cast<cPacket*>(msg);
     
-    if (busy) {
-        // SerDes is busy, this would typically cause backpressure
-        // For now, we'll queue it briefly or drop it
-        EV << "SerDes busy, packet from " << packet->getSenderModule()->getFullName() 
-           << " experiencing backpressure" << endl;
-        
-        // In a real implementation, this would trigger flow control
+    if (ingress) {
+        receiveFrame(packet);
+        return;
+    }
+    
+    if (!busy && powerState == POWER_IDLE) {
+        cancelEvent(lpiTimer);
+        startTransmission(packet);
+        return;
+    }
+    
+    // Lane busy or asleep: wait in the transmit FIFO; a sleeping lane
+    // starts waking up right away
+    if (powerState == POWER_LOW_POWER_IDLE) {
+        wakeups++;
+        setPowerState(POWER_WAKING);
+        scheduleAt(simTime() + wakeLatency, wakeTimer);
+    }
+    
+    // A train longer than the free FIFO space queues segment by segment
+    if (PacketTrain::isTrain(packet) && txFifoBytes + packet->getByteLength() > txFifoSize) {
+        for (AIPacket *segment : PacketTrain::split(check_and_cast<AIPacket*>(packet))) {
+            enqueueTransmission(segment);
+        }
+    } else {
+        enqueueTransmission(packet);
+    }
+    updateBackpressure();
+}
+
+void SerDesCore::enqueueTransmission(cPacket *packet)
+{
+    // Only a feeder that ignores backpressure and getAcceptableBytes() (or
+    // a headroom too small for its in-flight packets) can overflow the FIFO
+    if (txFifoBytes + packet->getByteLength() > txFifoSize) {
+        EV << "SerDes transmit FIFO overflow, dropping packet from "
+           << packet->getSenderModule()->getFullName() << endl;
+        overflowDrops++;
         delete packet;
         return;
     }
     
-    startTransmission(packet);
+    txFifo.push_back(packet);
+    txFifoBytes += packet->getByteLength();
+    maxFifoBytes = std::max(maxFifoBytes, txFifoBytes);
+    emit(fifoLengthSignal, txFifoBytes);
 }
 
 simtime_t SerDesCore::calculateTransmissionTime(cPacket *packet)
 {
-    // Calculate transmission time based on packet size and data rate
+    // Lane occupancy: framing, line code and FEC parity at the signalling
+    // rate; the decoder latency is pipelined (see getLinkLatency)
+    if (lanes == 1) {
+        return calculateLineBits(packet) / dataRate;
+    }
+    
+    // Striped frame: done when the lane with the most PCS blocks is
+    double lineBits = calculateLineBits(packet);
+    long blocks = (long)std::ceil(lineBits / (blockBytes * 8));
+    long laneBlocks = (blocks + lanes - 1) / lanes;
+    return lineBits * laneBlocks / blocks / laneRate;
+}
+
+double SerDesCore::calculateLineBits(cPacket *packet)
+{
     long packetBits = packet->getBitLength();
     if (packetBits == 0) {
         packetBits = packet->getByteLength() * 8;
     }
     
-    simtime_t transmissionTime = packetBits / dataRate;
-    return transmissionTime + latency;
+    double frameBits = packetBits + (preambleBytes + interFrameGap) * 8.0;
+    double codedBits = frameBits * codingLineBits / codingDataBits;
+    if (fecSymbols > 0) {
+        codedBits = codedBits * fecSymbols / fecDataSymbols;
+    }
+    return codedBits;
+}
+
+double SerDesCore::getMacDataRate() const
+{
+    double rate = dataRate * codingDataBits / codingLineBits;
+    if (fecSymbols > 0) {
+        rate = rate * fecDataSymbols / fecSymbols;
+    }
+    return rate;
+}
+
+simtime_t SerDesCore::getLinkLatency() const
+{
+    // PMA/PMD latency plus, with FEC, one codeword to accumulate at the
+    // receiver and the encode/decode pipeline
+    simtime_t linkLatency = latency;
+    if (fecSymbols > 0) {
+        linkLatency += fecSymbols * fecSymbolBits / dataRate + fecLatency;
+    }
+    return linkLatency;
+}
+
+bool SerDesCore::injectBitErrors(double lineBits)
+{
+    if (preFecBer <= 0) {
+        return false;
+    }
+    
+    // Without FEC any error corrupts the frame
+    double burstsPerBit = preFecBer / errorBurstLength;
+    if (fecSymbols == 0) {
+        return poisson(lineBits * burstsPerBit) > 0;
+    }
+    
+    // Errors come in bursts (DFE error propagation, crosstalk); a burst
+    // hits every 10-bit symbol it touches. RS(n,k) corrects up to
+    // (n - k) / 2 symbol errors per codeword.
+    int correctableSymbols = (fecSymbols - fecDataSymbols) / 2;
+    int codewordBits = fecSymbols * fecSymbolBits;
+    long codewords = std::max(1L, (long)std::ceil(lineBits / codewordBits));
+    bool corrupted = false;
+    
+    for (long codeword = 0; codeword < codewords; codeword++) {
+        int bursts = poisson(codewordBits * burstsPerBit);
+        int symbolErrors = 0;
+        for (int burst = 0; burst < bursts; burst++) {
+            long burstBits = errorBurstLength > 1 ? 1 + geometric(1.0 / errorBurstLength) : 1;
+            int offset = intuniform(0, fecSymbolBits - 1);
+            symbolErrors += (offset + burstBits - 1) / fecSymbolBits + 1;
+        }
+        
+        if (symbolErrors > correctableSymbols) {
+            uncorrectableCodewords++;
+            corrupted = true;
+        } else if (symbolErrors > 0) {
+            correctedCodewords++;
+        }
+    }
+    codewordsSent += codewords;
+    return corrupted;
 }
 
 void SerDesCore::startTransmission(cPacket *packet)
 {
+    updateUtilizationWindows();
+    if (framesSent > 0) {
+        idleGaps.collect(simTime() - lastTransmissionEnd);
+    }
+    
     busy = true;
     transmissionStartTime = simTime();
+    setPowerState(POWER_ACTIVE);
     
     simtime_t transmissionTime = calculateTransmissionTime(packet);
     
     // Schedule end of transmission
     scheduleAt(simTime() + transmissionTime, endTransmissionTimer);
     
-    // Send packet with appropriate delay
-    sendDelayed(packet, transmissionTime, "out");
+    // Frames the FEC cannot correct fail the FCS check at the receiver
+    double lineBits = calculateLineBits(packet);
+    framesSent++;
+    bytesSent += packet->getByteLength();
+    stripe(packet->getByteLength());
+    lineBitsSent += lineBits;
+    if (injectBitErrors(lineBits)) {
+        packet->setBitError(true);
+        uncorrectableFrames++;
+    } else {
+        goodBytesSent += packet->getByteLength();
+    }
     
     // Update statistics
     emit(throughputSignal, packet->getBitLength());
     
+    // The lane is free after serialization; the frame reaches the far end
+    // after the link latency
+    sendDelayed(packet, transmissionTime + getLinkLatency(), "out");
+    
     EV << "SerDes " << serdesType << " started transmission of " 
        << packet->getByteLength() << " bytes, duration: " 
        << transmissionTime << "s" << endl;
 }
 
+void SerDesCore::receiveFrame(cPacket *packet)
+{
+    // The frame held the lane for its serialization time, which ended
+    // (one link latency ago) before it arrived here
+    updateUtilizationWindows();
+    simtime_t frameTime = calculateTransmissionTime(packet);
+    busyTime += frameTime;
+    windowBusy += std::min(frameTime, simTime() - windowStart);
+    framesSent++;
+    bytesSent += packet->getByteLength();
+    lineBitsSent += calculateLineBits(packet);
+    emit(throughputSignal, packet->getBitLength());
+    
+    // Frames the transmitter's FEC could not correct fail the FCS check
+    if (packet->hasBitError()) {
+        EV << "SerDes dropping frame with FCS error from "
+           << packet->getSenderModule()->getFullName() << endl;
+        uncorrectableFrames++;
+        fcsErrorDrops++;
+        delete packet;
+        return;
+    }
+    
+    goodBytesSent += packet->getByteLength();
+    send(packet, "out");
+}
+
 void SerDesCore::endTransmission()
 {
+    updateUtilizationWindows();
     busy = false;
+    busyTime += simTime() - transmissionStartTime;
+    lastTransmissionEnd = simTime();
+    
+    EV << "SerDes transmission completed at " << simTime() << endl;
     
-    // Calculate utilization
-    simtime_t utilizationPeriod = simTime() - transmissionStartTime;
-    if (utilizationPeriod > 0) {
-        double utilization = (transmissionStartTime > 0) ? 1.0 : 0.0;
-        emit(utilizationSignal, utilization);
+    startNextTransmission();
+}
+
+void SerDesCore::startNextTransmission()
+{
+    if (txFifo.empty()) {
+        setPowerState(POWER_IDLE);
+        if (lowPowerIdle) {
+            scheduleAt(simTime() + lpiEntryDelay, lpiTimer);
+        }
+        return;
     }
     
-    EV << "SerDes transmission completed at " << simTime() << endl;
+    cPacket *packet = txFifo.front();
+    txFifo.pop_front();
+    txFifoBytes -= packet->getByteLength();
+    emit(fifoLengthSignal, txFifoBytes);
+    startTransmission(packet);
+    updateBackpressure();
+}
+
+void SerDesCore::finishWake()
+{
+    // Latency cost of low-power idle: everything that queued while the
+    // lane was asleep or waking up
+    for (cPacket *packet : txFifo) {
+        simtime_t wakeDelay = simTime() - packet->getArrivalTime();
+        emit(wakeDelaySignal, wakeDelay);
+        totalWakeDelay += wakeDelay;
+        wakeDelayedPackets++;
+    }
+    
+    EV << "SerDes woke up from low-power idle, " << txFifo.size() << " packets waiting" << endl;
+    startNextTransmission();
+}
+
+void SerDesCore::setPowerState(PowerState state)
+{
+    if (state == powerState) {
+        return;
+    }
+    powerStateTime[powerState] += simTime() - powerStateSince;
+    powerState = state;
+    powerStateSince = simTime();
+    emit(powerStateSignal, (long)state);
+}
+
+double SerDesCore::getPower(PowerState state) const
+{
+    double lanePower = activePowerPerLane;
+    if (state == POWER_IDLE) {
+        lanePower *= idlePowerRatio;
+    } else if (state == POWER_LOW_POWER_IDLE) {
+        lanePower *= lpiPowerRatio;
+    }
+    return lanes * lanePower;   // Waking draws active power
+}
+
+double SerDesCore::getEnergy() const
+{
+    double energy = 0;
+    for (int state = 0; state < NUM_POWER_STATES; state++) {
+        simtime_t time = powerStateTime[state];
+        if (state == powerState) {
+            time += simTime() - powerStateSince;
+        }
+        energy += time.dbl() * getPower((PowerState)state);
+    }
+    
+    // A receive lane stays idle in between frames; frames draw active power
+    if (ingress) {
+        energy += busyTime.dbl() * (getPower(POWER_ACTIVE) - getPower(POWER_IDLE));
+    }
+    return energy;
+}
+
+void SerDesCore::stripe(long bytes)
+{
+    // The PCS deals blocks round-robin over the lanes, continuing where
+    // the previous frame stopped
+    long blocks = (bytes + blockBytes - 1) / blockBytes;
+    for (int lane = 0; lane < lanes; lane++) {
+        long laneBlocks = blocks / lanes + ((lane - nextLane + lanes) % lanes < blocks % lanes ? 1 : 0);
+        laneBytes[lane] += laneBlocks * blockBytes;
+    }
+    nextLane = (nextLane + blocks) % lanes;
+}
+
+void SerDesCore::updateUtilizationWindows()
+{
+    // Close every window that ended since the last update; the lane was
+    // busy from lastWindowUpdate on if a transmission is in progress
+    simtime_t now = simTime();
+    while (now >= windowStart + utilizationWindow) {
+        simtime_t windowEnd = windowStart + utilizationWindow;
+        if (busy) {
+            windowBusy += windowEnd - lastWindowUpdate;
+        }
+        windowUtilization = windowBusy / utilizationWindow;
+        emit(utilizationSignal, windowUtilization);
+        windowBusy = 0;
+        windowStart = windowEnd;
+        lastWindowUpdate = windowEnd;
+        
+        // Long idle stretch: one zero sample instead of one per window
+        if (!busy && now >= windowStart + utilizationWindow) {
+            long idleWindows = (long)std::floor((now - windowStart) / utilizationWindow);
+            windowStart += idleWindows * utilizationWindow;
+            lastWindowUpdate = windowStart;
+            windowUtilization = 0;
+            emit(utilizationSignal, 0.0);
+        }
+    }
+    
+    if (busy) {
+        windowBusy += now - lastWindowUpdate;
+    }
+    lastWindowUpdate = now;
+}
+
+simtime_t SerDesCore::getBusyTime() const
+{
+    return busy ? busyTime + (simTime() - transmissionStartTime) : busyTime;
+}
+
+double SerDesCore::getUtilization() const
+{
+    return simTime() > 0 ? getBusyTime() / simTime() : 0;
+}
+
+long SerDesCore::getAcceptableBytes() const
+{
+    if (!busy && powerState == POWER_IDLE) {
+        return LONG_MAX;
+    }
+    return txFifoSize - txFifoBytes;
+}
+
+double SerDesCore::getWindowUtilization()
+{
+    Enter_Method_Silent();
+    updateUtilizationWindows();
+    return windowUtilization;
+}
+
+void SerDesCore::updateBackpressure()
+{
+    // Hysteresis between the XOFF and XON thresholds
+    if (!backpressure && txFifoBytes >= xoffThreshold) {
+        backpressure = true;
+        backpressureStart = simTime();
+        backpressureEvents++;
+    } else if (backpressure && txFifoBytes <= xonThreshold) {
+        backpressure = false;
+        backpressureTime += simTime() - backpressureStart;
+    } else {
+        return;
+    }
+    
+    emit(backpressureSignal, backpressure);
+    if (feeder != nullptr) {
+        feeder->setBackpressure(backpressure);
+    } else if (clockedFeeder != nullptr) {
+        clockedFeeder->setEgressPaused(feederPort, backpressure);
+    }
 }
 
 void SerDesCore::finish()
 {
     // Record final statistics
-    recordScalar("Final Utilization", busy ? 1.0 : 0.0);
+    updateUtilizationWindows();
+    recordScalar("Average Utilization", getUtilization());
+    recordScalar("Busy Time", getBusyTime());
+    recordScalar("Bytes Sent", bytesSent);
+    recordScalar("Bytes On Wire", getBytesOnWire());
+    idleGaps.record();
+    
+    simtime_t stalled = backpressureTime;
+    if (backpressure) {
+        stalled += simTime() - backpressureStart;
+    }
+    recordScalar("Backpressure Events", backpressureEvents);
+    recordScalar("Backpressure Time", stalled);
+    recordScalar("Backpressure Fraction", simTime() > 0 ? stalled / simTime() : 0);
+    recordScalar("Max Transmit FIFO Bytes", maxFifoBytes);
+    recordScalar("Transmit FIFO Overflow Drops", overflowDrops);
+    recordScalar("FCS Error Drops", fcsErrorDrops);
+    
+    // Link physics
+    double elapsed = simTime().dbl();
+    recordScalar("MAC Data Rate (bps)", getMacDataRate());
+    recordScalar("Link Latency", getLinkLatency());
+    recordScalar("Line Efficiency", lineBitsSent > 0 ? bytesSent * 8 / lineBitsSent : 0);
+    recordScalar("Frames Sent", framesSent);
+    recordScalar("Uncorrectable Frames", uncorrectableFrames);
+    recordScalar("Frame Error Rate", framesSent > 0 ? (double)uncorrectableFrames / framesSent : 0);
+    recordScalar("FEC Codewords", codewordsSent);
+    recordScalar("FEC Corrected Codewords", correctedCodewords);
+    recordScalar("FEC Uncorrectable Codewords", uncorrectableCodewords);
+    recordScalar("Effective Goodput (bps)", elapsed > 0 ? goodBytesSent * 8 / elapsed : 0);
+    
+    // Power and energy
+    double energy = getEnergy();
+    recordScalar("Energy (J)", energy);
+    recordScalar("Average Power (W)", elapsed > 0 ? energy / elapsed : 0);
+    recordScalar("Energy per Bit (pJ)", goodBytesSent > 0 ? energy / (goodBytesSent * 8.0) * 1e12 : 0);
+    const char *stateNames[] = {"Active", "Idle", "Low-Power Idle", "Waking"};
+    for (int state = 0; state < NUM_POWER_STATES; state++) {
+        simtime_t time = powerStateTime[state];
+        if (state == powerState) {
+            time += simTime() - powerStateSince;
+        }
+        std::string statName = std::string(stateNames[state]) + " Time Fraction";
+        recordScalar(statName.c_str(), elapsed > 0 ? time.dbl() / elapsed : 0);
+    }
+    recordScalar("LPI Wakeups", wakeups);
+    recordScalar("Wake-Delayed Packets", wakeDelayedPackets);
+    recordScalar("Average Wake Delay", wakeDelayedPackets > 0 ? totalWakeDelay.dbl() / wakeDelayedPackets : 0);
+    
+    // Striping balance of a ganged port
+    recordScalar("Lanes", lanes);
+    if (lanes > 1) {
+        long minLaneBytes = *std::min_element(laneBytes.begin(), laneBytes.end());
+        long maxLaneBytes = *std::max_element(laneBytes.begin(), laneBytes.end());
+        recordScalar("Lane Byte Skew", maxLaneBytes - minLaneBytes);
+    }
 }
 
 } // namespace tomahawk6
\ No newline at end of file
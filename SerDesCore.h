@@ -2,6 +2,8 @@
 #define __TOMAHAWK6_SERDESCORE_H_
 
 #include <omnetpp.h>
+#include <deque>
+#include <vector>
 #include "inet/common/INETDefs.h"
 #include "inet/common/packet/Packet.h"
 
@@ -10,27 +12,148 @@ using namespace inet;
 
 namespace tomahawk6 {
 
+class ClockedSwitchCore;
+class PacketBuffer;
+class PortManager;
+
 /**
  * SerDes Core implementation for Tomahawk 6
  * Supports both 106.25G PAM4 and 212.5G PAM4 configurations
+ *
+ * dataRate is the lane signalling rate. A frame occupies the lane for its
+ * preamble and inter-frame gap as well, inflated by the line code
+ * (64b/66b or 256b/257b) and the RS FEC parity. With 256b/257b and
+ * RS(544,514), 106.25G and 212.5G lanes carry 100G and 200G of MAC data.
+ * The receiver has to accumulate a whole FEC codeword before decoding,
+ * which adds codeword time plus fecLatency to every hop. Pre-FEC bit
+ * errors arrive in bursts. A codeword with more symbol errors than the
+ * code corrects marks its frame as corrupted (bit error).
+ *
+ * Next to a PortManager, serdes[i] is logical port i of the breakout mode:
+ * it gangs the port's lanes (dataRate is then their aggregate rate) and
+ * stripes every frame over them in PCS blocks.
+ *
+ * Packets arriving while the lane is busy wait in a bounded transmit FIFO.
+ * When the FIFO fills past xoffThreshold, the feeding PacketBuffer (or the
+ * port of a ClockedSwitchCore) is told to stop dequeuing. It may resume
+ * once the FIFO drains to xonThreshold.
+ * The space above xoffThreshold absorbs packets already on their way.
+ * A PacketBuffer hands over no more of a packet train than the FIFO can
+ * take; a train that arrives too long anyway queues segment by segment.
+ *
+ * With lowPowerIdle, a lane idle for lpiEntryDelay drops into low-power
+ * idle. The next frame waits wakeLatency while the lane wakes up. Energy
+ * is integrated per power state from the per-lane active power.
+ *
+ * With ingress set, the module is the receive side of a port: frames
+ * arrive already serialized (the transmitter charged lane time and link
+ * latency), so it only accounts lane occupancy and received bytes and
+ * drops frames that fail the FCS check. The transmit counters then count
+ * received frames.
  */
 class INET_API SerDesCore : public cSimpleModule
 {
+  public:
+    enum PowerState {
+        POWER_ACTIVE,           // Transmitting
+        POWER_IDLE,             // Link up, no data
+        POWER_LOW_POWER_IDLE,
+        POWER_WAKING,
+        NUM_POWER_STATES
+    };
+    
   private:
     // Configuration parameters
     std::string serdesType;
+    bool ingress;
     double dataRate;
     simtime_t latency;
+    int lanes;
+    double laneRate;
+    long txFifoSize;
+    long xoffThreshold;
+    long xonThreshold;
+    
+    // Framing, line coding and FEC
+    int preambleBytes;          // Preamble + SFD
+    int interFrameGap;          // Bytes
+    int codingDataBits;         // 256 of 256b/257b
+    int codingLineBits;         // 257 of 256b/257b
+    int fecSymbols;             // n of RS(n,k), 0: no FEC
+    int fecDataSymbols;         // k of RS(n,k)
+    int fecSymbolBits;
+    simtime_t fecLatency;       // Encoder + decoder pipeline
+    double preFecBer;
+    double errorBurstLength;    // Mean bits per error burst
+    simtime_t utilizationWindow;
+    
+    // Power model
+    bool lowPowerIdle;
+    simtime_t lpiEntryDelay;
+    simtime_t wakeLatency;
+    double activePowerPerLane;  // W
+    double idlePowerRatio;      // Relative to active
+    double lpiPowerRatio;
     
     // Statistics
     simsignal_t throughputSignal;
     simsignal_t utilizationSignal;
+    simsignal_t fifoLengthSignal;
+    simsignal_t backpressureSignal;
+    long overflowDrops;
+    long fcsErrorDrops;
+    long framesSent;
+    long uncorrectableFrames;
+    long codewordsSent;
+    long correctedCodewords;
+    long uncorrectableCodewords;
+    long bytesSent;
+    long goodBytesSent;
+    double lineBitsSent;
+    std::vector<long> laneBytes;
+    long maxFifoBytes;
+    long backpressureEvents;
+    simtime_t backpressureTime;
+    
+    // Busy-time accounting
+    simtime_t busyTime;             // Completed transmissions
+    simtime_t lastTransmissionEnd;
+    simtime_t windowStart;
+    simtime_t windowBusy;
+    simtime_t lastWindowUpdate;
+    double windowUtilization;       // Last complete window
+    cHistogram idleGaps;
+    
+    // Power states and energy
+    PowerState powerState;
+    simtime_t powerStateSince;
+    simtime_t powerStateTime[NUM_POWER_STATES];
+    cMessage *lpiTimer;
+    cMessage *wakeTimer;
+    long wakeups;
+    long wakeDelayedPackets;
+    simtime_t totalWakeDelay;
+    simsignal_t powerStateSignal;
+    simsignal_t wakeDelaySignal;
     
     // State tracking
     bool busy;
     simtime_t transmissionStartTime;
     cMessage *endTransmissionTimer;
     
+    // Transmit FIFO and flow control towards the feeding buffer
+    std::deque<cPacket*> txFifo;
+    long txFifoBytes;
+    PacketBuffer *feeder;
+    ClockedSwitchCore *clockedFeeder;
+    int feederPort;
+    bool backpressure;
+    simtime_t backpressureStart;
+    
+    // Lane striping
+    int blockBytes;
+    int nextLane;
+    
   protected:
     virtual void initialize() override;
     virtual void handleMessage(cMessage *msg) override;
@@ -38,8 +161,18 @@ class INET_API SerDesCore : public cSimpleModule
     
     // SerDes specific functions
     virtual simtime_t calculateTransmissionTime(cPacket *packet);
+    virtual double calculateLineBits(cPacket *packet);
+    virtual bool injectBitErrors(double lineBits);
+    virtual void enqueueTransmission(cPacket *packet);
     virtual void startTransmission(cPacket *packet);
+    virtual void receiveFrame(cPacket *packet);
     virtual void endTransmission();
+    virtual void startNextTransmission();
+    virtual void finishWake();
+    virtual void setPowerState(PowerState state);
+    virtual void updateBackpressure();
+    virtual void stripe(long bytes);
+    virtual void updateUtilizationWindows();
     
   public:
     SerDesCore();
@@ -47,8 +180,28 @@ class INET_API SerDesCore : public cSimpleModule
     
     // Public interface for capacity queries
     double getDataRate() const { return dataRate; }
+    double getMacDataRate() const;
+    int getLanes() const { return lanes; }
+    simtime_t getLinkLatency() const;
     std::string getSerDesType() const { return serdesType; }
+    bool isIngress() const { return ingress; }
     bool isBusy() const { return busy; }
+    long getTxFifoBytes() const { return txFifoBytes; }
+    long getAcceptableBytes() const;    // Without overflowing; an idle, awake lane takes any frame
+    
+    // Link load, e.g. for adaptive routing
+    simtime_t getBusyTime() const;
+    double getUtilization() const;          // Since the start of the run
+    double getWindowUtilization();          // Last complete utilizationWindow
+    double getBytesOnWire() const { return lineBitsSent / 8; }  // Incl. framing, coding and FEC
+    long getBytesSent() const { return bytesSent; }
+    
+    // Power and energy
+    PowerState getPowerState() const { return powerState; }
+    double getPower(PowerState state) const;    // W for all lanes of the port
+    double getEnergy() const;                   // J since the start of the run
+    long getGoodBytesSent() const { return goodBytesSent; }
+    bool isBackpressured() const { return backpressure; }
 };
 
 } // namespace tomahawk6
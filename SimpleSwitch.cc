@@ -3,8 +3,10 @@
 //
 
 #include <omnetpp.h>
+#include "AIPacket_m.h"
 
 using namespace omnetpp;
+using tomahawk6::AIPacket;
 
 class SimpleSwitch : public cSimpleModule
 {
@@ -78,8 +80,13 @@ void SimpleSwitch::forwardPacket(cPacket *packet, int inGate)
         return;
     }
     
-    // Simple forwarding: send to next port (avoid sending back to input port)
+    // Addressed packets go to the port of their destination endpoint,
+    // everything else to the next port (avoid sending back to input port)
     int outGate = (inGate + 1) % numPorts;
+    AIPacket *aiPacket = dynamic_cast<AIPacket *>(packet);
+    if (aiPacket != nullptr && aiPacket->getDestination() >= 0 && aiPacket->getDestination() < numPorts) {
+        outGate = aiPacket->getDestination();
+    }
     
     // Add minimal switching delay
     double switchingDelay = packet->getByteLength() * 8.0 / capacity;
@@ -0,0 +1,318 @@
+#include "TopologyConfigurator.h"
+#include "ClockedSwitchCore.h"
+#include "CognitiveRouter.h"
+#include <algorithm>
+#include <deque>
+#include <set>
+#include <vector>
+
+namespace tomahawk6 {
+
+Define_Module(TopologyConfigurator);
+
+TopologyConfigurator::TopologyConfigurator()
+{
+    numPartitions = 0;
+    numRouters = 0;
+    routesInstalled = 0;
+    ecmpPorts = 0;
+    maxEcmpWidth = 0;
+    diameter = 0;
+    cutLinks = 0;
+    partitionImbalance = 0;
+}
+
+void TopologyConfigurator::initialize(int stage)
+{
+    if (stage != 1) {
+        return;
+    }
+    
+    destinationVector = par("destinationVector").stdstringValue();
+    routeFile = par("routeFile").stdstringValue();
+    partitionFile = par("partitionFile").stdstringValue();
+    numPartitions = par("numPartitions");
+    lookahead = 0;
+    
+    // Parallel run: the routers load the routes the sequential run wrote
+    if (getSimulation()->getParsimNumPartitions() > 1) {
+        if (routeFile.empty()) {
+            throw cRuntimeError("Parallel simulation needs the routeFile of a sequential run");
+        }
+        EV << "TopologyConfigurator: parallel run, routers load their routes from " << routeFile << endl;
+        return;
+    }
+    
+    // Links between simple modules; connections through compound module
+    // boundaries (switch ports) are followed
+    cTopology topology("fabric");
+    topology.extractFromNetwork([](cModule *module) { return module->isSimple(); });
+    
+    installRoutes(topology);
+    if (numPartitions > 1) {
+        partition(topology);
+    }
+    
+    EV << "TopologyConfigurator installed " << routesInstalled << " routes in " << numRouters
+       << " routers, diameter " << diameter << " switch hops" << endl;
+}
+
+void TopologyConfigurator::handleMessage(cMessage *)
+{
+    throw cRuntimeError("TopologyConfigurator does not process messages");
+}
+
+void TopologyConfigurator::installRoutes(cTopology& topology)
+{
+    cModule *network = getSimulation()->getSystemModule();
+    if (!network->hasSubmoduleVector(destinationVector.c_str())) {
+        throw cRuntimeError("Network has no destination vector '%s'", destinationVector.c_str());
+    }
+    
+    std::vector<std::pair<cTopology::Node*, CognitiveRouter*>> routers;
+    for (int i = 0; i < topology.getNumNodes(); i++) {
+        cTopology::Node *node = topology.getNode(i);
+        CognitiveRouter *router = dynamic_cast<CognitiveRouter*>(node->getModule());
+        if (router != nullptr) {
+            routers.push_back(std::make_pair(node, router));
+        }
+    }
+    numRouters = routers.size();
+    
+    std::ofstream routes;
+    if (!routeFile.empty()) {
+        routes.open(routeFile.c_str());
+        if (!routes.is_open()) {
+            throw cRuntimeError("Cannot write route file '%s'", routeFile.c_str());
+        }
+        routes << "# <router> <destination> <ports>, written by " << getFullPath() << "\n";
+    }
+    
+    int numDestinations = network->getSubmoduleVectorSize(destinationVector.c_str());
+    for (int destination = 0; destination < numDestinations; destination++) {
+        cModule *endpoint = network->getSubmodule(destinationVector.c_str(), destination);
+        cTopology::Node *target = topology.getNodeFor(endpoint);
+        if (target == nullptr) {
+            throw cRuntimeError("Destination %s is not part of the topology", endpoint->getFullPath().c_str());
+        }
+        topology.calculateUnweightedSingleShortestPathsTo(target);
+        
+        for (auto& entry : routers) {
+            cTopology::Node *node = entry.first;
+            double distance = node->getDistanceToTarget();
+            if (distance == INFINITY) {
+                throw cRuntimeError("No path from %s to destination %d (%s)", entry.second->getFullPath().c_str(),
+                                    destination, endpoint->getFullPath().c_str());
+            }
+            
+            // Every port leading one step closer is an equal-cost next hop
+            std::vector<int> ports;
+            for (int j = 0; j < node->getNumOutLinks(); j++) {
+                cTopology::LinkOut *link = node->getLinkOut(j);
+                if (link->getRemoteNode()->getDistanceToTarget() == distance - 1) {
+                    ports.push_back(link->getLocalGate()->getIndex());
+                }
+            }
+            
+            entry.second->addRoute(destination, ports);
+            routesInstalled++;
+            ecmpPorts += ports.size();
+            maxEcmpWidth = std::max(maxEcmpWidth, (int)ports.size());
+            
+            // Nodes per switch hop: ingress SerDes, ingress buffer, router, egress
+            // buffer, egress SerDes; a clocked core replaces buffers and router
+            int nodesPerHop = dynamic_cast<ClockedSwitchCore*>(entry.second) != nullptr ? 3 : 5;
+            diameter = std::max(diameter, (int)distance / nodesPerHop + 1);
+            
+            if (routes.is_open()) {
+                routes << entry.second->getFullPath() << " " << destination;
+                for (int port : ports) {
+                    routes << " " << port;
+                }
+                routes << "\n";
+            }
+        }
+    }
+}
+
+cModule *TopologyConfigurator::getTopLevelModule(cModule *module) const
+{
+    cModule *network = getSimulation()->getSystemModule();
+    while (module->getParentModule() != network) {
+        module = module->getParentModule();
+    }
+    return module;
+}
+
+simtime_t TopologyConfigurator::getLinkDelay(cTopology::LinkOut *link)
+{
+    // Sum of the channel delays along the connection path
+    simtime_t delay = 0;
+    for (cGate *gate = link->getLocalGate(); gate != link->getRemoteGate(); gate = gate->getNextGate()) {
+        cChannel *channel = gate->getChannel();
+        if (channel != nullptr && channel->hasPar("delay")) {
+            delay += channel->par("delay").doubleValue();
+        }
+    }
+    return delay;
+}
+
+void TopologyConfigurator::partition(cTopology& topology)
+{
+    // Partitioning units are the network's top-level modules, weighted
+    // by their simple modules
+    std::vector<cModule*> units;
+    std::map<cModule*, int> weight;
+    std::map<cModule*, std::vector<cModule*>> neighbours;
+    std::set<cModule*> switches;
+    for (int i = 0; i < topology.getNumNodes(); i++) {
+        cTopology::Node *node = topology.getNode(i);
+        cModule *unit = getTopLevelModule(node->getModule());
+        if (weight[unit]++ == 0) {
+            units.push_back(unit);
+        }
+        if (dynamic_cast<CognitiveRouter*>(node->getModule()) != nullptr) {
+            switches.insert(unit);
+        }
+        for (int j = 0; j < node->getNumOutLinks(); j++) {
+            cModule *remoteUnit = getTopLevelModule(node->getLinkOut(j)->getRemoteNode()->getModule());
+            if (remoteUnit != unit) {
+                neighbours[unit].push_back(remoteUnit);
+                neighbours[remoteUnit].push_back(unit);
+            }
+        }
+    }
+    if (switches.empty()) {
+        throw cRuntimeError("No switches to partition");
+    }
+    
+    // Endpoints go with the switch they are cabled to
+    std::map<cModule*, cModule*> attachedTo;
+    std::map<cModule*, int> switchWeight;
+    long totalWeight = 0;
+    for (cModule *unit : units) {
+        cModule *owner = unit;
+        if (switches.count(unit) == 0) {
+            auto it = std::find_if(neighbours[unit].begin(), neighbours[unit].end(),
+                                   [&](cModule *neighbour) { return switches.count(neighbour) > 0; });
+            owner = it != neighbours[unit].end() ? *it : nullptr;
+        }
+        if (owner != nullptr) {
+            attachedTo[unit] = owner;
+            switchWeight[owner] += weight[unit];
+            totalWeight += weight[unit];
+        }
+    }
+    
+    // Breadth-first over the switch graph keeps neighbouring switches
+    // (a leaf and its spines, torus neighbours) in the same partition
+    std::vector<cModule*> order;
+    std::set<cModule*> visited;
+    for (cModule *root : units) {
+        if (switches.count(root) == 0 || !visited.insert(root).second) {
+            continue;
+        }
+        std::deque<cModule*> queue(1, root);
+        while (!queue.empty()) {
+            cModule *sw = queue.front();
+            queue.pop_front();
+            order.push_back(sw);
+            for (cModule *neighbour : neighbours[sw]) {
+                if (switches.count(neighbour) > 0 && visited.insert(neighbour).second) {
+                    queue.push_back(neighbour);
+                }
+            }
+        }
+    }
+    
+    // Fill the partitions in that order up to an equal share each
+    std::map<cModule*, int> partitionOf;
+    std::vector<long> partitionWeight(numPartitions, 0);
+    long assigned = 0;
+    int current = 0;
+    for (cModule *sw : order) {
+        if (current < numPartitions - 1 && assigned >= totalWeight * (current + 1) / numPartitions) {
+            current++;
+        }
+        partitionOf[sw] = current;
+        partitionWeight[current] += switchWeight[sw];
+        assigned += switchWeight[sw];
+    }
+    for (auto& entry : attachedTo) {
+        partitionOf[entry.first] = partitionOf[entry.second];
+    }
+    
+    long maxWeight = *std::max_element(partitionWeight.begin(), partitionWeight.end());
+    partitionImbalance = totalWeight > 0 ? (double)maxWeight * numPartitions / totalWeight : 0;
+    if ((int)order.size() < numPartitions) {
+        throw cRuntimeError("Cannot split %d switches into %d partitions", (int)order.size(), numPartitions);
+    }
+    
+    // Links between partitions need a delay to serve as lookahead
+    for (int i = 0; i < topology.getNumNodes(); i++) {
+        cTopology::Node *node = topology.getNode(i);
+        int partition = partitionOf[getTopLevelModule(node->getModule())];
+        for (int j = 0; j < node->getNumOutLinks(); j++) {
+            cTopology::LinkOut *link = node->getLinkOut(j);
+            if (partitionOf[getTopLevelModule(link->getRemoteNode()->getModule())] == partition) {
+                continue;
+            }
+            simtime_t delay = getLinkDelay(link);
+            if (delay <= 0) {
+                throw cRuntimeError("Link %s --> %s crosses partitions without propagation delay",
+                                    link->getLocalGate()->getFullPath().c_str(),
+                                    link->getRemoteGate()->getFullPath().c_str());
+            }
+            lookahead = cutLinks == 0 ? delay : std::min(lookahead, delay);
+            cutLinks++;
+        }
+    }
+    
+    writePartitions(partitionOf);
+    
+    EV << "Partitioned " << order.size() << " switches into " << numPartitions << " partitions: "
+       << cutLinks << " cut links, lookahead " << lookahead << ", imbalance " << partitionImbalance << endl;
+}
+
+void TopologyConfigurator::writePartitions(const std::map<cModule*, int>& partitionOf)
+{
+    if (partitionFile.empty()) {
+        return;
+    }
+    std::ofstream file(partitionFile.c_str());
+    if (!file.is_open()) {
+        throw cRuntimeError("Cannot write partition file '%s'", partitionFile.c_str());
+    }
+    
+    cModule *network = getSimulation()->getSystemModule();
+    file << "# " << network->getNedTypeName() << " in " << numPartitions << " partitions, "
+         << cutLinks << " cut links, lookahead " << lookahead << "s; written by " << getFullPath() << "\n";
+    
+    // Modules without links (this one) default to partition 0
+    for (cModule::SubmoduleIterator it(network); !it.end(); it++) {
+        cModule *unit = *it;
+        auto entry = partitionOf.find(unit);
+        int partition = entry != partitionOf.end() ? entry->second : 0;
+        file << "*." << unit->getFullName() << ".partition-id = " << partition << "\n";
+        if (!unit->isSimple()) {
+            file << "*." << unit->getFullName() << ".**.partition-id = " << partition << "\n";
+        }
+    }
+}
+
+void TopologyConfigurator::finish()
+{
+    recordScalar("Routers", numRouters);
+    recordScalar("Routes Installed", routesInstalled);
+    recordScalar("Average ECMP Width", routesInstalled > 0 ? (double)ecmpPorts / routesInstalled : 0);
+    recordScalar("Max ECMP Width", maxEcmpWidth);
+    recordScalar("Diameter (switch hops)", diameter);
+    if (numPartitions > 1 && cutLinks > 0) {
+        recordScalar("Partitions", numPartitions);
+        recordScalar("Partition Cut Links", cutLinks);
+        recordScalar("Lookahead", lookahead);
+        recordScalar("Partition Imbalance", partitionImbalance);
+    }
+}
+
+} // namespace tomahawk6
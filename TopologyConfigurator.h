@@ -0,0 +1,73 @@
+#ifndef __TOMAHAWK6_TOPOLOGYCONFIGURATOR_H_
+#define __TOMAHAWK6_TOPOLOGYCONFIGURATOR_H_
+
+#include <omnetpp.h>
+#include <fstream>
+#include <map>
+#include <string>
+#include "inet/common/INETDefs.h"
+
+using namespace omnetpp;
+using namespace inet;
+
+namespace tomahawk6 {
+
+/**
+ * Routing tables and parallel-simulation partitioning for multi-switch fabrics
+ *
+ * Extracts the network's simple modules with cTopology and, for every
+ * destination endpoint (module i of the destinationVector is address i),
+ * installs in each CognitiveRouter the output ports that lie on a shortest
+ * path to it. Several such ports form an ECMP group, which the router
+ * balances adaptively. Every switch hop crosses the same chain of SerDes
+ * and buffers, so unweighted distances count switch hops. Routes are
+ * installed in initialization stage 1, after the routers have set up
+ * their own tables in stage 0.
+ *
+ * With numPartitions > 1, a sequential run also splits the fabric for
+ * parallel simulation and writes partition-id entries to partitionFile.
+ * A switch stays whole, together with the endpoints attached to it, so
+ * only cables cross partitions and their propagation delay is the
+ * lookahead. Switches are taken in breadth-first order and filled into
+ * the partitions by simple-module count. The routes go to routeFile, from
+ * which the routers of the parallel run load them: there, most routers
+ * live in other processes and cannot be reached from here.
+ */
+class INET_API TopologyConfigurator : public cSimpleModule
+{
+  private:
+    std::string destinationVector;
+    std::string routeFile;
+    std::string partitionFile;
+    int numPartitions;
+    
+    // Statistics
+    int numRouters;
+    long routesInstalled;
+    long ecmpPorts;
+    int maxEcmpWidth;
+    int diameter;               // Switch hops of the longest route
+    long cutLinks;
+    simtime_t lookahead;        // Shortest delay of a link between partitions
+    double partitionImbalance;  // Largest partition relative to the mean
+    
+  protected:
+    virtual int numInitStages() const override { return 2; }
+    virtual void initialize(int stage) override;
+    virtual void handleMessage(cMessage *msg) override;
+    virtual void finish() override;
+    
+    virtual void installRoutes(cTopology& topology);
+    virtual void partition(cTopology& topology);
+    virtual void writePartitions(const std::map<cModule*, int>& partitionOf);
+    
+    cModule *getTopLevelModule(cModule *module) const;
+    static simtime_t getLinkDelay(cTopology::LinkOut *link);
+    
+  public:
+    TopologyConfigurator();
+};
+
+} // namespace tomahawk6
+
+#endif
@@ -0,0 +1,93 @@
+#include "TraceReader.h"
+#include <sstream>
+
+namespace tomahawk6 {
+
+TraceReader::TraceReader()
+{
+    lineNumber = 0;
+    lastId = -1;
+    recordsRead = 0;
+}
+
+void TraceReader::open(const std::string& fileName, size_t bufferSize)
+{
+    this->fileName = fileName;
+    
+    // The buffer must be installed before the file is opened
+    buffer.resize(bufferSize);
+    stream.rdbuf()->pubsetbuf(buffer.data(), buffer.size());
+    stream.open(fileName.c_str());
+    if (!stream.is_open()) {
+        throw cRuntimeError("Cannot open trace file '%s'", fileName.c_str());
+    }
+}
+
+bool TraceReader::next(TraceRecord& record)
+{
+    std::string line;
+    while (std::getline(stream, line)) {
+        lineNumber++;
+        
+        // Skip comments and blank lines
+        size_t start = line.find_first_not_of(" \t\r");
+        if (start == std::string::npos || line[start] == '#') {
+            continue;
+        }
+        
+        parseRecord(line, record);
+        recordsRead++;
+        return true;
+    }
+    return false;
+}
+
+void TraceReader::parseRecord(const std::string& line, TraceRecord& record)
+{
+    std::istringstream fields(line);
+    std::string op, peer, deps;
+    
+    if (!(fields >> record.id >> op >> record.size >> peer >> deps)) {
+        throw cRuntimeError("%s:%ld: expected '<id> <op> <size> <peer> <deps>'", fileName.c_str(), lineNumber);
+    }
+    if (record.id <= lastId) {
+        throw cRuntimeError("%s:%ld: record ids must be increasing", fileName.c_str(), lineNumber);
+    }
+    lastId = record.id;
+    
+    record.collectiveType = POINT_TO_POINT;
+    if (op == "COMPUTE") record.op = TRACE_COMPUTE;
+    else if (op == "SEND") record.op = TRACE_SEND;
+    else if (op == "RECV") record.op = TRACE_RECV;
+    else {
+        record.op = TRACE_COLLECTIVE;
+        if (op == "ALLREDUCE") record.collectiveType = ALL_REDUCE;
+        else if (op == "ALLGATHER") record.collectiveType = ALL_GATHER;
+        else if (op == "REDUCESCATTER") record.collectiveType = REDUCE_SCATTER;
+        else if (op == "BROADCAST") record.collectiveType = BROADCAST;
+        else if (op == "ALLTOALL") record.collectiveType = ALL_TO_ALL;
+        else throw cRuntimeError("%s:%ld: unknown operation '%s'", fileName.c_str(), lineNumber, op.c_str());
+    }
+    
+    record.peer = (peer == "-") ? -1 : std::stoi(peer);
+    record.group.clear();
+    if ((record.op == TRACE_SEND || record.op == TRACE_RECV) && record.peer < 0) {
+        throw cRuntimeError("%s:%ld: %s needs a peer rank", fileName.c_str(), lineNumber, op.c_str());
+    }
+    
+    // Dependencies can only point backwards
+    record.deps.clear();
+    if (deps != "-") {
+        cStringTokenizer tokenizer(deps.c_str(), ",");
+        while (tokenizer.hasMoreTokens()) {
+            long dep = std::stol(tokenizer.nextToken());
+            if (dep >= record.id) {
+                throw cRuntimeError("%s:%ld: dependency %ld does not precede record %ld",
+                                    fileName.c_str(), lineNumber, dep, record.id);
+            }
+            record.deps.push_back(dep);
+        }
+    }
+}
+
+} // namespace tomahawk6
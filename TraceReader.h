@@ -0,0 +1,80 @@
+#ifndef __TOMAHAWK6_TRACEREADER_H_
+#define __TOMAHAWK6_TRACEREADER_H_
+
+#include <omnetpp.h>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "inet/common/INETDefs.h"
+#include "AIPacket_m.h"
+
+using namespace omnetpp;
+using namespace inet;
+
+namespace tomahawk6 {
+
+/**
+ * Streaming reader for per-rank communication traces
+ *
+ * One record per line, '#' starts a comment:
+ *
+ *   <id> <op> <size> <peer> <deps>
+ *
+ *   id    record id, strictly increasing within a file
+ *   op    COMPUTE, SEND, RECV, ALLREDUCE, ALLGATHER, REDUCESCATTER,
+ *         BROADCAST or ALLTOALL
+ *   size  payload bytes; compute duration in nanoseconds for COMPUTE
+ *   peer  communicator rank for SEND/RECV, '-' otherwise
+ *   deps  comma-separated ids of earlier records that must complete
+ *         before this one starts, '-' for none
+ *
+ * Collectives are issued in trace order and must appear in the same order
+ * in the trace of every rank. The file is read line by line through a
+ * large stream buffer, so traces of any size use constant memory.
+ */
+class INET_API TraceReader
+{
+  public:
+    enum TraceOp {
+        TRACE_COMPUTE,
+        TRACE_SEND,
+        TRACE_RECV,
+        TRACE_COLLECTIVE
+    };
+    
+    struct TraceRecord {
+        long id;
+        TraceOp op;
+        AIWorkloadType collectiveType;
+        long size;
+        int peer;
+        std::vector<long> deps;
+        std::vector<int> group;     // Ranks taking part in a collective, empty: all
+    };
+    
+  private:
+    std::string fileName;
+    std::ifstream stream;
+    std::vector<char> buffer;
+    long lineNumber;
+    long lastId;
+    long recordsRead;
+    
+    void parseRecord(const std::string& line, TraceRecord& record);
+    
+  public:
+    TraceReader();
+    
+    void open(const std::string& fileName, size_t bufferSize);
+    bool isOpen() const { return stream.is_open(); }
+    
+    // Reads the next record; returns false at the end of the trace
+    bool next(TraceRecord& record);
+    
+    long getRecordsRead() const { return recordsRead; }
+    const std::string& getFileName() const { return fileName; }
+};
+
+} // namespace tomahawk6
+
+#endif
@@ -0,0 +1,106 @@
+#include "TrafficPacer.h"
+#include "PacketTrain.h"
+#include <algorithm>
+
+namespace tomahawk6 {
+
+TrafficPacer::TrafficPacer()
+{
+    owner = nullptr;
+    timer = nullptr;
+    sequence = 0;
+    maxTrainLength = 1;
+    lineRate = 0;
+    packetsReleased = 0;
+    timerEvents = 0;
+    maxPending = 0;
+}
+
+TrafficPacer::~TrafficPacer()
+{
+    if (owner != nullptr) {
+        owner->cancelAndDelete(timer);
+    }
+    
+    // Clean up packets that never departed
+    while (!pending.empty()) {
+        delete pending.top().packet;
+        pending.pop();
+    }
+}
+
+void TrafficPacer::init(cSimpleModule *owner, const char *gateName)
+{
+    this->owner = owner;
+    this->gateName = gateName;
+    timer = new cMessage("pacerTimer");
+}
+
+void TrafficPacer::setPacketTrains(int maxTrainLength, double lineRate)
+{
+    this->maxTrainLength = std::max(1, maxTrainLength);
+    this->lineRate = lineRate;
+}
+
+void TrafficPacer::enqueue(cPacket *packet, simtime_t delay)
+{
+    push(packet, simTime() + delay);
+}
+
+void TrafficPacer::push(cPacket *packet, simtime_t departureTime)
+{
+    PendingPacket entry;
+    entry.departureTime = departureTime;
+    entry.sequence = sequence++;
+    entry.packet = packet;
+    pending.push(entry);
+    
+    maxPending = std::max(maxPending, pending.size());
+    
+    // Only the earliest departure is ever in the future event set
+    if (!timer->isScheduled() || entry.departureTime < timer->getArrivalTime()) {
+        scheduleNextDeparture();
+    }
+}
+
+bool TrafficPacer::handleTimer(cMessage *msg)
+{
+    if (msg != timer) {
+        return false;
+    }
+    
+    timerEvents++;
+    
+    // Release every packet that is due now
+    while (!pending.empty() && pending.top().departureTime <= simTime()) {
+        cPacket *packet = pending.top().packet;
+        pending.pop();
+        
+        // Long segmented messages leave one train at a time; the remainder
+        // follows back-to-back once the train has been serialized
+        AIPacket *message = dynamic_cast<AIPacket*>(packet);
+        if (message != nullptr && lineRate > 0 && message->getTrainLength() > maxTrainLength) {
+            AIPacket *train = PacketTrain::detachTrain(message, maxTrainLength);
+            push(message, simTime() + train->getBitLength() / lineRate);
+            packet = train;
+        }
+        
+        owner->send(packet, gateName.c_str());
+        packetsReleased++;
+    }
+    
+    if (!pending.empty()) {
+        scheduleNextDeparture();
+    }
+    return true;
+}
+
+void TrafficPacer::scheduleNextDeparture()
+{
+    if (timer->isScheduled()) {
+        owner->cancelEvent(timer);
+    }
+    owner->scheduleAt(pending.top().departureTime, timer);
+}
+
+} // namespace tomahawk6
@@ -0,0 +1,79 @@
+#ifndef __TOMAHAWK6_TRAFFICPACER_H_
+#define __TOMAHAWK6_TRAFFICPACER_H_
+
+#include <omnetpp.h>
+#include <queue>
+#include <vector>
+#include "inet/common/INETDefs.h"
+
+using namespace omnetpp;
+using namespace inet;
+
+namespace tomahawk6 {
+
+/**
+ * Self-clocked packet pacer for traffic generators
+ * Holds packets with a future departure time and emits them from a single
+ * reusable timer, so the future event set only ever holds the next departure.
+ * Segmented messages are released as packet trains of at most maxTrainLength
+ * MTU segments, paced back-to-back at the line rate.
+ */
+class INET_API TrafficPacer
+{
+  private:
+    struct PendingPacket {
+        simtime_t departureTime;
+        long sequence;      // Keeps FIFO order for equal departure times
+        cPacket *packet;
+    };
+    
+    struct LaterDeparture {
+        bool operator()(const PendingPacket& a, const PendingPacket& b) const {
+            if (a.departureTime != b.departureTime) {
+                return a.departureTime > b.departureTime;
+            }
+            return a.sequence > b.sequence;
+        }
+    };
+    
+    cSimpleModule *owner;
+    std::string gateName;
+    cMessage *timer;
+    std::priority_queue<PendingPacket, std::vector<PendingPacket>, LaterDeparture> pending;
+    long sequence;
+    
+    // Packet-train release of segmented messages
+    int maxTrainLength;
+    double lineRate;
+    
+    // Statistics
+    long packetsReleased;
+    long timerEvents;
+    size_t maxPending;
+    
+    void push(cPacket *packet, simtime_t departureTime);
+    void scheduleNextDeparture();
+    
+  public:
+    TrafficPacer();
+    ~TrafficPacer();
+    
+    void init(cSimpleModule *owner, const char *gateName);
+    void setPacketTrains(int maxTrainLength, double lineRate);
+    
+    // Queue a packet to leave on the output gate after the given delay
+    void enqueue(cPacket *packet, simtime_t delay);
+    
+    // Returns true if msg was the pacer timer (and has been handled)
+    bool handleTimer(cMessage *msg);
+    
+    // Statistics
+    size_t getPendingCount() const { return pending.size(); }
+    size_t getMaxPending() const { return maxPending; }
+    long getPacketsReleased() const { return packetsReleased; }
+    long getTimerEvents() const { return timerEvents; }
+};
+
+} // namespace tomahawk6
+
+#endif
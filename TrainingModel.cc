@@ -0,0 +1,164 @@
+#include "TrainingModel.h"
+#include <algorithm>
+
+namespace tomahawk6 {
+
+TrainingModel::TrainingModel()
+{
+    rank = 0;
+    stage = 0;
+    numStages = 1;
+    replicas = 1;
+    microbatches = 1;
+    gradientBuckets = 1;
+    forwardTime = 0;
+    backwardTime = 0;
+    activationBytes = 0;
+    gradientBytes = 0;
+    numIterations = 0;
+    iterationsGenerated = 0;
+    nextId = 0;
+    lastBarrier = -1;
+}
+
+void TrainingModel::init(int rank, int ranks, int stages, int microbatches, int gradientBuckets,
+                         simtime_t computeTime, long activationBytes, long gradientBytes, int iterations)
+{
+    if (stages < 1 || ranks % stages != 0) {
+        throw cRuntimeError("%d ranks cannot be split into %d pipeline stages", ranks, stages);
+    }
+    
+    this->rank = rank;
+    numStages = stages;
+    replicas = ranks / stages;
+    stage = rank / replicas;
+    for (int i = 0; i < replicas; i++) {
+        dataParallelGroup.push_back(stage * replicas + i);
+    }
+    
+    // Backward costs twice the forward pass (gradients w.r.t. inputs and weights)
+    this->microbatches = std::max(1, microbatches);
+    this->gradientBuckets = std::max(1, gradientBuckets);
+    long computeNs = computeTime.inUnit(SIMTIME_NS);
+    forwardTime = computeNs / (3 * this->microbatches);
+    backwardTime = 2 * forwardTime;
+    this->activationBytes = std::max(1L, activationBytes);
+    this->gradientBytes = gradientBytes;
+    numIterations = iterations;
+}
+
+bool TrainingModel::next(TraceRecord& record)
+{
+    if (generated.empty() && iterationsGenerated < numIterations) {
+        generateIteration();
+    }
+    if (generated.empty()) {
+        return false;
+    }
+    
+    record = generated.front();
+    generated.pop_front();
+    return true;
+}
+
+bool TrainingModel::endsIteration(long id)
+{
+    if (barriers.empty() || barriers.front() != id) {
+        return false;
+    }
+    barriers.pop_front();
+    return true;
+}
+
+simtime_t TrainingModel::getComputePerIteration() const
+{
+    return SimTime(microbatches * (forwardTime + backwardTime), SIMTIME_NS);
+}
+
+long TrainingModel::addRecord(TraceReader::TraceOp op, long size, int peer, const std::vector<long>& deps)
+{
+    TraceRecord record;
+    record.id = nextId++;
+    record.op = op;
+    record.collectiveType = POINT_TO_POINT;
+    record.size = size;
+    record.peer = peer;
+    record.deps = deps;
+    generated.push_back(record);
+    return record.id;
+}
+
+void TrainingModel::generateIteration()
+{
+    bool firstStage = (stage == 0);
+    bool lastStage = (stage == numStages - 1);
+    int previousStageRank = rank - replicas;
+    int nextStageRank = rank + replicas;
+    
+    // Everything the closing barrier waits for
+    std::vector<long> iterationDeps;
+    long previous = lastBarrier;
+    
+    // Forward pass: a microbatch runs once its activations have arrived
+    for (int m = 0; m < microbatches; m++) {
+        std::vector<long> deps;
+        if (previous >= 0) {
+            deps.push_back(previous);
+        }
+        if (!firstStage) {
+            deps.push_back(addRecord(TraceReader::TRACE_RECV, activationBytes, previousStageRank, {}));
+        }
+        previous = addRecord(TraceReader::TRACE_COMPUTE, forwardTime, -1, deps);
+        if (!lastStage) {
+            iterationDeps.push_back(addRecord(TraceReader::TRACE_SEND, activationBytes, nextStageRank, {previous}));
+        }
+    }
+    
+    // Backward pass in reverse microbatch order. Gradients accumulate over
+    // the microbatches, so the last backward pass produces the final
+    // gradients, bucket by bucket from the output layers down; each bucket
+    // is reduced while the remaining buckets are still being computed.
+    for (int m = microbatches - 1; m >= 0; m--) {
+        std::vector<long> deps = {previous};
+        if (!lastStage) {
+            deps.push_back(addRecord(TraceReader::TRACE_RECV, activationBytes, nextStageRank, {}));
+        }
+        
+        if (m > 0 || replicas == 1) {
+            previous = addRecord(TraceReader::TRACE_COMPUTE, backwardTime, -1, deps);
+        } else {
+            long bucketBytes = std::max(1L, gradientBytes / gradientBuckets);
+            for (int bucket = 0; bucket < gradientBuckets; bucket++) {
+                long bucketTime = backwardTime / gradientBuckets;
+                if (bucket == gradientBuckets - 1) {
+                    bucketTime = backwardTime - bucket * bucketTime;
+                }
+                previous = addRecord(TraceReader::TRACE_COMPUTE, bucketTime, -1, deps);
+                deps = {previous};
+                
+                long reduce = addRecord(TraceReader::TRACE_COLLECTIVE, bucketBytes, -1, {previous});
+                generated.back().collectiveType = ALL_REDUCE;
+                generated.back().group = dataParallelGroup;
+                iterationDeps.push_back(reduce);
+            }
+        }
+        
+        if (!firstStage) {
+            iterationDeps.push_back(addRecord(TraceReader::TRACE_SEND, activationBytes, previousStageRank, {previous}));
+        }
+    }
+    iterationDeps.push_back(previous);
+    
+    // Iteration barrier: the optimizer step needs all reduced gradients and
+    // every stage has to be done before the next iteration starts
+    if (numStages * replicas > 1) {
+        lastBarrier = addRecord(TraceReader::TRACE_COLLECTIVE, BARRIER_BYTES, -1, iterationDeps);
+        generated.back().collectiveType = ALL_REDUCE;
+    } else {
+        lastBarrier = addRecord(TraceReader::TRACE_COMPUTE, 0, -1, iterationDeps);
+    }
+    barriers.push_back(lastBarrier);
+    iterationsGenerated++;
+}
+
+} // namespace tomahawk6
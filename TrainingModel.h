@@ -0,0 +1,81 @@
+#ifndef __TOMAHAWK6_TRAININGMODEL_H_
+#define __TOMAHAWK6_TRAININGMODEL_H_
+
+#include <omnetpp.h>
+#include <deque>
+#include <vector>
+#include "inet/common/INETDefs.h"
+#include "TraceReader.h"
+
+using namespace omnetpp;
+using namespace inet;
+
+namespace tomahawk6 {
+
+/**
+ * Iteration-level model of data- and pipeline-parallel training
+ *
+ * Generates, for one rank, the same dependency records a trace would hold:
+ * forward compute per microbatch with activations sent to the next pipeline
+ * stage, backward compute in reverse microbatch order with activation
+ * gradients sent to the previous stage, and gradient buckets whose AllReduce
+ * over the stage's data-parallel group starts as soon as backprop has
+ * produced them. Every iteration ends in a barrier over all ranks.
+ *
+ * Ranks are laid out stage by stage: rank r belongs to stage r / replicas,
+ * so a data-parallel group is a contiguous block of ranks.
+ */
+class INET_API TrainingModel
+{
+  public:
+    typedef TraceReader::TraceRecord TraceRecord;
+    
+  private:
+    static const long BARRIER_BYTES = 8;
+    
+    // Layout
+    int rank;
+    int stage;
+    int numStages;
+    int replicas;
+    std::vector<int> dataParallelGroup;     // Ranks of this rank's stage
+    
+    // Iteration shape
+    int microbatches;
+    int gradientBuckets;
+    long forwardTime;       // Per microbatch, in ns
+    long backwardTime;      // Per microbatch, in ns
+    long activationBytes;   // Per microbatch
+    long gradientBytes;     // Gradients of this stage
+    int numIterations;
+    
+    // Generation state
+    int iterationsGenerated;
+    long nextId;
+    long lastBarrier;
+    std::deque<TraceRecord> generated;
+    std::deque<long> barriers;
+    
+    void generateIteration();
+    long addRecord(TraceReader::TraceOp op, long size, int peer, const std::vector<long>& deps);
+    
+  public:
+    TrainingModel();
+    
+    void init(int rank, int ranks, int stages, int microbatches, int gradientBuckets,
+              simtime_t computeTime, long activationBytes, long gradientBytes, int iterations);
+              
+    // Returns the next record of this rank; false once all iterations are generated
+    bool next(TraceRecord& record);
+    
+    // True if the record closes an iteration; iterations end in order
+    bool endsIteration(long id);
+    
+    simtime_t getComputePerIteration() const;
+    int getStage() const { return stage; }
+    int getReplicas() const { return replicas; }
+};
+
+} // namespace tomahawk6
+
+#endif
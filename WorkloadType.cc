@@ -0,0 +1,28 @@
+#include "WorkloadType.h"
+#include <cctype>
+#include <string>
+
+namespace tomahawk6 {
+
+AIWorkloadType parseWorkloadType(const char *name)
+{
+    // "AllReduce" -> "ALL_REDUCE"; "P2P" is the short form of POINT_TO_POINT
+    std::string enumName;
+    for (const char *c = name; *c; c++) {
+        if (c != name && std::isupper((unsigned char)*c) && std::islower((unsigned char)c[-1])) {
+            enumName += '_';
+        }
+        enumName += (char)std::toupper((unsigned char)*c);
+    }
+    if (enumName == "P2P") {
+        enumName = "POINT_TO_POINT";
+    }
+    
+    intval_t value = cEnum::get("tomahawk6::AIWorkloadType")->lookup(enumName.c_str(), -1);
+    if (value < 0) {
+        throw cRuntimeError("Unknown workload type '%s'", name);
+    }
+    return (AIWorkloadType)value;
+}
+
+} // namespace tomahawk6
@@ -0,0 +1,23 @@
+#ifndef __TOMAHAWK6_WORKLOADTYPE_H_
+#define __TOMAHAWK6_WORKLOADTYPE_H_
+
+#include <omnetpp.h>
+#include "inet/common/INETDefs.h"
+#include "AIPacket_m.h"
+
+using namespace omnetpp;
+using namespace inet;
+
+namespace tomahawk6 {
+
+/**
+ * Workload type from its parameter spelling ("AllReduce", "AllGather",
+ * "ReduceScatter", "P2P", "Broadcast", "AllToAll") or its AIWorkloadType
+ * enumerator name, resolved through the generated cEnum; unknown names
+ * are an error
+ */
+INET_API AIWorkloadType parseWorkloadType(const char *name);
+
+} // namespace tomahawk6
+
+#endif
@@ -45,11 +45,28 @@ class Tomahawk6Analyzer:
             
         print(f"Found {len(scalar_files)} scalar result files:")
         
-        for sca_file in scalar_files:
+        for sca_file in sorted(scalar_files):
             print(f"  - {sca_file.name}")
-            config_name = sca_file.stem.split('-')[0]
-            self.results[config_name] = self._parse_scalar_file(sca_file)
+            data = self._parse_scalar_file(sca_file)
+            self.results[self._run_key(sca_file, data)] = data
             
+    def _run_key(self, sca_file, data):
+        """Result key: scenario, plus iteration variables and repetition of sweep runs."""
+        # "<config>[_<sim time>]-<run>" from sweep.py and the analysis suite
+        key = sca_file.stem.split('-')[0]
+        metadata = data['metadata']
+        itervars = metadata.get('iterationvars', '').strip('"')
+        repetition = metadata.get('repetition', '0').strip('"')
+        if itervars:
+            key += f" [{itervars}]"
+        if repetition not in ('', '0'):
+            key += f" #{repetition}"
+            
+        # Without run attributes, fall back to the file name
+        if key in self.results:
+            key = sca_file.stem
+        return key
+        
     def _parse_scalar_file(self, sca_file):
         """Parse individual .sca file and extract metrics."""
         results = {
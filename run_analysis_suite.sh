@@ -17,6 +17,8 @@ export PATH="$OMNETPP_ROOT/bin:$PATH"
 # Configurations to test
 CONFIGS=(
     "BasicTest"
+    "BandwidthScalingTest"
+    "LatencyAnalysisTest"
 )
 
 # Simulation parameters
@@ -31,27 +33,13 @@ if [ -d results ]; then
     mv results/* results_archive/ 2>/dev/null || true
 fi
 
-# Run simulations with different parameters
-for config in "${CONFIGS[@]}"; do
-    for sim_time in "${SIM_TIMES[@]}"; do
-        scenario_name="${config}_${sim_time}"
-        echo ""
-        echo "Running scenario: $scenario_name"
-        echo "---------------------------------"
-        
-        # Run simulation
-        timeout 60s ./tomahawk6_dbg -u Cmdenv -c "$config" \
-            --sim-time-limit="$sim_time" \
-            --output-scalar-file="results/${scenario_name}.sca" \
-            --output-vector-file="results/${scenario_name}.vec"
-        
-        if [ $? -eq 0 ]; then
-            echo "✓ $scenario_name completed successfully"
-        else
-            echo "✗ $scenario_name failed or timed out"
-        fi
-    done
-done
+# Run every configuration at every time limit, one simulation per core;
+# the scalars are also merged into results/sweep.db
+python3 sweep.py "${CONFIGS[@]}" \
+    --executable ./tomahawk6_dbg \
+    --sim-time-limit "$(IFS=,; echo "${SIM_TIMES[*]}")" \
+    --result-dir results \
+    --timeout 60 || echo "✗ Some scenarios failed or timed out, see results/logs/"
 
 echo ""
 echo "Running comprehensive analysis..."
@@ -0,0 +1,151 @@
+#!/bin/bash
+#
+# Tomahawk 6 Parallel Simulation Runner
+# Partitions a fabric, runs it as local parallel-simulation processes and
+# reports speedup and an estimated synchronization overhead against a
+# sequential run
+#
+# Usage: ./run_parallel.sh [config] [partitions] [transport] [sim-time]
+#   config      ini configuration with a multi-switch fabric (LargeScaleTest)
+#   partitions  number of processes (4)
+#   transport   "pipe" (named pipes, default) or "file" (shared files)
+#   sim-time    simulated time of both runs (1ms)
+#
+# The sequential run doubles as the baseline: its TopologyConfigurator
+# writes the routes and the partition-id entries the parallel run uses.
+# Each switch stays whole with its endpoints; cables between partitions
+# provide the lookahead of the null message protocol.
+#
+
+set -e
+
+CONFIG=${1:-LargeScaleTest}
+PARTITIONS=${2:-4}
+TRANSPORT=${3:-pipe}
+SIM_TIME=${4:-1ms}
+
+echo "========================================"
+echo "Tomahawk 6 Parallel Simulation"
+echo "========================================"
+
+# Set OMNeT++ environment
+export OMNETPP_ROOT="/mnt/d/omnetpp-6.2.0"
+export PATH="$OMNETPP_ROOT/bin:$PATH"
+
+case "$TRANSPORT" in
+    pipe) COMM_CLASS="cNamedPipeCommunications" ;;
+    file) COMM_CLASS="cFileCommunications" ;;
+    *) echo "ERROR: unknown transport '$TRANSPORT' (use pipe or file)"; exit 1 ;;
+esac
+
+if [ ! -x ./tomahawk6 ]; then
+    echo "ERROR: ./tomahawk6 not found, build the simulation first"
+    exit 1
+fi
+
+OUT_DIR="results/parsim/${CONFIG}-${PARTITIONS}"
+COMM_DIR="$OUT_DIR/comm"
+ROUTES="$OUT_DIR/routes.txt"
+PARTITION_FILE="$OUT_DIR/partitions.ini"
+PARALLEL_INI="$OUT_DIR/parallel.ini"
+rm -rf "$OUT_DIR"
+mkdir -p "$COMM_DIR"
+
+now() {
+    date +%s.%N
+}
+
+last_event() {
+    grep -o 'event #[0-9]*' "$1" | tail -1 | tr -dc '0-9'
+}
+
+# Sequential baseline; also writes routes and partitioning
+echo ""
+echo "Sequential run: $CONFIG, $SIM_TIME simulated time"
+start=$(now)
+./tomahawk6 -u Cmdenv -c "$CONFIG" --sim-time-limit="$SIM_TIME" \
+    "--**.configurator.routeFile=\"$ROUTES\"" \
+    "--**.configurator.numPartitions=$PARTITIONS" \
+    "--**.configurator.partitionFile=\"$PARTITION_FILE\"" \
+    --output-scalar-file="$OUT_DIR/sequential.sca" \
+    --output-vector-file="$OUT_DIR/sequential.vec" > "$OUT_DIR/sequential.log" 2>&1
+SEQ_TIME=$(echo "$(now) $start" | awk '{print $1 - $2}')
+SEQ_EVENTS=$(last_event "$OUT_DIR/sequential.log")
+echo "✓ Sequential: ${SEQ_TIME}s wall clock, ${SEQ_EVENTS:-?} events"
+
+if [ ! -s "$PARTITION_FILE" ]; then
+    echo "ERROR: no partitioning written; does $CONFIG use a network with a TopologyConfigurator?"
+    exit 1
+fi
+head -1 "$PARTITION_FILE"
+
+# Parallel configuration on top of the selected one
+{
+    echo "[Config ${CONFIG}Parallel]"
+    echo "extends = $CONFIG"
+    echo "parallel-simulation = true"
+    echo "parsim-communications-class = \"$COMM_CLASS\""
+    echo "parsim-synchronization-class = \"cNullMessageProtocol\""
+    echo "parsim-namedpipecommunications-prefix = \"$COMM_DIR/\""
+    echo "parsim-filecommunications-prefix = \"$COMM_DIR/\""
+    echo "parsim-filecommunications-read-prefix = \"$COMM_DIR/read/\""
+    echo "**.configurator.routeFile = \"$ROUTES\""
+    echo "**.cognitiveRouter.routeFile = \"$ROUTES\""
+    echo "**.clockedCore.routeFile = \"$ROUTES\""
+    grep -v '^#' "$PARTITION_FILE"
+} > "$PARALLEL_INI"
+mkdir -p "$COMM_DIR/read"
+
+# One local process per partition
+echo ""
+echo "Parallel run: $PARTITIONS processes over $COMM_CLASS"
+start=$(now)
+pids=()
+for ((p = 0; p < PARTITIONS; p++)); do
+    ./tomahawk6 -u Cmdenv -f omnetpp.ini -f "$PARALLEL_INI" -c "${CONFIG}Parallel" -p$p,$PARTITIONS \
+        --sim-time-limit="$SIM_TIME" \
+        --output-scalar-file="$OUT_DIR/partition-$p.sca" \
+        --output-vector-file="$OUT_DIR/partition-$p.vec" > "$OUT_DIR/partition-$p.log" 2>&1 &
+    pids+=($!)
+done
+
+failed=0
+for pid in "${pids[@]}"; do
+    wait $pid || failed=1
+done
+PAR_TIME=$(echo "$(now) $start" | awk '{print $1 - $2}')
+
+if [ $failed -ne 0 ]; then
+    echo "✗ Parallel run FAILED, see $OUT_DIR/partition-*.log"
+    exit 1
+fi
+echo "✓ Parallel: ${PAR_TIME}s wall clock"
+
+# Speedup is measured. Busy time and synchronization overhead are
+# estimates, not parsim measurements: a process is assumed busy for its
+# events at the sequential cost per event, and the rest of its wall clock
+# time is attributed to null messages and waiting for the other partitions.
+echo ""
+echo "Results"
+echo "======="
+REPORT="$OUT_DIR/speedup.csv"
+echo "partition,events,est_busy_s,est_sync_overhead" > "$REPORT"
+for ((p = 0; p < PARTITIONS; p++)); do
+    events=$(last_event "$OUT_DIR/partition-$p.log")
+    echo "$p ${events:-0} $SEQ_TIME ${SEQ_EVENTS:-0} $PAR_TIME" | awk '{
+        busy = $4 > 0 ? $2 * $3 / $4 : 0
+        overhead = $5 > 0 ? 1 - busy / $5 : 0
+        printf "%d,%d,%.3f,%.3f\n", $1, $2, busy, overhead
+    }' >> "$REPORT"
+done
+column -s, -t "$REPORT"
+
+echo "$SEQ_TIME $PAR_TIME $PARTITIONS" | awk '{
+    speedup = $2 > 0 ? $1 / $2 : 0
+    printf "Speedup: %.2fx on %d processes (efficiency %.0f%%)\n", speedup, $3, speedup / $3 * 100
+}'
+awk -F, 'NR > 1 {sum += $4; n++} END {if (n > 0) printf "Mean synchronization overhead (estimated from event counts): %.0f%%\n", sum / n * 100}' "$REPORT"
+grep -h '"Partition\|"Lookahead' "$OUT_DIR/sequential.sca" 2>/dev/null | sed 's/^scalar [^ ]* /  /' || true
+
+echo ""
+echo "Logs, result files and speedup.csv in $OUT_DIR"
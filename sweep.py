@@ -0,0 +1,411 @@
+#!/usr/bin/env python3
+"""
+Tomahawk 6 Parameter Sweep Runner
+
+Runs every iteration and repetition of one or more ini configurations as
+independent simulation processes spread over all local cores. Runs are
+dealt to per-worker queues; a worker that drains its own queue steals from
+the back of the longest remaining one, so long runs (large fabrics, high
+loads) do not leave the other cores idle at the end of a sweep.
+
+The scalars of each finished run are merged into one SQLite result store as
+soon as the run completes. An interrupted sweep resumes where it stopped:
+runs already marked done in the store are skipped.
+
+Version: 1.0
+"""
+
+import os
+import re
+import sys
+import time
+import shlex
+import sqlite3
+import argparse
+import threading
+import subprocess
+from collections import deque
+from datetime import datetime
+from pathlib import Path
+
+SCHEMA = """
+CREATE TABLE IF NOT EXISTS runs (
+    job TEXT PRIMARY KEY,
+    config TEXT,
+    run INTEGER,
+    sim_time TEXT,
+    description TEXT,
+    status TEXT,
+    exit_code INTEGER,
+    wall_time REAL,
+    finished TEXT
+);
+CREATE TABLE IF NOT EXISTS scalars (
+    job TEXT,
+    module TEXT,
+    name TEXT,
+    value REAL
+);
+CREATE TABLE IF NOT EXISTS itervars (
+    job TEXT,
+    name TEXT,
+    value TEXT
+);
+CREATE INDEX IF NOT EXISTS scalars_job ON scalars (job);
+CREATE INDEX IF NOT EXISTS scalars_name ON scalars (name);
+"""
+
+class Job:
+    """One simulation run: a configuration, its run number and an optional time limit."""
+    
+    def __init__(self, config, run, sim_time=None, description=""):
+        self.config = config
+        self.run = run
+        self.sim_time = sim_time
+        self.description = description
+        
+    @property
+    def scenario(self):
+        # Matches the <config>_<sim time> scenario names of the analysis suite
+        return f"{self.config}_{self.sim_time}" if self.sim_time else self.config
+        
+    @property
+    def key(self):
+        return f"{self.scenario}-{self.run}"
+
+class WorkStealingQueue:
+    """Per-worker job deques; idle workers steal from the longest one."""
+    
+    def __init__(self, jobs, workers):
+        self.lock = threading.Lock()
+        self.deques = [deque() for _ in range(workers)]
+        self.steals = 0
+        
+        # Round robin, so neighbouring runs of one iteration land on
+        # different workers
+        for i, job in enumerate(jobs):
+            self.deques[i % workers].append(job)
+            
+    def take(self, worker):
+        with self.lock:
+            own = self.deques[worker]
+            if own:
+                return own.popleft()
+            victim = max(self.deques, key=len)
+            if victim:
+                self.steals += 1
+                return victim.pop()
+            return None
+
+class ResultStore:
+    """Merged SQLite store of run status, iteration variables and scalars."""
+    
+    def __init__(self, path):
+        Path(path).parent.mkdir(parents=True, exist_ok=True)
+        self.lock = threading.Lock()
+        self.db = sqlite3.connect(path, check_same_thread=False)
+        self.db.executescript(SCHEMA)
+        self.db.commit()
+        
+    def completed(self):
+        rows = self.db.execute("SELECT job FROM runs WHERE status = 'done'")
+        return {row[0] for row in rows}
+        
+    def forget(self, configs):
+        with self.lock:
+            keys = [row[0] for row in self.db.execute(
+                f"SELECT job FROM runs WHERE config IN ({','.join('?' * len(configs))})", configs)]
+            for table in ("runs", "scalars", "itervars"):
+                self.db.executemany(f"DELETE FROM {table} WHERE job = ?", [(k,) for k in keys])
+            self.db.commit()
+            
+    def record(self, job, status, exit_code, wall_time, scalars=(), itervars=()):
+        with self.lock:
+            # Replace whatever a previous, interrupted attempt left behind
+            for table in ("scalars", "itervars"):
+                self.db.execute(f"DELETE FROM {table} WHERE job = ?", (job.key,))
+            self.db.executemany("INSERT INTO scalars VALUES (?, ?, ?, ?)",
+                                [(job.key, m, n, v) for m, n, v in scalars])
+            self.db.executemany("INSERT INTO itervars VALUES (?, ?, ?)",
+                                [(job.key, n, v) for n, v in itervars])
+            self.db.execute("INSERT OR REPLACE INTO runs VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?)",
+                            (job.key, job.config, job.run, job.sim_time, job.description,
+                             status, exit_code, wall_time, datetime.now().isoformat(timespec='seconds')))
+            self.db.commit()
+            
+    def close(self):
+        self.db.close()
+
+def parse_scalar_file(sca_file):
+    """Return the scalars (statistic fields included) and iteration variables of a .sca file."""
+    scalars = []
+    itervars = []
+    statistic = None
+    
+    with open(sca_file) as f:
+        for line in f:
+            if not line.strip():
+                continue
+            try:
+                fields = shlex.split(line)
+            except ValueError:
+                continue
+            kind = fields[0]
+            if kind == 'scalar' and len(fields) >= 4:
+                scalars.append((fields[1], fields[2], _to_float(fields[3])))
+                statistic = None
+            elif kind == 'statistic' and len(fields) >= 3:
+                statistic = (fields[1], fields[2])
+            elif kind == 'field' and statistic is not None and len(fields) >= 3:
+                scalars.append((statistic[0], f"{statistic[1]}:{fields[1]}", _to_float(fields[2])))
+            elif kind == 'itervar' and len(fields) >= 3:
+                itervars.append((fields[1], fields[2]))
+            elif kind not in ('attr', 'bin'):
+                statistic = None
+                
+    return scalars, itervars
+
+def _to_float(value):
+    try:
+        return float(value)
+    except ValueError:
+        return None
+
+class SweepRunner:
+    """Enumerates the runs of a sweep and executes them on a pool of workers."""
+    
+    def __init__(self, args):
+        self.args = args
+        self.result_dir = Path(args.result_dir)
+        self.log_dir = self.result_dir / "logs"
+        self.store = ResultStore(args.db or str(self.result_dir / "sweep.db"))
+        self.stopping = threading.Event()
+        self.processes = set()
+        self.print_lock = threading.Lock()
+        self.done = 0
+        self.failed = 0
+        self.busy_time = 0.0
+        self.total = 0
+        
+    def enumerate_runs(self, config):
+        """Ask the simulation for the runs (iterations x repetitions) of a configuration."""
+        cmd = [self.args.executable, "-u", "Cmdenv", "-c", config, "-q", "runs"]
+        output = subprocess.run(cmd, capture_output=True, text=True).stdout
+        
+        runs = []
+        for line in output.splitlines():
+            match = re.match(r'\s*Run (\d+):\s*(.*)', line)
+            if match:
+                runs.append((int(match.group(1)), match.group(2).strip()))
+        if not runs:
+            raise RuntimeError(f"no runs found for configuration '{config}':\n{output}")
+        return runs
+        
+    def build_jobs(self):
+        sim_times = self.args.sim_time_limit.split(',') if self.args.sim_time_limit else [None]
+        jobs = []
+        for config in self.args.configs:
+            runs = self.enumerate_runs(config)
+            print(f"  {config}: {len(runs)} run(s) x {len(sim_times)} time limit(s)")
+            for run, description in runs:
+                for sim_time in sim_times:
+                    jobs.append(Job(config, run, sim_time, description))
+        return jobs
+        
+    def command(self, job):
+        cmd = [self.args.executable, "-u", "Cmdenv", "-c", job.config, "-r", str(job.run),
+               "--cmdenv-express-mode=true",
+               f"--output-scalar-file={self.result_dir / job.key}.sca",
+               f"--output-vector-file={self.result_dir / job.key}.vec"]
+        if job.sim_time:
+            cmd.append(f"--sim-time-limit={job.sim_time}")
+        if self.args.no_vectors:
+            cmd.append("--**.vector-recording=false")
+        return cmd
+        
+    def execute(self, job, worker):
+        sca_file = self.result_dir / f"{job.key}.sca"
+        if sca_file.exists():
+            sca_file.unlink()
+            
+        start = time.time()
+        exit_code = None
+        with open(self.log_dir / f"{job.key}.log", "w") as log:
+            process = subprocess.Popen(self.command(job), stdout=log, stderr=subprocess.STDOUT)
+            with self.print_lock:
+                self.processes.add(process)
+            try:
+                exit_code = process.wait(timeout=self.args.timeout)
+            except subprocess.TimeoutExpired:
+                process.kill()
+                process.wait()
+            finally:
+                with self.print_lock:
+                    self.processes.discard(process)
+        wall_time = time.time() - start
+        
+        # Interrupted runs stay pending for the next attempt
+        if self.stopping.is_set():
+            return
+            
+        if exit_code == 0 and sca_file.exists():
+            scalars, itervars = parse_scalar_file(sca_file)
+            self.store.record(job, 'done', exit_code, wall_time, scalars, itervars)
+            status = "✓"
+        else:
+            self.store.record(job, 'failed' if exit_code is not None else 'timeout', exit_code, wall_time)
+            status = "✗"
+            
+        with self.print_lock:
+            self.busy_time += wall_time
+            if status == "✓":
+                self.done += 1
+            else:
+                self.failed += 1
+            finished = self.done + self.failed
+            print(f"[{finished}/{self.total}] {status} {job.key} ({job.description or 'no iteration'}) "
+                  f"{wall_time:.1f}s on worker {worker}")
+                  
+    def worker(self, index, queue):
+        while not self.stopping.is_set():
+            job = queue.take(index)
+            if job is None:
+                return
+            self.execute(job, index)
+            
+    def run(self):
+        self.result_dir.mkdir(parents=True, exist_ok=True)
+        self.log_dir.mkdir(parents=True, exist_ok=True)
+        
+        if self.args.restart:
+            self.store.forget(self.args.configs)
+            
+        print("Enumerating runs...")
+        jobs = self.build_jobs()
+        completed = self.store.completed()
+        pending = [job for job in jobs if job.key not in completed]
+        self.total = len(pending)
+        
+        if len(pending) < len(jobs):
+            print(f"Resuming: {len(jobs) - len(pending)} of {len(jobs)} runs already in the store")
+        if not pending:
+            print("Nothing to do.")
+            return 0
+            
+        workers = max(1, min(self.args.jobs, len(pending)))
+        queue = WorkStealingQueue(pending, workers)
+        print(f"Running {len(pending)} runs on {workers} worker(s)\n")
+        
+        start = time.time()
+        threads = [threading.Thread(target=self.worker, args=(i, queue), daemon=True)
+                   for i in range(workers)]
+        for thread in threads:
+            thread.start()
+        try:
+            for thread in threads:
+                while thread.is_alive():
+                    thread.join(0.5)
+        except KeyboardInterrupt:
+            self.stopping.set()
+            with self.print_lock:
+                for process in self.processes:
+                    process.terminate()
+            for thread in threads:
+                thread.join()
+            print(f"\nSweep interrupted: {self.done} runs stored, rerun the same command to resume.")
+            return 1
+        finally:
+            self.store.close()
+            
+        elapsed = time.time() - start
+        print(f"\nSweep finished: {self.done} done, {self.failed} failed in {elapsed:.1f}s")
+        if elapsed > 0:
+            print(f"Parallel speedup: {self.busy_time / elapsed:.2f}x on {workers} worker(s), "
+                  f"{queue.steals} steal(s)")
+        return 1 if self.failed else 0
+
+def main():
+    """Main function with command line interface."""
+    parser = argparse.ArgumentParser(
+        description="Run Tomahawk 6 parameter sweeps on all local cores",
+        formatter_class=argparse.RawDescriptionHelpFormatter,
+        epilog="""
+Examples:
+  python sweep.py BandwidthScalingTest                    # All runs on all cores
+  python sweep.py LatencyAnalysisTest -j 8 --no-vectors   # 8 workers, scalars only
+  python sweep.py BasicTest --sim-time-limit 1s,5s,10s    # Each run at three time limits
+  python sweep.py BandwidthScalingTest --restart          # Discard stored runs, start over
+
+Query the merged results, e.g.:
+  sqlite3 results/sweep.db "SELECT r.config, r.description, s.value FROM runs r
+      JOIN scalars s USING (job) WHERE s.name = 'Latency p99'"
+        """
+    )
+    
+    parser.add_argument(
+        'configs',
+        nargs='+',
+        help='ini configurations to sweep'
+    )
+    
+    parser.add_argument(
+        '--jobs', '-j',
+        type=int,
+        default=os.cpu_count() or 1,
+        help='Number of simulations run in parallel (default: number of cores)'
+    )
+    
+    parser.add_argument(
+        '--sim-time-limit',
+        help='Comma separated time limits; every run is repeated for each'
+    )
+    
+    parser.add_argument(
+        '--executable',
+        default='./tomahawk6',
+        help='Simulation executable (default: ./tomahawk6)'
+    )
+    
+    parser.add_argument(
+        '--result-dir',
+        default='results',
+        help='Directory for result files and logs (default: results)'
+    )
+    
+    parser.add_argument(
+        '--db',
+        help='Merged result store (default: <result-dir>/sweep.db)'
+    )
+    
+    parser.add_argument(
+        '--timeout',
+        type=float,
+        help='Wall clock limit per run in seconds'
+    )
+    
+    parser.add_argument(
+        '--no-vectors',
+        action='store_true',
+        help='Disable vector recording'
+    )
+    
+    parser.add_argument(
+        '--restart',
+        action='store_true',
+        help='Discard stored runs of these configurations instead of resuming'
+    )
+    
+    args = parser.parse_args()
+    
+    if not os.path.exists(args.executable):
+        print(f"Error: simulation executable '{args.executable}' not found, build the simulation first.")
+        sys.exit(1)
+        
+    try:
+        sys.exit(SweepRunner(args).run())
+    except RuntimeError as e:
+        print(f"Error: {e}")
+        sys.exit(1)
+
+if __name__ == "__main__":
+    main()